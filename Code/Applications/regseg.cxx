@@ -56,6 +56,8 @@ int main(int argc, char *argv[]) {
 	OptimizerType::AddOptions( opt_desc );
 	bpo::options_description fun_desc("Functional options (by levels)");
 	FunctionalType::AddOptions( fun_desc );
+	bpo::options_description reg_desc("Registration options (by levels)");
+	RegistrationType::AddOptions( reg_desc );
 
 
 	std::vector< std::string > cli_token;
@@ -95,7 +97,7 @@ int main(int argc, char *argv[]) {
 	std::vector< bpo::variables_map > vm_levels;
 
 
-	all_desc.add( general_desc ).add( opt_desc ).add( fun_desc );
+	all_desc.add( general_desc ).add( opt_desc ).add( fun_desc ).add( reg_desc );
 
 	try {
 		// Deal with general options
@@ -120,6 +122,7 @@ int main(int argc, char *argv[]) {
 				bpo::options_description ndesc("Level " + boost::lexical_cast<std::string> (i) + " options");
 				OptimizerType::AddOptions( ndesc );
 				FunctionalType::AddOptions( ndesc );
+				RegistrationType::AddOptions( ndesc );
 
 				bpo::store(	bpo::command_line_parser( cli_levels[i] ).options(ndesc).run(), vm );
 				bpo::notify( vm );
@@ -46,7 +46,13 @@
 #include <itkProcessObject.h>
 #include <itkCommand.h>
 #include <itkDataObjectDecorator.h>
+#include <itkVectorIndexSelectionCastImageFilter.h>
+#include <itkComposeImageFilter.h>
+#include <itkDiscreteGaussianImageFilter.h>
+#include <itkResampleImageFilter.h>
+#include <itkLinearInterpolateImageFunction.h>
 #include <vector>       // std::vector
+#include <map>          // std::map
 #include <iostream>     // std::cout
 
 
@@ -139,6 +145,18 @@ public:
 
 	typedef typename FunctionalType::ProbabilityMapType       FixedMaskType;
 	typedef typename FixedMaskType::ConstPointer              FixedMaskConstPointer;
+	typedef typename FunctionalType::SmoothingCacheType       SmoothingCacheType;
+	typedef typename FunctionalType::ChannelType              ChannelType;
+
+	typedef itk::FixedArray< double, Dimension >              ShrinkFactorsType;
+	typedef std::vector< ShrinkFactorsType >                  ShrinkFactorsList;
+	typedef std::vector< double >                             ResolutionKeyType;
+	typedef std::map< ResolutionKeyType,
+			          ReferenceImageConstPointer >            ReferencePyramidType;
+	typedef std::map< ResolutionKeyType,
+			          FixedMaskConstPointer >                 MaskPyramidType;
+	typedef std::map< ResolutionKeyType,
+			          SmoothingCacheType >                    SmoothingPyramidType;
 
 
 	typedef OptimizerBase< FunctionalType >                   OptimizerType;
@@ -207,7 +225,10 @@ public:
 
 	//itkGetConstMacro( StopConditionDescription, StopConditionDescriptionType );
 
-	void SetReferenceNames(const std::vector< std::string > s) { this->m_ReferenceNames = std::vector<std::string>(s); }
+	void SetReferenceNames(const std::vector< std::string > s) {
+		this->m_ReferenceNames = std::vector<std::string>(s);
+		this->ClearImageCache();
+	}
 	void SetPriorsNames(const std::vector< std::string > s) { this->m_PriorsNames = std::vector<std::string>(s); }
 	void SetTargetNames(const std::vector< std::string > s) { this->m_TargetNames = std::vector<std::string>(s); }
 
@@ -236,6 +257,10 @@ public:
 
 	rstkVectorMethods( NumberOfIterations, NumberValueType );
 
+	/** Downsampling factors of the fixed images in each level (1.0 is full resolution) */
+	rstkSetVectorElement( ShrinkFactors, ShrinkFactorsType );
+	rstkGetConstVectorElement( ShrinkFactors, ShrinkFactorsType );
+
 	rstkVectorMethods( StepSize, OptCompValueType );
 	rstkVectorMethods( Alpha, OptCompValueType );
 	rstkVectorMethods( Beta, OptCompValueType );
@@ -250,7 +275,7 @@ public:
 	void AddShapeTarget( const PriorsType *surf ) { this->m_Target.push_back( surf ); }
 
 	// Methods inherited from the Configurable interface
-	virtual void AddOptions( SettingsDesc& opts ) const {};
+	static void AddOptions( SettingsDesc& opts );
 
 	void SetSettingsOfLevel( size_t l, SettingsMap& map );
 
@@ -282,6 +307,11 @@ protected:
 	void ConcatenateFields( size_t level = 0 );
 	void SetUpLevel( size_t level );
 	void Stop( StopConditionType code, std::string msg );
+	void ClearImageCache();
+
+	template< typename TImage >
+	typename TImage::Pointer ShrinkImage( const TImage* image, const ShrinkFactorsType& factors ) const;
+	ReferenceImagePointer ShrinkReferenceImage( const ShrinkFactorsType& factors ) const;
 
 	virtual void ParseSettings() {};
 private:
@@ -305,6 +335,7 @@ private:
 	StopConditionDescriptionType  m_StopConditionDescription;
 
 	GridSizeList m_GridSchedule;
+	ShrinkFactorsList m_ShrinkFactors;
 	GridSizeList m_FactorsSchedule;
 	GridSizeType m_MaxGridSize;
 	GridSizeType m_MinGridSize;
@@ -339,6 +370,14 @@ private:
 	size_t m_TransformNumberOfThreads;
 
 	std::vector< std::string > m_ReferenceNames;
+
+	// Images that do not change between levels, so they are loaded and processed only once
+	ReferenceImageConstPointer m_CachedReference;
+	FixedMaskConstPointer m_CachedMaskSource;
+	FixedMaskConstPointer m_CachedMask;
+	ReferencePyramidType m_ReferencePyramid;
+	MaskPyramidType m_MaskPyramid;
+	SmoothingPyramidType m_SmoothingCache;
 	std::vector< std::string > m_PriorsNames;
 	std::vector< std::string > m_TargetNames;
 };
@@ -164,12 +164,46 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 
 	this->m_Functional = FunctionalType::New();
 	this->m_Functional->SetSettings( this->m_Config[level] );
-	this->m_Functional->LoadReferenceImage( this->m_ReferenceNames );
 
-	if (this->m_FixedMask.IsNotNull() ) {
+	// Full resolution images are read and processed once, and shared by all levels
+	if ( this->m_CachedReference.IsNull() ) {
+		this->m_Functional->LoadReferenceImage( this->m_ReferenceNames );
+		this->m_CachedReference = this->m_Functional->GetReferenceImage();
+	} else {
+		this->m_Functional->SetReferenceImage( this->m_CachedReference );
+	}
+
+	if (this->m_FixedMask.IsNotNull() && this->m_CachedMaskSource != this->m_FixedMask ) {
 		this->m_Functional->SetBackgroundMask(this->m_FixedMask);
+		this->m_CachedMask = this->m_Functional->GetBackgroundMask();
+		this->m_CachedMaskSource = this->m_FixedMask;
+		this->m_MaskPyramid.clear();
+	}
+
+	// Coarse levels evaluate the data term on downsampled images
+	const ShrinkFactorsType factors = this->m_ShrinkFactors[level];
+	ResolutionKeyType key( factors.Begin(), factors.End() );
+	bool fullres = true;
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		if ( factors[i] != 1.0 ) fullres = false;
+	}
+
+	if ( !fullres ) {
+		if ( this->m_ReferencePyramid.count( key ) == 0 ) {
+			this->m_ReferencePyramid[key] = this->ShrinkReferenceImage( factors );
+		}
+		this->m_Functional->SetReferenceImage( this->m_ReferencePyramid[key] );
+
+		if ( this->m_CachedMask.IsNotNull() && this->m_MaskPyramid.count( key ) == 0 ) {
+			this->m_MaskPyramid[key] = this->template ShrinkImage< FixedMaskType >( this->m_CachedMask, factors );
+		}
 	}
 
+	if ( this->m_CachedMask.IsNotNull() ) {
+		this->m_Functional->SetProcessedBackgroundMask( fullres?this->m_CachedMask:this->m_MaskPyramid[key] );
+	}
+	this->m_Functional->SetSmoothingCache( &this->m_SmoothingCache[key] );
+
 	if ( level == 0 ) {
 		this->m_Functional->LoadShapePriors( this->m_PriorsNames );
 	} else {
@@ -222,6 +256,8 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	this->m_NumberOfLevels = levels;
 
 	m_GridSchedule.resize(m_NumberOfLevels);
+	ShrinkFactorsType ones; ones.Fill( 1.0 );
+	m_ShrinkFactors.resize( this->m_NumberOfLevels, ones );
 	m_NumberOfIterations.resize( this->m_NumberOfLevels );
 	m_StepSize.resize( this->m_NumberOfLevels );
 	m_Alpha.resize( this->m_NumberOfLevels );
@@ -241,6 +277,83 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	this->InvokeEvent( itk::EndEvent() );
 }
 
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+void
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::ClearImageCache() {
+	this->m_CachedReference = NULL;
+	this->m_CachedMaskSource = NULL;
+	this->m_CachedMask = NULL;
+	this->m_ReferencePyramid.clear();
+	this->m_MaskPyramid.clear();
+	this->m_SmoothingCache.clear();
+}
+
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+template < typename TImage >
+typename TImage::Pointer
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::ShrinkImage( const TImage* image, const ShrinkFactorsType& factors ) const {
+	typedef itk::DiscreteGaussianImageFilter< TImage, TImage >        SmoothingFilter;
+	typedef itk::ResampleImageFilter< TImage, TImage >                ResampleFilter;
+	typedef itk::LinearInterpolateImageFunction< TImage >             Interpolator;
+
+	typename TImage::SpacingType spacing = image->GetSpacing();
+	typename TImage::SizeType size = image->GetLargestPossibleRegion().GetSize();
+	typename TImage::SpacingType newspacing;
+	typename TImage::SizeType newsize;
+	typename TImage::PointType neworigin;
+	typename SmoothingFilter::ArrayType variance;
+	itk::ContinuousIndex< double, Dimension > first;
+
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		// Keep the physical extent of the image, the new voxels tile the old ones
+		newsize[i] = std::max< size_t >( 1, floor( size[i] / factors[i] + 0.5 ) );
+		newspacing[i] = spacing[i] * size[i] / newsize[i];
+		first[i] = -0.5 + 0.5 * newspacing[i] / spacing[i];
+
+		// Anti-aliasing, as in itk::MultiResolutionPyramidImageFilter
+		variance[i] = ( newsize[i] < size[i] )?pow( 0.5 * newspacing[i], 2.0 ):0.0;
+	}
+	image->TransformContinuousIndexToPhysicalPoint( first, neworigin );
+
+	typename SmoothingFilter::Pointer smooth = SmoothingFilter::New();
+	smooth->SetInput( image );
+	smooth->SetVariance( variance );
+	smooth->UseImageSpacingOn();
+
+	typename ResampleFilter::Pointer res = ResampleFilter::New();
+	res->SetInput( smooth->GetOutput() );
+	res->SetInterpolator( Interpolator::New() );
+	res->SetSize( newsize );
+	res->SetOutputSpacing( newspacing );
+	res->SetOutputOrigin( neworigin );
+	res->SetOutputDirection( image->GetDirection() );
+	res->SetDefaultPixelValue( 0.0 );
+	res->Update();
+	return res->GetOutput();
+}
+
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+typename ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >::ReferenceImagePointer
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::ShrinkReferenceImage( const ShrinkFactorsType& factors ) const {
+	typedef itk::VectorIndexSelectionCastImageFilter< ReferenceImageType, ChannelType > ChannelSelector;
+	typedef itk::ComposeImageFilter< ChannelType, ReferenceImageType >                 ComposeFilter;
+
+	typename ComposeFilter::Pointer comb = ComposeFilter::New();
+	size_t nchannels = this->m_CachedReference->GetNumberOfComponentsPerPixel();
+	for ( size_t c = 0; c < nchannels; c++ ) {
+		typename ChannelSelector::Pointer sel = ChannelSelector::New();
+		sel->SetInput( this->m_CachedReference );
+		sel->SetIndex( c );
+		sel->Update();
+		comb->SetInput( c, this->template ShrinkImage< ChannelType >( sel->GetOutput(), factors ) );
+	}
+	comb->Update();
+	return comb->GetOutput();
+}
+
 template < typename TFixedImage, typename TTransform, typename TComputationalValue >
 void
 ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
@@ -289,7 +402,7 @@ template < typename TFixedImage, typename TTransform, typename TComputationalVal
 void
 ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 ::GenerateFinalDisplacementField() {
-	this->m_OutputTransform->SetOutputReference(this->m_Functional->GetReferenceImage());
+	this->m_OutputTransform->SetOutputReference(this->m_CachedReference);
 	this->m_OutputTransform->Interpolate();
 	this->m_DisplacementField = this->m_OutputTransform->GetDisplacementField();
 }
@@ -315,9 +428,33 @@ ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
 	}
 
 	this->m_Config[l] = map;
+
+	if( map.count( "shrink-factors" ) ) {
+		std::vector< double > f = map["shrink-factors"].as< std::vector< double > >();
+		if ( f.size() != 1 && f.size() != Dimension ) {
+			itkExceptionMacro( << "shrink-factors of level " << l << " must have 1 or " << Dimension << " values.");
+		}
+
+		ShrinkFactorsType factors;
+		for( size_t i = 0; i < Dimension; i++ ) {
+			factors[i] = ( f.size() == 1 )?f[0]:f[i];
+			if ( factors[i] < 1.0 ) {
+				itkExceptionMacro( << "shrink-factors of level " << l << " cannot be lower than 1.0.");
+			}
+		}
+		this->SetShrinkFactorsElement( l, factors );
+	}
 	this->Modified();
 }
 
+template < typename TFixedImage, typename TTransform, typename TComputationalValue >
+void
+ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >
+::AddOptions( SettingsDesc& opts ) {
+	opts.add_options()
+			("shrink-factors", bpo::value< std::vector<double> >()->multitoken(), "downsample the fixed images and mask by these factors in this level (one isotropic value or one per axis)");
+}
+
 
 template < typename TFixedImage, typename TTransform, typename TComputationalValue >
 typename ACWERegistrationMethod< TFixedImage, TTransform, TComputationalValue >::FieldList
@@ -18,12 +18,21 @@
 #include <itkLinearInterpolateImageFunction.h>
 #include <itkSize.h>
 #include <itkDefaultConvertPixelTraits.h>
+#include <vector>
 
 namespace rstk
 {
 /** \class DownsampleAveragingFilter
  * \brief Shrink filter with averaging
  *
+ * Each output voxel is the average of the input voxels it overlaps,
+ * weighted by the overlap. Input and output grids must share their
+ * axes (only spacing, origin and flips may differ), so that the
+ * weights are separable and precomputed once per axis. When the
+ * output spacing is an integer multiple of the input spacing and the
+ * grids are aligned, all weights are one and the average reduces to
+ * a box filter with integer strides.
+ *
  * Output information (spacing, size and direction) for the output
  * image should be set. This information has the normal defaults of
  * unit spacing, zero origin and identity direction. Optionally, the
@@ -232,8 +241,19 @@ private:
   DownsampleAveragingFilter(const Self &); //purposely not implemented
   void operator=(const Self &);      //purposely not implemented
 
-  SizeType        m_WindowSize;           // Size of the averaging window
-  size_t          m_WindowN;
+  /** Averaging weights of the input voxels along one axis, for each output index */
+  struct AxisWeights {
+    std::vector< long >   first;    // first input index of each window
+    std::vector< size_t > count;    // input voxels in each window
+    std::vector< size_t > offset;   // position of each window in weights
+    std::vector< double > weights;  // overlap of each input voxel
+    std::vector< double > total;    // sum of the weights of each window
+    bool                  uniform;  // all weights are one
+  };
+
+  void ComputeAxisWeights();
+
+  AxisWeights     m_AxisWeights[ImageDimension];
   PixelType       m_DefaultPixelValue;    // default pixel value
                                           // if the point is
                                           // outside the image
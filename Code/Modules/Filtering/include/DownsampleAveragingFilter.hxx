@@ -18,6 +18,8 @@
 #include <itkSpecialCoordinatesImage.h>
 #include <itkDefaultConvertPixelTraits.h>
 #include <itkNumericTraitsVectorPixel.h>
+#include <algorithm>
+#include <cmath>
 
 namespace rstk {
 /**
@@ -26,8 +28,7 @@ namespace rstk {
 template<class TInputImage, class TOutputImage, class TPrecisionType>
 DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::DownsampleAveragingFilter() :
   m_UseReferenceImage(false),
-  m_NumberOfComponents(0),
-  m_WindowN(0) {
+  m_NumberOfComponents(0) {
 	m_OutputOrigin.Fill(0.0);
 	m_OutputSpacing.Fill(1.0);
 	m_OutputDirection.SetIdentity();
@@ -98,36 +99,98 @@ void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::SetOu
 
 /**
  * Set up state of filter before multi-threading.
- * InterpolatorType::SetInputImage is not thread-safe and hence
- * has to be set up before ThreadedGenerateData
+ * The averaging weights along each axis are computed here, once,
+ * and shared read-only by all the threads.
  */
 template<class TInputImage, class TOutputImage, class TPrecisionType>
 void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::BeforeThreadedGenerateData() {
-	size_t tmpN = 1;
+	this->ComputeAxisWeights();
+}
 
-	SizeType inputSize = this->GetInput()->GetLargestPossibleRegion().GetSize();
-	SpacingType inputSpacing = this->GetInput()->GetSpacing();
+/**
+ * Overlap of each output voxel with the input voxels, along each axis.
+ * Output index o is centered at input continuous index c0 + m*o, and
+ * covers |m| input voxels.
+ */
+template<class TInputImage, class TOutputImage, class TPrecisionType>
+void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::ComputeAxisWeights() {
+	InputImageConstPointer inputPtr = this->GetInput();
+	OutputImagePointer outputPtr = this->GetOutput();
 
-	double inVolume = 1.0;
-	double outVolume = 1.0;
-	// Compute pixel ratios
-	for (size_t i = 0; i < ImageDimension; i++) {
-		m_WindowSize[i] = vcl_ceil( inputSpacing[i] / m_OutputSpacing[i]) + 1;
+	InputImageRegionType inRegion = inputPtr->GetLargestPossibleRegion();
+	OutputImageRegionType outRegion = outputPtr->GetLargestPossibleRegion();
+	typename TInputImage::SpacingType inSpacing = inputPtr->GetSpacing();
+	SpacingType outSpacing = outputPtr->GetSpacing();
+	typename TInputImage::DirectionType inDirection = inputPtr->GetDirection();
+	DirectionType outDirection = outputPtr->GetDirection();
+	typename TInputImage::PointType inOrigin = inputPtr->GetOrigin();
+	PointType outOrigin = outputPtr->GetOrigin();
+
+	// Directions are orthonormal, the inverse of inDirection is its transpose
+	double m[ImageDimension][ImageDimension];
+	double c0[ImageDimension];
+	for (size_t r = 0; r < ImageDimension; r++) {
+		c0[r] = 0.0;
+		for (size_t c = 0; c < ImageDimension; c++) {
+			double d = 0.0;
+			for (size_t k = 0; k < ImageDimension; k++) {
+				d+= inDirection(k, r) * outDirection(k, c);
+			}
+			m[r][c] = d * outSpacing[c] / inSpacing[r];
+			c0[r]+= inDirection(c, r) * (outOrigin[c] - inOrigin[c]) / inSpacing[r];
+		}
 	}
-	m_WindowN = tmpN;
 
-	// find the actual number of threads
-	long nbOfThreads = this->GetNumberOfThreads();
-	if (itk::MultiThreader::GetGlobalMaximumNumberOfThreads() != 0) {
-		nbOfThreads = vnl_math_min(this->GetNumberOfThreads(),
-				itk::MultiThreader::GetGlobalMaximumNumberOfThreads());
+	for (size_t r = 0; r < ImageDimension; r++) {
+		for (size_t c = 0; c < ImageDimension; c++) {
+			if ( r != c && fabs(m[r][c]) > 1.0e-6 * fabs(m[c][c]) ) {
+				itkExceptionMacro(<< "Input and output grids must have the same axes");
+			}
+		}
 	}
-	// number of threads can be constrained by the region size, so call the
-	// SplitRequestedRegion
-	// to get the real number of threads which will be used
-	OutputImageRegionType splitRegion; // dummy region - just to call the following method
-	nbOfThreads = this->SplitRequestedRegion(0, nbOfThreads, splitRegion);
 
+	for (size_t d = 0; d < ImageDimension; d++) {
+		AxisWeights& axis = m_AxisWeights[d];
+		size_t n = outRegion.GetSize()[d];
+		long ostart = outRegion.GetIndex()[d];
+		long ifirst = inRegion.GetIndex()[d];
+		long ilast = ifirst + static_cast<long>(inRegion.GetSize()[d]) - 1;
+		double h = 0.5 * fabs(m[d][d]);
+
+		axis.first.resize(n);
+		axis.count.resize(n);
+		axis.offset.resize(n);
+		axis.total.resize(n);
+		axis.weights.clear();
+		axis.uniform = true;
+
+		for (size_t o = 0; o < n; o++) {
+			double c = c0[d] + m[d][d] * (ostart + static_cast<long>(o));
+			double lo = c - h;
+			double hi = c + h;
+			long i0 = std::max(static_cast<long>(vcl_floor(lo + 0.5)), ifirst);
+			long i1 = std::min(static_cast<long>(vcl_ceil(hi - 0.5)), ilast);
+
+			axis.offset[o] = axis.weights.size();
+			axis.first[o] = i0;
+			axis.total[o] = 0.0;
+			for (long i = i0; i <= i1; i++) {
+				double w = std::min(hi, i + 0.5) - std::max(lo, i - 0.5);
+
+				// Skip slivers, and round the full overlaps of aligned grids
+				if (w < 1.0e-6) {
+					if (axis.weights.size() == axis.offset[o]) axis.first[o] = i + 1;
+					continue;
+				}
+				if (w > 1.0 - 1.0e-6) w = 1.0;
+				else axis.uniform = false;
+
+				axis.weights.push_back(w);
+				axis.total[o]+= w;
+			}
+			axis.count[o] = axis.weights.size() - axis.offset[o];
+		}
+	}
 }
 
 /**
@@ -140,143 +203,141 @@ void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::After
 
 /**
  * ThreadedGenerateData
+ *
+ * For each output row, the input rows under it are first accumulated with
+ * the weights of the other axes, then the accumulated row is averaged
+ * along x.
  */
 template<class TInputImage, class TOutputImage, class TPrecisionType>
 void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::ThreadedGenerateData(
 		const OutputImageRegionType & outputRegionForThread,
 		itk::ThreadIdType threadId) {
-	// Get the output pointers
 	OutputImagePointer outputPtr = this->GetOutput();
-
-	// Get this input pointers
 	InputImageConstPointer inputPtr = this->GetInput();
-	SizeType inputSize = inputPtr->GetLargestPossibleRegion().GetSize();
-
-	// Create an iterator that will walk the output region for this thread.
-	typedef itk::ImageRegionIteratorWithIndex<TOutputImage> OutputIterator;
-	typedef itk::ImageRegionConstIterator<TInputImage> InputIterator;
-	typedef itk::ImageRegionConstIterator< MaskImageType > MaskIterator;
-
-	OutputIterator outIt(outputPtr, outputRegionForThread);
-	MaskIterator maskIt;
-
 	typename MaskImageType::ConstPointer mask = this->GetMaskImage();
 	bool hasMask = mask.IsNotNull();
 
-	if (hasMask)
-		maskIt = MaskIterator(mask, outputRegionForThread);
-
-	// Define a few indices that will be used to translate from an input pixel
-	// to an output pixel
-	PointType outputPoint;         // Coordinates of current output pixel
-	PointType inputPoint;          // Coordinates of current input pixel
-
-	IndexType inputIndex;
-
-	IndexType index;
-	IndexType startInputIndex;
-	size_t N;
-
 	// Support for progress methods/callbacks
 	itk::ProgressReporter progress(this, threadId,
 			outputRegionForThread.GetNumberOfPixels());
 
-	// Cache information from the superclass
-	PixelType defaultValue = this->GetDefaultPixelValue();
-
-	InputImageRegionType window;
-	SizeType windowSize;
-	int offset[ImageDimension];
-	for (size_t dim = 0; dim < ImageDimension; dim++) {
-		offset[dim] = - vcl_floor( 0.5*m_WindowSize[dim] );
+	const InputPixelValueType* inBuffer = inputPtr->GetBufferPointer();
+	OutputPixelValueType* outBuffer = outputPtr->GetBufferPointer();
+	size_t ncin = inputPtr->GetNumberOfComponentsPerPixel();
+	size_t ncout = m_NumberOfComponents;
+
+	IndexType outStart = outputPtr->GetLargestPossibleRegion().GetIndex();
+	size_t nx = outputRegionForThread.GetSize()[0];
+	size_t ox0 = outputRegionForThread.GetIndex()[0] - outStart[0];
+	const AxisWeights& xaxis = m_AxisWeights[0];
+
+	// Input span of this thread's rows
+	long xfirst = 0;
+	long xlast = 0;
+	bool found = false;
+	for (size_t i = 0; i < nx; i++) {
+		if (xaxis.count[ox0 + i] == 0) continue;
+		long end = xaxis.first[ox0 + i] + static_cast<long>(xaxis.count[ox0 + i]);
+		xfirst = found?std::min(xfirst, xaxis.first[ox0 + i]):xaxis.first[ox0 + i];
+		xlast = found?std::max(xlast, end):end;
+		found = true;
 	}
-
-
-	size_t inputLength = m_NumberOfComponents - 1;
-
-	PixelType pixval;
-	PixelType outpix;
-	InputPixelType inpix;
-	float inval;
-	OutputPixelValueType bg = 0.0;
-
-	bool any;
-	while (!outIt.IsAtEnd()) {
-		// First get the position of the pixel in the output coordinate frame
-		index = outIt.GetIndex();
-		outputPtr->TransformIndexToPhysicalPoint(index, outputPoint);
-
-		// Compute corresponding input pixel continuous index, this index
-		// will incremented in the scanline loop
-		inputPtr->TransformPhysicalPointToIndex(outputPoint, inputIndex);
-
-		pixval = PixelType(m_DefaultPixelValue);
-		outpix = PixelType(m_DefaultPixelValue);
-
-		windowSize = m_WindowSize;
-		// Insert here averaging code
-		for (size_t dim = 0; dim < ImageDimension; dim++) {
-			startInputIndex[dim] = inputIndex[dim] + offset[dim];
-
-			if (startInputIndex[dim] < 0) {
-				windowSize[dim] += startInputIndex[dim];
-				startInputIndex[dim] = 0;
+	size_t span = xlast - xfirst;
+	std::vector< double > acc(span * ncin);
+
+	bool uniform = true;
+	for (size_t d = 0; d < ImageDimension; d++) uniform = uniform && m_AxisWeights[d].uniform;
+
+	typename TInputImage::IndexType inIdx;
+	size_t o[ImageDimension];
+	size_t k[ImageDimension];
+	std::vector< OutputPixelValueType > pixval(ncout);
+
+	typedef itk::ImageLinearIteratorWithIndex<TOutputImage> OutputLineIterator;
+	OutputLineIterator lineIt(outputPtr, outputRegionForThread);
+	lineIt.SetDirection(0);
+	for (lineIt.GoToBegin(); !lineIt.IsAtEnd(); lineIt.NextLine()) {
+		IndexType idx = lineIt.GetIndex();
+
+		// Accumulate the input rows under this output row
+		double wrest = 1.0;
+		bool empty = (span == 0);
+		for (size_t d = 1; d < ImageDimension; d++) {
+			o[d] = idx[d] - outStart[d];
+			k[d] = 0;
+			wrest*= m_AxisWeights[d].total[o[d]];
+			empty = empty || m_AxisWeights[d].count[o[d]] == 0;
+		}
+		std::fill(acc.begin(), acc.end(), 0.0);
+
+		while (!empty) {
+			double w = 1.0;
+			inIdx[0] = xfirst;
+			for (size_t d = 1; d < ImageDimension; d++) {
+				const AxisWeights& axis = m_AxisWeights[d];
+				inIdx[d] = axis.first[o[d]] + k[d];
+				w*= axis.weights[axis.offset[o[d]] + k[d]];
 			}
 
-			if ((startInputIndex[dim] + windowSize[dim])
-					> (inputSize[dim] - 1)) {
-				windowSize[dim] = inputSize[dim] - startInputIndex[dim] - 1;
+			const InputPixelValueType* in = inBuffer + inputPtr->ComputeOffset(inIdx) * ncin;
+			size_t len = span * ncin;
+			if (uniform) {
+				for (size_t j = 0; j < len; j++) acc[j]+= in[j];
+			} else {
+				for (size_t j = 0; j < len; j++) acc[j]+= w * in[j];
 			}
 
-			if (windowSize[dim] > m_WindowSize[dim]) {
-				windowSize[dim] = 0;
+			// Next input row, odometer over the windows of the other axes
+			size_t d = 1;
+			for (; d < ImageDimension; d++) {
+				if (++k[d] < m_AxisWeights[d].count[o[d]]) break;
+				k[d] = 0;
 			}
-
+			if (d == ImageDimension) break;
 		}
 
-		window.SetSize(windowSize);
-		window.SetIndex(startInputIndex);
+		OutputPixelValueType* out = outBuffer + outputPtr->ComputeOffset(idx) * ncout;
+		const OutputPixelValueType* bg = hasMask?(mask->GetBufferPointer() + mask->ComputeOffset(idx)):NULL;
 
-		InputIterator inIt(inputPtr, window);
+		for (size_t i = 0; i < nx; i++, out+= ncout) {
+			size_t ox = ox0 + i;
+			double total = wrest * xaxis.total[ox];
 
-		N = 0;
-		while (!inIt.IsAtEnd()) {
-			inpix = inIt.Get();
-			for(size_t comp = 0; comp < inputLength; comp++) {
-				inval = InputPixelConvertType::GetNthComponent(comp, inpix);
-				PixelConvertType::SetNthComponent(comp, outpix, inval);
+			for (size_t comp = 0; comp < ncout; comp++) {
+				pixval[comp] = PixelConvertType::GetNthComponent(comp, m_DefaultPixelValue);
 			}
-			pixval+= outpix;
-			N++;
-			++inIt;
-		}
-
-		pixval = pixval/N;
 
-		if(hasMask) {
-			bg = maskIt.Value();
+			if (!empty && total > 0.0) {
+				const double* a = &acc[(xaxis.first[ox] - xfirst) * ncin];
+				const double* wx = &xaxis.weights[xaxis.offset[ox]];
+				for (size_t comp = 0; comp < ncin; comp++) {
+					double v = 0.0;
+					for (size_t j = 0; j < xaxis.count[ox]; j++) {
+						v+= wx[j] * a[j * ncin + comp];
+					}
+					pixval[comp] = v / total;
+				}
+			}
 
-			if( bg > 0.0 ) {
-				any = false;
-				for(size_t comp = 0; comp < inputLength-1; comp++) {
-					if (PixelConvertType::GetNthComponent(comp, pixval) > 0.0) {
-						any=true;
+			if (hasMask && bg[i] > 0.0) {
+				bool any = false;
+				for (size_t comp = 0; comp + 1 < ncin; comp++) {
+					if (pixval[comp] > 0.0) {
+						any = true;
 						break;
 					}
 				}
 
-				pixval = (any)?m_MaskedPixelValue:m_DefaultPixelValue;
+				const PixelType& fill = (any)?m_MaskedPixelValue:m_DefaultPixelValue;
+				for (size_t comp = 0; comp < ncout; comp++) {
+					pixval[comp] = PixelConvertType::GetNthComponent(comp, fill);
+				}
 			}
-			++maskIt;
-		}
-
-		outIt.Set(pixval);
-
-		progress.CompletedPixel();
-		++outIt;
-	} //while( !outIt.IsAtEnd() )
 
-	return;
+			for (size_t comp = 0; comp < ncout; comp++) out[comp] = pixval[comp];
+			progress.CompletedPixel();
+		}
+	}
 }
 
 /**
@@ -429,7 +490,15 @@ void DownsampleAveragingFilter<TInputImage, TOutputImage, TPrecisionType>::Gener
 template<class TInputImage, class TOutputImage, class TPrecisionType>
 itk::ModifiedTimeType DownsampleAveragingFilter<TInputImage, TOutputImage,
 		TPrecisionType>::GetMTime(void) const {
-	itk::ModifiedTimeType latestTime = itk::Object::GetMTime();
+	itk::ModifiedTimeType latestTime = Superclass::GetMTime();
+
+	// Inputs modified in place (e.g. patched maps) do not go through the pipeline
+	for (size_t i = 0; i < 3; i++) {
+		const itk::DataObject* input = this->itk::ProcessObject::GetInput(i);
+		if (input != NULL && input->GetMTime() > latestTime) {
+			latestTime = input->GetMTime();
+		}
+	}
 	return latestTime;
 }
 
@@ -0,0 +1,173 @@
+// --------------------------------------------------------------------------------------
+// File:          MeshScanlineRasterizer.h
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_H_
+#define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_H_
+
+#include <vector>
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkImageBase.h>
+#include <itkContinuousIndex.h>
+
+namespace rstk {
+/** \class MeshScanlineRasterizer
+ *  \brief Scanline core shared by the multi-label mesh rasterizers
+ *
+ *  Initialize() maps the vertices of a set of closed triangle meshes to the
+ *  continuous index of a grid, and buckets the triangles by the slices they
+ *  may cross. For each slice, IntersectSlice() cuts its triangles with a
+ *  z-plane and buckets the resulting segments by row; ComputeSpans() then
+ *  splits one scanline of a row in spans, labeled with the first mesh
+ *  containing them (the number of meshes for the background). All methods
+ *  after Initialize() are const and safe to call from several threads, each
+ *  with its own ScanlineBuffer. Only 3D meshes are supported.
+ */
+template< typename TInputMesh, unsigned int VDimension = 3 >
+class MeshScanlineRasterizer: public itk::Object {
+public:
+	typedef MeshScanlineRasterizer                   Self;
+	typedef itk::Object                              Superclass;
+	typedef itk::SmartPointer< Self >                Pointer;
+	typedef itk::SmartPointer< const Self >          ConstPointer;
+
+	itkNewMacro(Self);
+	itkTypeMacro(MeshScanlineRasterizer, itk::Object);
+
+	itkStaticConstMacro( Dimension, unsigned int, VDimension );
+
+	typedef TInputMesh                               InputMeshType;
+	typedef typename InputMeshType::CellType         CellType;
+	typedef std::vector< const InputMeshType* >      InputMeshList;
+	typedef itk::ImageBase< VDimension >             GridType;
+	typedef typename GridType::PointType             PointType;
+	typedef itk::ContinuousIndex< double, VDimension > ContinuousIndexType;
+
+	/** Intersection of a triangle with a z-plane, in continuous index coordinates */
+	struct Segment {
+		double x0, y0, x1, y1;
+		size_t mesh;
+	};
+
+	/** Intersection of a segment with a scanline */
+	struct Crossing {
+		double x;
+		size_t mesh;
+
+		bool operator<(const Crossing& c) const {
+			return x < c.x;
+		}
+	};
+
+	/** Piece of a scanline between two crossings, x0 may be -inf and x1 +inf */
+	struct Span {
+		double x0, x1;
+		size_t label;
+	};
+
+	typedef std::pair< size_t, size_t >              TriangleReference; // (mesh, triangle)
+	typedef std::vector< TriangleReference >         TriangleReferenceList;
+	typedef std::vector< Segment >                   SegmentList;
+	typedef std::vector< Crossing >                  CrossingList;
+	typedef std::vector< Span >                      SpanList;
+	typedef std::vector< ContinuousIndexType >       VertexList;
+
+	/** Per-thread scratch of ComputeSpans */
+	struct ScanlineBuffer {
+		CrossingList crossings;
+		std::vector< bool > inside;
+		SpanList spans;
+		SegmentList segments;
+	};
+
+	/** Maps the vertices to the continuous index of grid, and buckets the triangles
+	 *  by the slices firstSlice..firstSlice+nslices-1 they may cross. A slice s
+	 *  takes the triangles overlapping [s - halfWidth, s + halfWidth] along z */
+	void Initialize(const InputMeshList& meshes, const GridType* grid, long firstSlice, size_t nslices, double halfWidth);
+
+	/** Cuts the triangles of slice z with the plane at zc, and buckets the
+	 *  segments by the rows firstRow..firstRow+rows.size()-1 overlapping
+	 *  [y - halfWidth, y + halfWidth] */
+	void IntersectSlice(long z, double zc, long firstRow, double halfWidth, std::vector< SegmentList >& rows) const;
+
+	/** Splits the scanline at y in spans, from the segments of its row */
+	void ComputeSpans(const SegmentList& segments, double y, ScanlineBuffer& buffer) const;
+
+	/** Initializes the rasterizer on all the slices of grid, and also buckets
+	 *  the triangles by the (row, slice) cells they may cross, so that
+	 *  EvaluateLabel() only visits the triangles around one scanline */
+	void InitializeProbe(const InputMeshList& meshes, const GridType* grid);
+
+	/** Label of the point at continuous index ci, the number of meshes for
+	 *  the background and outside the grid. Requires InitializeProbe() */
+	size_t EvaluateLabel(const ContinuousIndexType& ci, ScanlineBuffer& buffer) const;
+
+	size_t GetNumberOfMeshes() const { return this->m_Vertices.size(); }
+	const TriangleReferenceList& GetSliceTriangles(long z) const { return this->m_Slices[z - this->m_FirstSlice]; }
+
+protected:
+	MeshScanlineRasterizer(): m_FirstSlice(0), m_FirstRow(0), m_NumberOfRows(0) {}
+	~MeshScanlineRasterizer() {}
+
+	inline bool IntersectTriangle(const TriangleReference& tri, double z, Segment& seg) const;
+
+private:
+	MeshScanlineRasterizer(const Self &); //purposely not implemented
+	void operator=(const Self &);         //purposely not implemented
+
+	long m_FirstSlice;
+	std::vector< VertexList > m_Vertices;              // mesh vertices, in continuous index of the grid
+	std::vector< std::vector< size_t > > m_Triangles;  // three vertex ids per triangle
+	std::vector< TriangleReferenceList > m_Slices;     // triangles that may cross each slice
+	long m_FirstRow;
+	size_t m_NumberOfRows;
+	std::vector< TriangleReferenceList > m_Cells;      // triangles that may cross each (row, slice), for EvaluateLabel
+}; // class
+
+} // namespace rstk
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "MeshScanlineRasterizer.hxx"
+#endif
+
+#endif /* SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_H_ */
@@ -0,0 +1,298 @@
+// --------------------------------------------------------------------------------------
+// File:          MeshScanlineRasterizer.hxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_HXX_
+#define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_HXX_
+
+#include "MeshScanlineRasterizer.h"
+#include <algorithm>
+#include <itkNumericTraits.h>
+
+namespace rstk
+{
+
+template< typename TInputMesh, unsigned int VDimension >
+void
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::Initialize(const InputMeshList& meshes, const GridType* grid, long firstSlice, size_t nslices, double halfWidth) {
+	size_t nmeshes = meshes.size();
+	m_FirstSlice = firstSlice;
+	m_Vertices.resize(nmeshes);
+	m_Triangles.resize(nmeshes);
+	m_Slices.assign(nslices, TriangleReferenceList());
+
+	long lastSlice = firstSlice + nslices - 1;
+	PointType p;
+
+	for (size_t mid = 0; mid < nmeshes; mid++) {
+		const InputMeshType* mesh = meshes[mid];
+
+		VertexList& vertices = m_Vertices[mid];
+		vertices.resize(mesh->GetNumberOfPoints());
+
+		typename InputMeshType::PointsContainerConstIterator p_it = mesh->GetPoints()->Begin();
+		typename InputMeshType::PointsContainerConstIterator p_end = mesh->GetPoints()->End();
+		while (p_it != p_end) {
+			if (p_it.Index() >= vertices.size()) {
+				vertices.resize(p_it.Index() + 1);
+			}
+			p.CastFrom(p_it.Value());
+			grid->TransformPhysicalPointToContinuousIndex(p, vertices[p_it.Index()]);
+			++p_it;
+		}
+
+		std::vector< size_t >& triangles = m_Triangles[mid];
+		triangles.clear();
+
+		typename InputMeshType::CellsContainerConstIterator c_it = mesh->GetCells()->Begin();
+		typename InputMeshType::CellsContainerConstIterator c_end = mesh->GetCells()->End();
+		while (c_it != c_end) {
+			const CellType* cell = c_it.Value();
+			++c_it;
+
+			if (cell->GetNumberOfPoints() != 3) {
+				continue;
+			}
+
+			size_t tid = triangles.size() / 3;
+			double zmin = itk::NumericTraits< double >::max();
+			double zmax = itk::NumericTraits< double >::NonpositiveMin();
+			typename CellType::PointIdConstIterator pit = cell->PointIdsBegin();
+			for (; pit != cell->PointIdsEnd(); ++pit) {
+				triangles.push_back(*pit);
+				double z = vertices[*pit][2];
+				if (z < zmin) zmin = z;
+				if (z > zmax) zmax = z;
+			}
+
+			long s0 = ceil(zmin - halfWidth);
+			long s1 = floor(zmax + halfWidth);
+			if (s0 < firstSlice) s0 = firstSlice;
+			if (s1 > lastSlice) s1 = lastSlice;
+
+			for (long s = s0; s <= s1; s++) {
+				m_Slices[s - firstSlice].push_back(TriangleReference(mid, tid));
+			}
+		}
+	}
+}
+
+template< typename TInputMesh, unsigned int VDimension >
+inline bool
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::IntersectTriangle(const TriangleReference& tri, double z, Segment& seg) const {
+	const VertexList& vertices = m_Vertices[tri.first];
+	const size_t* ids = &m_Triangles[tri.first][3 * tri.second];
+
+	double x[2], y[2];
+	size_t n = 0;
+	for (size_t e = 0; e < 3 && n < 2; e++) {
+		const ContinuousIndexType& a = vertices[ids[e]];
+		const ContinuousIndexType& b = vertices[ids[(e + 1) % 3]];
+
+		// Half-open test, so that shared vertices are counted only once
+		if ((a[2] <= z && z < b[2]) || (b[2] <= z && z < a[2])) {
+			double t = (z - a[2]) / (b[2] - a[2]);
+			x[n] = a[0] + t * (b[0] - a[0]);
+			y[n] = a[1] + t * (b[1] - a[1]);
+			n++;
+		}
+	}
+
+	if (n < 2) {
+		return false;
+	}
+
+	seg.x0 = x[0];
+	seg.y0 = y[0];
+	seg.x1 = x[1];
+	seg.y1 = y[1];
+	seg.mesh = tri.first;
+	return true;
+}
+
+template< typename TInputMesh, unsigned int VDimension >
+void
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::IntersectSlice(long z, double zc, long firstRow, double halfWidth, std::vector< SegmentList >& rows) const {
+	long nrows = rows.size();
+	for (long r = 0; r < nrows; r++) {
+		rows[r].clear();
+	}
+
+	const TriangleReferenceList& triangles = this->GetSliceTriangles(z);
+	Segment seg;
+	for (size_t t = 0; t < triangles.size(); t++) {
+		if (!this->IntersectTriangle(triangles[t], zc, seg)) {
+			continue;
+		}
+
+		long r0 = long(ceil(std::min(seg.y0, seg.y1) - halfWidth)) - firstRow;
+		long r1 = long(floor(std::max(seg.y0, seg.y1) + halfWidth)) - firstRow;
+		if (r0 < 0) r0 = 0;
+		if (r1 > nrows - 1) r1 = nrows - 1;
+
+		for (long r = r0; r <= r1; r++) {
+			rows[r].push_back(seg);
+		}
+	}
+}
+
+template< typename TInputMesh, unsigned int VDimension >
+void
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::ComputeSpans(const SegmentList& segments, double y, ScanlineBuffer& buffer) const {
+	size_t nmeshes = this->GetNumberOfMeshes();
+	CrossingList& crossings = buffer.crossings;
+	SpanList& spans = buffer.spans;
+	Crossing c;
+
+	crossings.clear();
+	for (size_t s = 0; s < segments.size(); s++) {
+		const Segment& sg = segments[s];
+		if ((sg.y0 <= y && y < sg.y1) || (sg.y1 <= y && y < sg.y0)) {
+			c.x = sg.x0 + (y - sg.y0) * (sg.x1 - sg.x0) / (sg.y1 - sg.y0);
+			c.mesh = sg.mesh;
+			crossings.push_back(c);
+		}
+	}
+	std::sort(crossings.begin(), crossings.end());
+
+	// Sweep the scanline, the first mesh containing a span takes it
+	buffer.inside.assign(nmeshes, false);
+	spans.clear();
+
+	Span span;
+	span.x0 = itk::NumericTraits< double >::NonpositiveMin();
+	span.label = nmeshes;
+	for (size_t k = 0; k < crossings.size(); k++) {
+		span.x1 = crossings[k].x;
+		spans.push_back(span);
+
+		buffer.inside[crossings[k].mesh] = !buffer.inside[crossings[k].mesh];
+		span.x0 = crossings[k].x;
+		span.label = nmeshes;
+		for (size_t m = 0; m < nmeshes; m++) {
+			if (buffer.inside[m]) {
+				span.label = m;
+				break;
+			}
+		}
+	}
+	span.x1 = itk::NumericTraits< double >::max();
+	spans.push_back(span);
+}
+
+template< typename TInputMesh, unsigned int VDimension >
+void
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::InitializeProbe(const InputMeshList& meshes, const GridType* grid) {
+	typename GridType::IndexType start = grid->GetLargestPossibleRegion().GetIndex();
+	typename GridType::SizeType size = grid->GetLargestPossibleRegion().GetSize();
+
+	// Half a voxel both sides, so that any point rounds to a cell holding all
+	// the triangles that may cross its scanline
+	this->Initialize(meshes, grid, start[2], size[2], 0.5);
+
+	m_FirstRow = start[1];
+	m_NumberOfRows = size[1];
+	m_Cells.assign(size[1] * size[2], TriangleReferenceList());
+
+	long lastRow = m_FirstRow + m_NumberOfRows - 1;
+	for (size_t s = 0; s < m_Slices.size(); s++) {
+		const TriangleReferenceList& triangles = m_Slices[s];
+		for (size_t t = 0; t < triangles.size(); t++) {
+			const VertexList& vertices = m_Vertices[triangles[t].first];
+			const size_t* ids = &m_Triangles[triangles[t].first][3 * triangles[t].second];
+
+			double ymin = itk::NumericTraits< double >::max();
+			double ymax = itk::NumericTraits< double >::NonpositiveMin();
+			for (size_t v = 0; v < 3; v++) {
+				double y = vertices[ids[v]][1];
+				if (y < ymin) ymin = y;
+				if (y > ymax) ymax = y;
+			}
+
+			long r0 = ceil(ymin - 0.5);
+			long r1 = floor(ymax + 0.5);
+			if (r0 < m_FirstRow) r0 = m_FirstRow;
+			if (r1 > lastRow) r1 = lastRow;
+			for (long r = r0; r <= r1; r++) {
+				m_Cells[s * m_NumberOfRows + (r - m_FirstRow)].push_back(triangles[t]);
+			}
+		}
+	}
+}
+
+template< typename TInputMesh, unsigned int VDimension >
+size_t
+MeshScanlineRasterizer< TInputMesh, VDimension >
+::EvaluateLabel(const ContinuousIndexType& ci, ScanlineBuffer& buffer) const {
+	size_t nmeshes = this->GetNumberOfMeshes();
+	long z = long(floor(ci[2] + 0.5)) - m_FirstSlice;
+	long r = long(floor(ci[1] + 0.5)) - m_FirstRow;
+	if (z < 0 || z >= long(m_Slices.size()) || r < 0 || r >= long(m_NumberOfRows)) {
+		return nmeshes;
+	}
+
+	const TriangleReferenceList& triangles = m_Cells[z * m_NumberOfRows + r];
+	SegmentList& segments = buffer.segments;
+	Segment seg;
+	segments.clear();
+	for (size_t t = 0; t < triangles.size(); t++) {
+		if (this->IntersectTriangle(triangles[t], ci[2], seg)) {
+			segments.push_back(seg);
+		}
+	}
+
+	this->ComputeSpans(segments, ci[1], buffer);
+	const SpanList& spans = buffer.spans;
+	for (size_t k = 0; k < spans.size(); k++) {
+		if (spans[k].x0 <= ci[0] && ci[0] < spans[k].x1) {
+			return spans[k].label;
+		}
+	}
+	return nmeshes;
+}
+
+} // namespace rstk
+#endif /* SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MESHSCANLINERASTERIZER_HXX_ */
@@ -47,9 +47,19 @@
 #include <itkImageBase.h>
 #include <itkImageSource.h>
 #include <itkVectorImage.h>
-#include <itkTriangleMeshToBinaryImageFilter.h>
+#include <itkContinuousIndex.h>
+#include "MeshScanlineRasterizer.h"
 
 namespace rstk {
+/** \class MultilabelBinarizeMeshFilter
+ *  \brief Rasterizes a set of closed triangle meshes into a multi-label image
+ *
+ *  All the meshes are intersected with each scanline (voxel centers) in a single
+ *  pass, and the label and the per-component output are written directly. The
+ *  first mesh containing a voxel center takes it, the remaining voxels are
+ *  assigned to the background (last component). Work is split over slices.
+ *  Only 3D meshes are supported.
+ */
 template< typename TInputMesh, typename TOutputPixelType = unsigned char, unsigned int VDimension = 3 >
 class MultilabelBinarizeMeshFilter: public itk::ImageSource< itk::VectorImage< TOutputPixelType, VDimension > >
 {
@@ -81,6 +91,7 @@ public:
 	  typedef typename OutputImageType::SpacingType               SpacingType;
 	  typedef typename OutputImageType::DirectionType             DirectionType;
 	  typedef typename Superclass::OutputImageRegionType          OutputImageRegionType;
+	  typedef itk::ContinuousIndex< double, VDimension >          ContinuousIndexType;
 
 	  /** Some convenient typedefs. */
 	  typedef TInputMesh                                          InputMeshType;
@@ -100,9 +111,6 @@ public:
 
 	  typedef itk::Image< OutputPixelValueType, VDimension >      OutputComponentType;
 	  typedef typename OutputComponentType::Pointer               OutputComponentPointer;
-	  typedef itk::TriangleMeshToBinaryImageFilter
-				          <InputMeshType, OutputComponentType>	  BinarizeMeshFilterType;
-	  typedef typename BinarizeMeshFilterType::Pointer            BinarizeMeshFilterPointer;
 
 	  typedef itk::ProcessObject                                  ProcessObject;
 
@@ -134,31 +142,27 @@ public:
 		  for(size_t c = 0; c < cont.size(); c++) {
 			  InputMeshPointer ptr = cont[c];
 			  this->ProcessObject::SetNthInput(c, ptr);
-			  m_NumberOfMeshes++;
 		  }
+		  m_NumberOfMeshes = cont.size();
+		  this->Modified();
 	  }
 
 	  itkGetObjectMacro(OutputSegmentation, OutputComponentType)
 	  itkGetConstObjectMacro(OutputSegmentation, OutputComponentType)
 
-	  struct ThreadStruct { Pointer Filter; };
-	  itk::MultiThreader * GetPreMultiThreader() const { return m_PreThreader; }
 protected:
 	  void BeforeThreadedGenerateData();
-	  void ThreadedGenerateData(const RegionType & inputRegionForThread, itk::ThreadIdType threadId);
+	  void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, itk::ThreadIdType threadId);
 	  virtual void GenerateOutputInformation();
 
-	  static ITK_THREAD_RETURN_TYPE BinarizeThreaderCallback(void *arg);
-	  void BinarizeThreaded(size_t num);
-	  void SplitRequestedFilters(itk::ThreadIdType id, itk::ThreadIdType num, std::vector<size_t>& res);
-
 	  MultilabelBinarizeMeshFilter();
 	  ~MultilabelBinarizeMeshFilter() {}
 	  virtual void PrintSelf(std::ostream & os, itk::Indent indent) const { Superclass::PrintSelf(os, indent); }
 
-		/** Support processing data in multiple threads. */
-		itk::MultiThreader::Pointer m_PreThreader;
-		itk::ThreadIdType           m_NumberOfThreads;
+	  typedef MeshScanlineRasterizer< TInputMesh, VDimension >    RasterizerType;
+	  typedef typename RasterizerType::Pointer                    RasterizerPointer;
+	  typedef typename RasterizerType::SegmentList                SegmentList;
+	  typedef typename RasterizerType::SpanList                   SpanList;
 private:
 	  MultilabelBinarizeMeshFilter(const Self &); //purposely not implemented
 	  void operator=(const Self &);                  //purposely not implemented
@@ -171,8 +175,9 @@ private:
 
 	  size_t m_NumberOfMeshes;
 	  size_t m_NumberOfRegions;
-	  std::vector< BinarizeMeshFilterPointer > m_Components;
 	  OutputComponentPointer m_OutputSegmentation;
+
+	  RasterizerPointer m_Rasterizer;
 }; // class
 
 } // namespace rstk
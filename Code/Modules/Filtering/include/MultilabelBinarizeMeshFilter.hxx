@@ -44,8 +44,9 @@
 #define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELBINARIZEMESHFILTER_HXX_
 
 #include "MultilabelBinarizeMeshFilter.h"
+#include <algorithm>
 #include <itkProcessObject.h>
-#include <itkImageRegionIterator.h>
+#include <itkProgressReporter.h>
 
 namespace rstk
 {
@@ -53,16 +54,14 @@ namespace rstk
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
 MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 ::MultilabelBinarizeMeshFilter():
- m_NumberOfMeshes(0) {
+ m_NumberOfMeshes(0),
+ m_NumberOfRegions(0) {
 	this->SetNumberOfRequiredInputs(1);
 	m_Size.Fill(0);
 	m_Index.Fill(0);
 	m_Spacing.Fill(0.0);
 	m_Origin.Fill(0.0);
 	m_Direction.GetVnlMatrix().set_identity();
-
-	this->m_PreThreader = itk::MultiThreader::New();
-	this->m_NumberOfThreads = this->m_PreThreader->GetNumberOfThreads();
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
@@ -70,6 +69,7 @@ void
 MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 ::SetOutputReference(const itk::ImageBase<Dimension>* reference) {
 	this->SetSize(reference->GetLargestPossibleRegion().GetSize());
+	this->SetIndex(reference->GetLargestPossibleRegion().GetIndex());
 	this->SetOrigin(reference->GetOrigin());
 	this->SetDirection(reference->GetDirection());
 	this->SetSpacing(reference->GetSpacing());
@@ -87,158 +87,100 @@ MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 	region.SetSize(m_Size);
 	region.SetIndex(m_Index);
 
-	output->SetLargestPossibleRegion(region); //
-	output->SetBufferedRegion(region);        // set the region
-	output->SetRequestedRegion(region);       //
+	output->SetLargestPossibleRegion(region); // set the region
 	output->SetSpacing(m_Spacing);            // set spacing
 	output->SetOrigin(m_Origin);              //   and origin
 	output->SetDirection(m_Direction);        // direction cosines
 	output->SetNumberOfComponentsPerPixel(m_NumberOfRegions);
-	output->Allocate();
-
-
-	OutputPixelType zero;
-	zero.SetSize(m_NumberOfRegions);
-	zero.Fill(0);
-	zero[m_NumberOfMeshes] = 1;
-	output->FillBuffer(zero);
-
-	m_OutputSegmentation = OutputComponentType::New();
-	m_OutputSegmentation->SetLargestPossibleRegion(region); //
-	m_OutputSegmentation->SetBufferedRegion(region);        // set the region
-	m_OutputSegmentation->SetRequestedRegion(region);       //
-	m_OutputSegmentation->SetSpacing(m_Spacing);            // set spacing
-	m_OutputSegmentation->SetOrigin(m_Origin);              //   and origin
-	m_OutputSegmentation->SetDirection(m_Direction);        // direction cosines
-	m_OutputSegmentation->Allocate();
-	m_OutputSegmentation->FillBuffer(m_NumberOfMeshes);
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-void
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::BinarizeThreaded(size_t num) {
-	this->m_Components[num]->Update();
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-void
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::SplitRequestedFilters(itk::ThreadIdType id, itk::ThreadIdType num, std::vector<size_t>& res) {
-	size_t total = this->m_Components.size();
-
-	if (num > total)
-		itkExceptionMacro(<< "total number of threads overs number of filters")
-
-	res.push_back(id);
-
-	for(int rem = total; rem > num; ) {
-		size_t nextId = id + num;
-		if( nextId < total )
-			res.push_back(nextId);
-		else
-			return;
-
-		rem-=num;
-	}
-}
-
-template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
-ITK_THREAD_RETURN_TYPE
-MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::BinarizeThreaderCallback(void *arg) {
-	ThreadStruct *str;
-	itk::ThreadIdType total, threadId, threadCount;
-
-	threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
-	threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
-	str = (ThreadStruct *)(((itk::MultiThreader::ThreadInfoStruct *)(arg))->UserData);
-
-	std::vector<size_t> filters;
-	str->Filter->SplitRequestedFilters(threadId, threadCount, filters);
-
-	for (size_t id = 0; id < filters.size(); id++)
-		str->Filter->BinarizeThreaded(filters[id]);
-
-	return ITK_THREAD_RETURN_VALUE;
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
 void
 MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
 ::BeforeThreadedGenerateData() {
-	// Get the input and output pointers
 	OutputImagePointer output = this->GetOutput();
-	m_Components.clear();
+	RegionType region = output->GetLargestPossibleRegion();
 
-	// find the actual number of threads
-	m_NumberOfThreads = this->GetNumberOfThreads();
-	if ( itk::MultiThreader::GetGlobalMaximumNumberOfThreads() != 0 ) {
-		m_NumberOfThreads = vnl_math_min( this->GetNumberOfThreads(), itk::MultiThreader::GetGlobalMaximumNumberOfThreads() );
-	}
+	m_OutputSegmentation = OutputComponentType::New();
+	m_OutputSegmentation->SetRegions(region);
+	m_OutputSegmentation->SetSpacing(m_Spacing);
+	m_OutputSegmentation->SetOrigin(m_Origin);
+	m_OutputSegmentation->SetDirection(m_Direction);
+	m_OutputSegmentation->Allocate();
 
-	long nbOfThreads = (m_NumberOfMeshes > m_NumberOfThreads)?m_NumberOfThreads:m_NumberOfMeshes;
-	struct ThreadStruct str;
-	str.Filter = this;
-
-	for (size_t idx = 0; idx < m_NumberOfMeshes; idx++ ) {
-		BinarizeMeshFilterPointer meshFilter = BinarizeMeshFilterType::New();
-		meshFilter->SetSpacing( m_Spacing );
-		meshFilter->SetDirection( m_Direction );
-		meshFilter->SetOrigin( m_Origin );
-		meshFilter->SetSize( m_Size );
-		meshFilter->SetInput( GetInput(idx) );
-		m_Components.push_back(meshFilter);
+	// Map vertices to the continuous index of the output, and bucket
+	// the triangles by the slice centers they cross
+	typename RasterizerType::InputMeshList meshes(m_NumberOfMeshes);
+	for (size_t mid = 0; mid < m_NumberOfMeshes; mid++) {
+		meshes[mid] = this->GetInput(mid);
 	}
-
-	this->GetPreMultiThreader()->SetNumberOfThreads( nbOfThreads );
-	this->GetPreMultiThreader()->SetSingleMethod( this->BinarizeThreaderCallback, &str );
-	this->GetPreMultiThreader()->SingleMethodExecute();
-
-	// number of threads can be constrained by the region size, so call the
-	// SplitRequestedRegion
-	// to get the real number of threads which will be used
-	RegionType splitRegion;  // dummy region - just to call the following method
-	nbOfThreads = this->SplitRequestedRegion(0, m_NumberOfThreads, splitRegion);
+	m_Rasterizer = RasterizerType::New();
+	m_Rasterizer->Initialize(meshes, output, m_Index[2], m_Size[2], 0.0);
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
 void
 MultilabelBinarizeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
-::ThreadedGenerateData(const RegionType & inputRegionForThread, itk::ThreadIdType threadId) {
-	size_t nPix = inputRegionForThread.GetNumberOfPixels();
-	itk::ProgressReporter progress( this, threadId, nPix );
+::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, itk::ThreadIdType threadId) {
+	OutputImagePointer output = this->GetOutput();
+	OutputPixelValueType* outBuffer = output->GetBufferPointer();
+	OutputPixelValueType* segBuffer = m_OutputSegmentation->GetBufferPointer();
+
+	IndexType start = outputRegionForThread.GetIndex();
+	SizeType size = outputRegionForThread.GetSize();
+	long nx = size[0];
+	long ny = size[1];
+
+	itk::ProgressReporter progress(this, threadId, size[2]);
+
+	std::vector< SegmentList > rows(ny);
+	std::vector< size_t > labels(nx);
+	typename RasterizerType::ScanlineBuffer buffer;
+	IndexType idx;
+
+	for (long z = start[2]; z < long(start[2] + size[2]); z++) {
+		// Segments of the plane through the voxel centers, by the rows they cross
+		m_Rasterizer->IntersectSlice(z, z, start[1], 0.0, rows);
+
+		idx[2] = z;
+		for (long r = 0; r < ny; r++) {
+			m_Rasterizer->ComputeSpans(rows[r], start[1] + r, buffer);
+
+			// Voxel centers within a span take its label
+			std::fill(labels.begin(), labels.end(), m_NumberOfMeshes);
+			const SpanList& spans = buffer.spans;
+			for (size_t k = 0; k < spans.size(); k++) {
+				if (spans[k].label == m_NumberOfMeshes) {
+					continue;
+				}
+
+				double x0 = std::max(spans[k].x0, start[0] - 1.0);
+				double x1 = std::min(spans[k].x1, start[0] + nx + 1.0);
+				long i0 = long(ceil(x0)) - start[0];
+				long i1 = long(ceil(x1)) - start[0];
+				if (i0 < 0) i0 = 0;
+				if (i1 > nx) i1 = nx;
+				for (long i = i0; i < i1; i++) {
+					labels[i] = spans[k].label;
+				}
+			}
 
-	const OutputPixelValueType* compBuffer[m_NumberOfMeshes];
-	for( size_t comp = 0; comp < m_NumberOfMeshes; comp++ ) {
-		compBuffer[comp] = m_Components[comp]->GetOutput()->GetBufferPointer();
-	}
-	OutputComponentPointer ref = m_OutputSegmentation;
-	OutputPixelValueType* segBuffer = ref->GetBufferPointer();
-
-	itk::ImageRegionIterator< OutputImageType > outIt( this->GetOutput(), inputRegionForThread );
- 	outIt.GoToBegin();
-
- 	size_t pix;
- 	OutputPixelValueType* outBuffer = this->GetOutput()->GetBufferPointer();
- 	OutputPixelValueType v;
- 	while ( !outIt.IsAtEnd() ) {
- 		pix = ref->ComputeOffset(outIt.GetIndex());
-
-		for( size_t comp = 0; comp < m_NumberOfMeshes; comp++ ) {
-			v = *( compBuffer[comp] + pix );
-
-			if( v > 0 ) {
-				*( outBuffer + pix * m_NumberOfRegions + comp ) = 1;
-				*( outBuffer + pix * m_NumberOfRegions + m_NumberOfMeshes ) = 0;
-				*( segBuffer + pix ) = comp;
-				break;
+			// Write the row out
+			idx[1] = start[1] + r;
+			idx[0] = start[0];
+			size_t offset = output->ComputeOffset(idx);
+			OutputPixelValueType* px = outBuffer + offset * m_NumberOfRegions;
+			OutputPixelValueType* sx = segBuffer + offset;
+			for (long i = 0; i < nx; i++) {
+				std::fill(px, px + m_NumberOfRegions, 0);
+				px[labels[i]] = 1;
+				*sx = labels[i];
+				px+= m_NumberOfRegions;
+				sx++;
 			}
 		}
 		progress.CompletedPixel();
-		++outIt;
- 	}
-
+	}
 }
 
 template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
@@ -0,0 +1,235 @@
+// --------------------------------------------------------------------------------------
+// File:          MultilabelPartialVolumeMeshFilter.h
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_H_
+#define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_H_
+
+#include <vector>
+#include <atomic>
+#include <itkImage.h>
+#include <itkImageBase.h>
+#include <itkImageSource.h>
+#include <itkVectorImage.h>
+#include <itkContinuousIndex.h>
+#include "MeshScanlineRasterizer.h"
+
+namespace rstk {
+/** \class MultilabelPartialVolumeMeshFilter
+ *  \brief Computes the fraction of each voxel covered by a set of closed triangle meshes
+ *
+ *  The output has one component per mesh, one for the background and a last
+ *  component flagging the voxels masked out by MaskImage, the same layout
+ *  DownsampleAveragingFilter produces from a MultilabelBinarizeMeshFilter output.
+ *  Coverage is computed directly at the output resolution: it is exact along the
+ *  x axis and sampled with SubsamplingFactor x SubsamplingFactor scanlines in the
+ *  y-z plane of each voxel. As in MultilabelBinarizeMeshFilter, the first mesh
+ *  containing a point takes it. Only 3D meshes are supported.
+ */
+template< typename TInputMesh, typename TOutputPixelType = float, unsigned int VDimension = 3 >
+class MultilabelPartialVolumeMeshFilter: public itk::ImageSource< itk::VectorImage< TOutputPixelType, VDimension > >
+{
+public:
+	/** Standard class typedefs. */
+	typedef MultilabelPartialVolumeMeshFilter                   Self;
+	typedef TOutputPixelType                                    OutputPixelValueType;
+	typedef itk::VectorImage< TOutputPixelType, VDimension >    OutputImageType;
+
+	typedef itk::ImageSource< OutputImageType >                 Superclass;
+	typedef itk::SmartPointer< Self >                           Pointer;
+	typedef itk::SmartPointer< const Self >                     ConstPointer;
+
+	/** Method for creation through the object factory. */
+	itkNewMacro(Self);
+
+	/** Run-time type information (and related methods). */
+	itkTypeMacro(MultilabelPartialVolumeMeshFilter, itk::ImageSource);
+
+	itkStaticConstMacro( Dimension, unsigned int, VDimension );
+
+	typedef typename OutputImageType::Pointer                   OutputImagePointer;
+	typedef typename OutputImageType::PixelType                 OutputPixelType;
+	typedef typename OutputImageType::PointType                 PointType;
+	typedef typename OutputImageType::IndexType                 IndexType;
+	typedef typename OutputImageType::SizeType                  SizeType;
+	typedef typename OutputImageType::RegionType                RegionType;
+	typedef typename OutputImageType::SpacingType               SpacingType;
+	typedef typename OutputImageType::DirectionType             DirectionType;
+	typedef typename Superclass::OutputImageRegionType          OutputImageRegionType;
+	typedef itk::ContinuousIndex< double, VDimension >          ContinuousIndexType;
+	typedef std::vector< RegionType >                           RegionList;
+
+	/** Some convenient typedefs. */
+	typedef TInputMesh                                          InputMeshType;
+	typedef typename InputMeshType::Pointer                     InputMeshPointer;
+	typedef typename InputMeshType::ConstPointer                InputMeshConstPointer;
+	typedef typename InputMeshType::PointType                   InputPointType;
+	typedef typename InputMeshType::CellType                    CellType;
+	typedef typename std::vector<InputMeshPointer>              InputMeshContainer;
+
+	typedef itk::Image< OutputPixelValueType, VDimension >      MaskImageType;
+	typedef typename MaskImageType::ConstPointer                MaskImageConstPointer;
+
+	typedef unsigned char                                       SegmentationPixelType;
+	typedef itk::Image< SegmentationPixelType, VDimension >     OutputSegmentationType;
+	typedef typename OutputSegmentationType::Pointer            OutputSegmentationPointer;
+
+	typedef itk::ProcessObject                                  ProcessObject;
+
+	// Set/Get spacing
+	itkSetMacro(Spacing, SpacingType);
+	itkGetConstReferenceMacro(Spacing, SpacingType);
+
+	// Set/Get Direction
+	itkSetMacro(Direction, DirectionType);
+	itkGetConstMacro(Direction, DirectionType);
+
+	// Set/get origin
+	itkSetMacro(Origin, PointType);
+	itkGetConstReferenceMacro(Origin, PointType);
+
+	/** Set/Get Index */
+	itkSetMacro(Index, IndexType);
+	itkGetConstMacro(Index, IndexType);
+
+	/** Set/Get Size */
+	itkSetMacro(Size, SizeType);
+	itkGetConstMacro(Size, SizeType);
+
+	/** Number of scanlines per voxel along y and z */
+	itkSetClampMacro(SubsamplingFactor, size_t, 1, 16);
+	itkGetConstMacro(SubsamplingFactor, size_t);
+
+	/** Voxels with mask value above zero are flagged in the last component */
+	itkSetConstObjectMacro(MaskImage, MaskImageType);
+	itkGetConstObjectMacro(MaskImage, MaskImageType);
+
+	void SetOutputReference(const itk::ImageBase<Dimension>* reference);
+
+	InputMeshType * GetInput(size_t idx);
+	void SetInputs(const InputMeshContainer & cont) {
+		for(size_t c = 0; c < cont.size(); c++) {
+			InputMeshPointer ptr = cont[c];
+			this->ProcessObject::SetNthInput(c, ptr);
+		}
+		m_NumberOfMeshes = cont.size();
+		this->Modified();
+	}
+
+	/** Write the fractions to the output image. When off, the output buffer is
+	 *  not allocated and subclasses only get the fractions of each row through
+	 *  ThreadedProcessRow */
+	itkSetMacro(WriteFractions, bool);
+	itkGetConstMacro(WriteFractions, bool);
+	itkBooleanMacro(WriteFractions);
+
+	/** Compute only these regions of the output, which must lie within
+	 *  Index and Size. The triangles are bucketed once for all of them, and
+	 *  the voxels of the output outside every region are left undefined */
+	void SetRequestedRegions(const RegionList & regions) {
+		m_RequestedRegions = regions;
+		this->Modified();
+	}
+	const RegionList & GetRequestedRegions() const { return m_RequestedRegions; }
+
+	/** Label of the region with the largest coverage in each voxel */
+	itkGetObjectMacro(OutputSegmentation, OutputSegmentationType)
+	itkGetConstObjectMacro(OutputSegmentation, OutputSegmentationType)
+
+protected:
+	MultilabelPartialVolumeMeshFilter();
+	~MultilabelPartialVolumeMeshFilter() {}
+	virtual void PrintSelf(std::ostream & os, itk::Indent indent) const;
+
+	virtual void GenerateOutputInformation();
+	virtual void AllocateOutputs();
+	virtual void GenerateData();
+	void BeforeThreadedGenerateData();
+	void ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, itk::ThreadIdType threadId);
+
+	/** Called with the final fractions of each output row (nx pixels of
+	 *  NumberOfRegions + 1 components, starting at first), so that subclasses
+	 *  can consume them while they are still in cache */
+	virtual void ThreadedProcessRow(const IndexType & itkNotUsed(first), size_t itkNotUsed(nx),
+			const OutputPixelValueType* itkNotUsed(fractions), itk::ThreadIdType itkNotUsed(threadId)) {}
+
+	typedef MeshScanlineRasterizer< TInputMesh, VDimension >    RasterizerType;
+	typedef typename RasterizerType::Pointer                    RasterizerPointer;
+	typedef typename RasterizerType::SegmentList                SegmentList;
+	typedef typename RasterizerType::SpanList                   SpanList;
+
+	inline void AccumulateSpan( double x0, double x1, size_t label, double w, double xfirst, size_t nx, double* row ) const;
+
+private:
+	MultilabelPartialVolumeMeshFilter(const Self &); //purposely not implemented
+	void operator=(const Self &);                  //purposely not implemented
+
+	struct RegionsThreadStruct {
+		Self* Filter;
+		std::atomic< size_t > next;   // first region not claimed yet
+	};
+	static ITK_THREAD_RETURN_TYPE RegionsThreaderCallback(void *arg);
+
+	IndexType m_Index;
+	SizeType m_Size;
+	SpacingType m_Spacing;
+	PointType m_Origin;
+	DirectionType m_Direction;
+
+	size_t m_NumberOfMeshes;
+	size_t m_NumberOfRegions;
+	size_t m_SubsamplingFactor;
+	bool m_WriteFractions;
+	MaskImageConstPointer m_MaskImage;
+	OutputSegmentationPointer m_OutputSegmentation;
+	RegionList m_RequestedRegions;
+
+	RasterizerPointer m_Rasterizer;
+}; // class
+
+} // namespace rstk
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "MultilabelPartialVolumeMeshFilter.hxx"
+#endif
+
+#endif /* SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_H_ */
@@ -0,0 +1,321 @@
+// --------------------------------------------------------------------------------------
+// File:          MultilabelPartialVolumeMeshFilter.hxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of RegSeg
+//
+// RegSeg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// RegSeg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_HXX_
+#define SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_HXX_
+
+#include "MultilabelPartialVolumeMeshFilter.h"
+#include <algorithm>
+#include <itkProcessObject.h>
+#include <itkProgressReporter.h>
+#include <itkMultiThreader.h>
+
+namespace rstk
+{
+/** Constructor */
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::MultilabelPartialVolumeMeshFilter():
+ m_NumberOfMeshes(0),
+ m_NumberOfRegions(0),
+ m_SubsamplingFactor(2),
+ m_WriteFractions(true) {
+	this->SetNumberOfRequiredInputs(1);
+	m_Size.Fill(0);
+	m_Index.Fill(0);
+	m_Spacing.Fill(0.0);
+	m_Origin.Fill(0.0);
+	m_Direction.GetVnlMatrix().set_identity();
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::PrintSelf(std::ostream & os, itk::Indent indent) const {
+	Superclass::PrintSelf(os, indent);
+	os << indent << "NumberOfMeshes: " << m_NumberOfMeshes << std::endl;
+	os << indent << "SubsamplingFactor: " << m_SubsamplingFactor << std::endl;
+	os << indent << "WriteFractions: " << m_WriteFractions << std::endl;
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::SetOutputReference(const itk::ImageBase<Dimension>* reference) {
+	this->SetSize(reference->GetLargestPossibleRegion().GetSize());
+	this->SetIndex(reference->GetLargestPossibleRegion().GetIndex());
+	this->SetOrigin(reference->GetOrigin());
+	this->SetDirection(reference->GetDirection());
+	this->SetSpacing(reference->GetSpacing());
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::GenerateOutputInformation() {
+	OutputImagePointer output = this->GetOutput();
+	m_NumberOfRegions = m_NumberOfMeshes + 1;
+
+	RegionType region;
+	region.SetSize(m_Size);
+	region.SetIndex(m_Index);
+
+	output->SetLargestPossibleRegion(region);
+	output->SetSpacing(m_Spacing);
+	output->SetOrigin(m_Origin);
+	output->SetDirection(m_Direction);
+	output->SetNumberOfComponentsPerPixel(m_NumberOfRegions + 1);
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::AllocateOutputs() {
+	if (m_WriteFractions) {
+		Superclass::AllocateOutputs();
+		return;
+	}
+
+	// Leave the output without buffer
+	RegionType empty;
+	empty.SetIndex(m_Index);
+	this->GetOutput()->SetBufferedRegion(empty);
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::GenerateData() {
+	if (m_RequestedRegions.empty()) {
+		Superclass::GenerateData();
+		return;
+	}
+
+	// Same sequence as ImageSource::GenerateData, but threads claim whole
+	// requested regions instead of splitting the output
+	this->AllocateOutputs();
+	this->BeforeThreadedGenerateData();
+
+	RegionsThreadStruct str;
+	str.Filter = this;
+	str.next = 0;
+
+	this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
+	this->GetMultiThreader()->SetSingleMethod(this->RegionsThreaderCallback, &str);
+	this->GetMultiThreader()->SingleMethodExecute();
+
+	this->AfterThreadedGenerateData();
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+ITK_THREAD_RETURN_TYPE
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::RegionsThreaderCallback(void *arg) {
+	itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct *)(arg);
+	RegionsThreadStruct* str = (RegionsThreadStruct *)(info->UserData);
+	const RegionList& regions = str->Filter->m_RequestedRegions;
+
+	size_t r;
+	while ((r = str->next.fetch_add(1)) < regions.size()) {
+		str->Filter->ThreadedGenerateData(regions[r], info->ThreadID);
+	}
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::BeforeThreadedGenerateData() {
+	OutputImagePointer output = this->GetOutput();
+	RegionType region = output->GetLargestPossibleRegion();
+
+	m_OutputSegmentation = OutputSegmentationType::New();
+	m_OutputSegmentation->SetRegions(region);
+	m_OutputSegmentation->SetSpacing(m_Spacing);
+	m_OutputSegmentation->SetOrigin(m_Origin);
+	m_OutputSegmentation->SetDirection(m_Direction);
+	m_OutputSegmentation->Allocate();
+	if (m_RequestedRegions.empty()) {
+		m_OutputSegmentation->FillBuffer(m_NumberOfMeshes);
+	}
+
+	// Map vertices to the continuous index of the output, and bucket
+	// the triangles by the output slices they cross
+	typename RasterizerType::InputMeshList meshes(m_NumberOfMeshes);
+	for (size_t mid = 0; mid < m_NumberOfMeshes; mid++) {
+		meshes[mid] = this->GetInput(mid);
+	}
+	m_Rasterizer = RasterizerType::New();
+	m_Rasterizer->Initialize(meshes, output, m_Index[2], m_Size[2], 0.5);
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+inline void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::AccumulateSpan(double x0, double x1, size_t label, double w, double xfirst, size_t nx, double* row) const {
+	double xlast = xfirst + nx;
+	if (x0 < xfirst) x0 = xfirst;
+	if (x1 > xlast) x1 = xlast;
+	if (x1 <= x0) {
+		return;
+	}
+
+	size_t i0 = floor(x0 - xfirst);
+	size_t i1 = floor(x1 - xfirst);
+	if (i1 > nx - 1) i1 = nx - 1;
+
+	for (size_t i = i0; i <= i1; i++) {
+		double a = std::max(x0, xfirst + i);
+		double b = std::min(x1, xfirst + i + 1);
+		if (b > a) {
+			row[i * m_NumberOfRegions + label] += w * (b - a);
+		}
+	}
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+void
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::ThreadedGenerateData(const OutputImageRegionType & outputRegionForThread, itk::ThreadIdType threadId) {
+	OutputImagePointer output = this->GetOutput();
+	OutputPixelValueType* outBuffer = output->GetBufferPointer();
+	SegmentationPixelType* segBuffer = m_OutputSegmentation->GetBufferPointer();
+	const OutputPixelValueType* mskBuffer = NULL;
+	if (m_MaskImage.IsNotNull()) {
+		mskBuffer = m_MaskImage->GetBufferPointer();
+	}
+
+	IndexType start = outputRegionForThread.GetIndex();
+	SizeType size = outputRegionForThread.GetSize();
+	size_t nx = size[0];
+	size_t ny = size[1];
+	size_t ncomps = m_NumberOfRegions + 1;
+	size_t nsub = m_SubsamplingFactor;
+	double w = 1.0 / (nsub * nsub);
+	double xfirst = start[0] - 0.5;
+
+	itk::ProgressReporter progress(this, threadId, size[2]);
+
+	std::vector< double > coverage(nx * ny * m_NumberOfRegions);
+	std::vector< OutputPixelValueType > rowBuffer(m_WriteFractions?0:nx * ncomps);
+	std::vector< SegmentList > rows(ny);
+	typename RasterizerType::ScanlineBuffer buffer;
+	IndexType idx;
+
+	for (long z = start[2]; z < long(start[2] + size[2]); z++) {
+		std::fill(coverage.begin(), coverage.end(), 0.0);
+
+		for (size_t sz = 0; sz < nsub; sz++) {
+			double zc = z - 0.5 + (sz + 0.5) / nsub;
+
+			// Intersect the triangles with this plane and bucket the segments by row
+			m_Rasterizer->IntersectSlice(z, zc, start[1], 0.5, rows);
+
+			for (size_t r = 0; r < ny; r++) {
+				double* row = &coverage[r * nx * m_NumberOfRegions];
+
+				for (size_t sy = 0; sy < nsub; sy++) {
+					double yc = start[1] + r - 0.5 + (sy + 0.5) / nsub;
+
+					m_Rasterizer->ComputeSpans(rows[r], yc, buffer);
+					const SpanList& spans = buffer.spans;
+					for (size_t k = 0; k < spans.size(); k++) {
+						this->AccumulateSpan(spans[k].x0, spans[k].x1, spans[k].label, w, xfirst, nx, row);
+					}
+				}
+			}
+		}
+
+		// Write the slice out
+		idx[2] = z;
+		for (size_t r = 0; r < ny; r++) {
+			idx[0] = start[0];
+			idx[1] = start[1] + r;
+			OutputPixelValueType* rowOut = m_WriteFractions?(outBuffer + output->ComputeOffset(idx) * ncomps):&rowBuffer[0];
+			for (size_t i = 0; i < nx; i++) {
+				idx[0] = start[0] + i;
+				const double* cov = &coverage[(r * nx + i) * m_NumberOfRegions];
+				OutputPixelValueType* px = rowOut + i * ncomps;
+
+				size_t label = m_NumberOfMeshes;
+				double max = 0.0;
+				for (size_t comp = 0; comp < m_NumberOfRegions; comp++) {
+					px[comp] = (cov[comp] > 1.0)?1.0:cov[comp];
+					if (cov[comp] > max) {
+						max = cov[comp];
+						label = comp;
+					}
+				}
+				px[m_NumberOfRegions] = 0.0;
+				*(segBuffer + m_OutputSegmentation->ComputeOffset(idx)) = label;
+
+				// Voxels out of the mask are either fully flagged or left empty
+				if (mskBuffer != NULL && *(mskBuffer + m_MaskImage->ComputeOffset(idx)) > 0.0) {
+					bool any = false;
+					for (size_t comp = 0; comp < m_NumberOfMeshes; comp++) {
+						if (px[comp] > 0.0) {
+							any = true;
+						}
+						px[comp] = 0.0;
+					}
+					px[m_NumberOfMeshes] = 0.0;
+					px[m_NumberOfRegions] = any?1.0:0.0;
+				}
+			}
+
+			idx[0] = start[0];
+			this->ThreadedProcessRow(idx, nx, rowOut, threadId);
+		}
+		progress.CompletedPixel();
+	}
+}
+
+template< typename TInputMesh, typename TOutputPixelType, unsigned int VDimension >
+typename MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >::InputMeshType *
+MultilabelPartialVolumeMeshFilter< TInputMesh, TOutputPixelType, VDimension >
+::GetInput(size_t idx) {
+	return itkDynamicCastInDebugMode< TInputMesh * >
+			( this->ProcessObject::GetInput(idx) );
+}
+
+} // namespace rstk
+#endif /* SOURCE_DIRECTORY__MODULES_FILTERING_INCLUDE_MULTILABELPARTIALVOLUMEMESHFILTER_HXX_ */
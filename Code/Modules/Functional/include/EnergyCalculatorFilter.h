@@ -45,6 +45,7 @@
 
 #include <itkImageTransformer.h>
 #include <itkImageRegionConstIterator.h>
+#include <itkImageLinearConstIteratorWithIndex.h>
 #include "ModelBase.h"
 
 namespace rstk {
@@ -69,6 +70,7 @@ public:
 	typedef typename InputImageType::SpacingType                              SpacingType;
 	typedef typename InputImageType::IndexType                                IndexType;
 	typedef typename InputImageType::PixelType                                PixelType;
+	typedef typename InputImageType::InternalPixelType                        PixelValueType;
 	typedef typename InputImageType::PointType                                PointType;
 	typedef typename InputImageType::RegionType                               RegionType;
 
@@ -77,13 +79,14 @@ public:
 	typedef typename PriorsImageType::PixelType                               PriorsPixelType;
 	typedef typename PriorsImageType::Pointer                                 PriorsImagePointer;
 	typedef itk::ImageRegionConstIterator< PriorsImageType >                  PriorsImageIteratorType;
-	typedef itk::Array<PriorsPrecisionType>                                   TotalVolumeContainer;
+	typedef SparsePriorsMap< PriorsPrecisionType, Dimension >                 SparsePriorsMapType;
 
 	typedef itk::Image< PriorsPrecisionType, Dimension >                      MaskType;
 	typedef typename MaskType::Pointer                                        MaskPointer;
 
 	typedef TMeasureType                                                      MeasureType;
 	typedef itk::Array<MeasureType>                                           MeasureArrayType;
+	typedef itk::Array<MeasureType>                                           TotalVolumeContainer;
 	typedef itk::SimpleDataObjectDecorator< MeasureArrayType >                MeasureArrayObjectType;
 
 	typedef typename Superclass::DataObjectPointer                            DataObjectPointer;
@@ -114,7 +117,18 @@ public:
     }
 
     const PriorsImageType * GetPriorsMap() {
-    	return static_cast<const PriorsImageType*>(this->ProcessObject::GetInput(1));
+    	return dynamic_cast<const PriorsImageType*>(this->ProcessObject::GetInput(1));
+    }
+
+    /** Set/Get the priors in compact form, replaces the dense priors map
+     *
+     */
+    void SetSparsePriorsMap(const SparsePriorsMapType *priors) {
+    	this->SetNthInput(1, const_cast<SparsePriorsMapType *>(priors));
+    }
+
+    const SparsePriorsMapType * GetSparsePriorsMap() {
+    	return dynamic_cast<const SparsePriorsMapType*>(this->ProcessObject::GetInput(1));
     }
 
     /** Set/Get priors
@@ -132,6 +146,8 @@ public:
     itkGetConstObjectMacro(Model, EnergyModelType);
 
 	const MeasureArrayType GetEnergies() const { return this->GetEnergiesOutput()->Get();}
+	/** Total volume (partial volume weighted) of each region in the last update */
+	const TotalVolumeContainer GetVolumes() const { return this->m_TotalVolumes; }
 	MeasureArrayObjectType * GetEnergiesOutput();
 	const MeasureArrayObjectType * GetEnergiesOutput() const;
 
@@ -157,7 +173,8 @@ private:
 	size_t m_NumberOfRegions;
 	ThreadMeasureArrayType m_Energies;
 	ThreadVolumeArrayType m_Volumes;
-	PriorsPrecisionType m_PixelVolume;
+	TotalVolumeContainer m_TotalVolumes;
+	MeasureType m_PixelVolume;
 	EnergyModelConstPointer m_Model;
 }; // class EnergyCalculatorFilter
 
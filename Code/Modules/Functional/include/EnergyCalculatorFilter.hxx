@@ -81,7 +81,8 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
 	RegionType splitRegion;  // dummy region - just to call the following method
 	nbOfThreads = this->SplitRequestedRegion(0, nbOfThreads, splitRegion);
 
-	this->m_NumberOfRegions = this->GetPriorsMap()->GetNumberOfComponentsPerPixel();
+	const SparsePriorsMapType* sparse = this->GetSparsePriorsMap();
+	this->m_NumberOfRegions = ( sparse != NULL )?sparse->GetNumberOfComponents():this->GetPriorsMap()->GetNumberOfComponentsPerPixel();
 	this->m_Energies.resize(nbOfThreads);
 	this->m_Volumes.resize(nbOfThreads);
 
@@ -97,12 +98,23 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
 	long nbOfPixels = inputRegionForThread.GetNumberOfPixels();
 	itk::ProgressReporter progress( this, threadId, nbOfPixels );
 
-	itk::ImageRegionConstIterator< TInputVectorImage > inputIt( this->GetInput(), inputRegionForThread );
-	itk::ImageRegionConstIterator< PriorsImageType >   priorIt( this->GetPriorsMap(), inputRegionForThread );
-	itk::ImageRegionConstIterator< MaskType >          maskIt ( this->GetMask(), inputRegionForThread );
- 	inputIt.GoToBegin();
+	const InputImageType* input = this->GetInput();
+	const PriorsImageType* priors = this->GetPriorsMap();
+	const SparsePriorsMapType* sparse = this->GetSparsePriorsMap();
+	const PixelValueType* inputBuffer = input->GetBufferPointer();
+	const PriorsPrecisionType* priorsBuffer = ( priors != NULL )?priors->GetBufferPointer():NULL;
+	size_t ncomps = input->GetNumberOfComponentsPerPixel();
+	size_t nrois = this->m_NumberOfRegions;
+
+	// Rows of the region are evaluated at once for each region
+	itk::ImageLinearConstIteratorWithIndex< InputImageType > lineIt( input, inputRegionForThread );
+	lineIt.SetDirection( 0 );
+	size_t rowlength = inputRegionForThread.GetSize()[0];
+	std::vector< MeasureType > rowEnergies( rowlength );
+	std::vector< PriorsPrecisionType > rowPriors( ( sparse != NULL )?rowlength * nrois:0 );
 
  	EnergyModelConstPointer model = this->GetModel();
+ 	bool cached = model->HasEnergyCache();
 
  	MeasureArrayType energies;
  	energies.SetSize(this->m_NumberOfRegions);
@@ -112,30 +124,47 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
  	volumes.SetSize(this->m_NumberOfRegions);
  	volumes.Fill(0.0);
 
- 	size_t lastroi = this->m_NumberOfRegions - 1;
- 	PriorsPixelType w;
- 	double bgw;
- 	PriorsPrecisionType vol;
- 	PixelType val;
- 	MeasureType e;
-	while ( !inputIt.IsAtEnd() ) {
-		bgw = maskIt.Get();
-		val = inputIt.Get();
-		w = priorIt.Get();
-
-		for(size_t roi = 0; roi < m_NumberOfRegions; roi++ ) {
-			if( w[roi] < 1.0e-8 )
+ 	MeasureType vol;
+	IndexType idx;
+	for ( lineIt.GoToBegin(); !lineIt.IsAtEnd(); lineIt.NextLine() ) {
+		idx = lineIt.GetIndex();
+		const PixelValueType* x = inputBuffer + input->ComputeOffset( idx ) * ncomps;
+		const PriorsPrecisionType* w;
+		if ( sparse != NULL ) {
+			sparse->GetRow( idx, rowlength, &rowPriors[0] );
+			w = &rowPriors[0];
+		} else {
+			w = priorsBuffer + priors->ComputeOffset( idx ) * nrois;
+		}
+
+		for(size_t roi = 0; roi < nrois; roi++ ) {
+			size_t first = 0;
+			while( first < rowlength && w[first * nrois + roi] < 1.0e-8 ) first++;
+			if( first == rowlength )
 				continue;
 
-			e = model->Evaluate(val, roi);
-			vol = w[roi] * this->m_PixelVolume;
-			volumes[roi]+= vol;
-			energies[roi]+= vol * e;
+			if( cached ) {
+				IndexType pidx = idx;
+				for( size_t i = first; i < rowlength; i++ ) {
+					pidx[0] = idx[0] + i;
+					rowEnergies[i] = ( w[i * nrois + roi] < 1.0e-8 )?0.0:model->EvaluateAtIndex( pidx, roi );
+				}
+			} else {
+				model->EvaluateBatch( x + first * ncomps, rowlength - first, roi, &rowEnergies[first] );
+			}
+
+			for( size_t i = first; i < rowlength; i++ ) {
+				if( w[i * nrois + roi] < 1.0e-8 )
+					continue;
+				vol = w[i * nrois + roi] * this->m_PixelVolume;
+				volumes[roi]+= vol;
+				energies[roi]+= vol * rowEnergies[i];
+			}
 		}
 
-		++inputIt;
-	    ++priorIt;
-	    progress.CompletedPixel();
+		for( size_t i = 0; i < rowlength; i++ ) {
+			progress.CompletedPixel();
+		}
 	}
 
 	this->m_Energies[threadId] = energies;
@@ -164,6 +193,7 @@ EnergyCalculatorFilter< TInputVectorImage, TMeasureType, TPriorsPrecisionType >
 		energies[roi]+= volumes[roi] * model->GetRegionOffsetContainer()[roi];
 	}
 
+	this->m_TotalVolumes = volumes;
 	this->GetEnergiesOutput()->Set(energies);
 }
 
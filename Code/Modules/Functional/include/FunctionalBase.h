@@ -38,7 +38,8 @@
 #ifndef FUNCTIONALBASE_H_
 #define FUNCTIONALBASE_H_
 
-#include <mutex>
+#include <atomic>
+#include <map>
 
 #include <itkObject.h>
 #include <itkNumericTraits.h>
@@ -84,10 +85,13 @@
 #include "WarpQEMeshFilter.h"
 #include "SparseMatrixTransform.h"
 #include "DownsampleAveragingFilter.h"
-#include "MultilabelBinarizeMeshFilter.h"
+#include "MultilabelPartialVolumeMeshFilter.h"
+#include "MeshScanlineRasterizer.h"
+#include "TriangleMeshTopology.h"
 
 #include "EnergyCalculatorFilter.h"
 #include "MahalanobisDistanceModel.h"
+#include "PartialVolumeEnergyFilter.h"
 
 namespace rstk {
 /** \class FunctionalBase
@@ -150,12 +154,16 @@ public:
 	typedef typename ReferenceImageType::DirectionType                DirectionType;
 	typedef typename ReferenceImageType::SizeType                     ReferenceSizeType;
 	typedef typename ReferenceImageType::SpacingType                  ReferenceSpacingType;
+	typedef typename ReferenceImageType::RegionType                   ReferenceRegionType;
+	typedef std::vector< ReferenceRegionType >                        ReferenceRegionList;
 	typedef itk::Array< MeasureType >                                 MeasureArray;
 
 	typedef itk::SmoothingRecursiveGaussianImageFilter
 			< ReferenceImageType >                                    SmoothingFilterType;
 	typedef typename SmoothingFilterType::Pointer			          SmoothingFilterPointer;
 	typedef typename SmoothingFilterType::SigmaArrayType              SigmaArrayType;
+	typedef std::map< std::vector< double >,
+			          ReferenceImageConstPointer >                    SmoothingCacheType;
 
 	typedef rstk::VectorLinearInterpolateImageFunction
 			< ReferenceImageType >                                    InterpolatorType;
@@ -203,6 +211,10 @@ public:
 	typedef typename NormalFilterType::AreaContainerType              NormalFilterAreasContainer;
 	typedef std::vector< NormalFilterPointer >                        NormalFilterList;
 
+	typedef TriangleMeshTopology< VectorContourType >                 TopologyType;
+	typedef typename TopologyType::Pointer                            TopologyPointer;
+	typedef std::vector< TopologyPointer >                            TopologyList;
+
 	// Contour copiers
 	typedef typename rstk::CopyQuadEdgeMeshFilter
 				  <ScalarContourType, ScalarContourType>              ScalarContourCopyType;
@@ -256,13 +268,15 @@ public:
 	typedef typename PriorsImageType::PixelType                       PriorsPixelType;
 	typedef typename PriorsImageType::InternalPixelType               PriorsValueType;
 
-	typedef MultilabelBinarizeMeshFilter< VectorContourType >         BinarizeMeshFilterType;
-	typedef typename BinarizeMeshFilterType::Pointer                  BinarizeMeshFilterPointer;
-	typedef typename BinarizeMeshFilterType::OutputImageType          BinarizationImageType;
+	typedef PartialVolumeEnergyFilter
+			< VectorContourType, EnergyModelType >                    PartialVolumeFilterType;
+	typedef typename PartialVolumeFilterType::Pointer                 PartialVolumeFilterPointer;
+	typedef typename PartialVolumeFilterType::SparsePriorsMapType     SparsePriorsMapType;
+	typedef typename SparsePriorsMapType::Pointer                     SparsePriorsMapPointer;
 
-	typedef DownsampleAveragingFilter
-			< BinarizationImageType, PriorsImageType >                DownsampleFilter;
-	typedef typename DownsampleFilter::Pointer                        DownsamplePointer;
+	typedef MeshScanlineRasterizer< VectorContourType >               ProbeRasterizerType;
+	typedef typename ProbeRasterizerType::Pointer                     ProbeRasterizerPointer;
+	typedef typename ProbeRasterizerType::ScanlineBuffer              ProbeBufferType;
 
 	typedef itk::Image< float, Dimension >                            ProbabilityMapType;
 	typedef typename ProbabilityMapType::Pointer                      ProbabilityMapPointer;
@@ -355,7 +369,11 @@ public:
 	itkSetClampMacro( DecileThreshold, float, 0.0, 0.5 );
 	itkGetMacro( DecileThreshold, float );
 
-	itkGetMacro( CurrentContours, VectorContourList);
+	/** Contours at the current positions, their point data hold the last shape gradients */
+	VectorContourList GetCurrentContours() {
+		this->SyncCurrentContours();
+		return this->m_CurrentContours;
+	}
 	itkGetMacro( Gradients, VectorContourList );
 	itkGetMacro( Vertices, PointsVector );
 	itkGetMacro( ValidVertices, PointIdContainer );
@@ -363,16 +381,44 @@ public:
 	virtual void SetCurrentDisplacements( const VNLVectorContainer& vals );
 
 	itkGetConstObjectMacro(ReferenceImage, ReferenceImageType);
-	itkSetConstObjectMacro(ReferenceImage, ReferenceImageType);
+	virtual void SetReferenceImage( const ReferenceImageType * _arg );
 
 	void LoadReferenceImage( const std::vector<std::string> fixedImageNames );
 
-	itkGetConstObjectMacro( CurrentMaps, PriorsImageType);
+	/** Current partial volume maps, expanded from the sparse maps if those are used */
+	typename PriorsImageType::ConstPointer GetCurrentMaps() const {
+		if ( this->m_SparseMaps.IsNotNull() ) {
+			return this->m_SparseMaps->ToImage().GetPointer();
+		}
+		return this->m_CurrentMaps.GetPointer();
+	}
+	itkGetConstObjectMacro( SparseMaps, SparsePriorsMapType );
 
 	itkGetMacro( ApplySmoothing, bool );
 	itkGetMacro( UseBackground, bool );
 	itkSetMacro( UseBackground, bool );
 
+	/** Re-rasterize only the neighborhood of moved triangles when updating the region maps */
+	itkGetMacro( UseIncrementalRegions, bool );
+	itkSetMacro( UseIncrementalRegions, bool );
+	itkBooleanMacro( UseIncrementalRegions );
+
+	/** Cache per-voxel region energies in the model, optionally only in a band around the boundaries */
+	itkGetMacro( UseEnergyCache, bool );
+	itkSetMacro( UseEnergyCache, bool );
+	itkBooleanMacro( UseEnergyCache );
+	itkGetMacro( EnergyCacheBand, size_t );
+	itkSetMacro( EnergyCacheBand, size_t );
+
+	/** Refresh descriptors from the region changes, re-estimating them robustly every N updates (0 disables) */
+	itkGetMacro( IncrementalDescriptors, size_t );
+	itkSetMacro( IncrementalDescriptors, size_t );
+
+	/** Keep the region maps as labels plus the fractions of boundary voxels only */
+	itkGetMacro( UseSparseMaps, bool );
+	itkSetMacro( UseSparseMaps, bool );
+	itkBooleanMacro( UseSparseMaps );
+
 	itkGetMacro( Sigma, SigmaArrayType );
 	itkSetMacro( Sigma, SigmaArrayType );
 
@@ -396,14 +442,26 @@ public:
 
 	MeasureType GetValue();
 	itkGetConstMacro(RegionValue, MeasureArray);
+	itkGetConstMacro(RegionVolume, MeasureArray);
 	itkGetConstMacro(GradientStatistics, GradientStatsArray);
 	void ComputeDerivative(PointValueType* gradVector, ScalesType scales);
 
 	virtual void Initialize();
 	virtual void UpdateDescriptors() {
-		this->m_Model->SetPriorsMap(this->m_CurrentMaps);
-		this->m_Model->Update();
+		// In between robust estimations, use the sums patched by PatchRegionsInBox
+		if ( this->m_IncrementalDescriptors > 0 && this->m_Model->HasDescriptorSums() &&
+				++this->m_DescriptorUpdates < this->m_IncrementalDescriptors ) {
+			this->m_Model->UpdateDescriptorsFromSums();
+		} else {
+			this->m_DescriptorUpdates = 0;
+			this->ConnectCurrentMaps(this->m_Model.GetPointer());
+			this->m_Model->Update();
+		}
 		this->m_MaxEnergy = this->m_Model->GetMaxEnergy();
+
+		// Cached energies were evaluated with the old descriptors
+		this->m_EnergyCacheValid = false;
+		this->m_EnergyUpdated = false;
 	}
 
 	virtual std::string PrintFormattedDescriptors() {
@@ -414,6 +472,16 @@ public:
 
 	itkGetConstObjectMacro( BackgroundMask, ProbabilityMapType);
 	virtual void SetBackgroundMask (const ProbabilityMapType * _arg);
+	/** Sets a mask that was already processed by SetBackgroundMask on the same reference grid */
+	void SetProcessedBackgroundMask (const ProbabilityMapType * _arg) {
+		if ( this->m_BackgroundMask != _arg ) {
+			this->m_BackgroundMask = _arg;
+			this->Modified();
+		}
+	}
+
+	/** Smoothed reference images, keyed by sigma, that can be shared among functionals */
+	void SetSmoothingCache( SmoothingCacheType* cache ) { this->m_SmoothingCache = cache; }
 
 	itkGetConstMacro( OffMaskVertices, std::vector<size_t>);
 
@@ -450,8 +518,6 @@ protected:
 		os << std::endl;
 	}
 
-	void InitializeSamplingGrid( void );
-
 	//virtual MeasureType GetEnergyOfSample( ReferencePixelType sample, size_t roim, bool bias = false ) const = 0;
 	MeasureType GetEnergyAtPoint( const PointType& point, size_t roi ) const;
 	MeasureType GetEnergyAtPoint( const PointType& point, size_t roi, ReferencePixelType& value ) const;
@@ -462,21 +528,41 @@ protected:
 	//virtual MeasureType GetEnergyOffset(size_t roi) const = 0;
 
 	// Methods for multithreading
+	/** Buffers of one thread in ThreadedDerivativeCompute, sized to the chunk */
+	struct GradientScratch {
+		std::vector< typename InterpolatorType::ContinuousIndexType > cidx;
+		std::vector< ChannelPixelType > samples;   // component-major
+		std::vector< ChannelPixelType > subset;
+		std::vector< size_t > ids;
+		std::vector< MeasureType > energies, gin, gout;
+	};
+
 	struct ParallelGradientStruct {
 		Self* selfptr;
 		size_t total;
+		size_t chunk;                    // vertices claimed at once by a thread
+		std::atomic< size_t > next;      // first vertex not claimed yet
 		PointValuesVector* gradients;
-		std::mutex mutex;
-		std::vector<NormalFilterAreasContainer> areas;
-		std::vector<PointsContainerPointer> points;
-		std::vector< double > totalAreas;
+		std::vector< GradientScratch > scratch;   // per thread
 	};
 
 	static ITK_THREAD_RETURN_TYPE ThreadedDerivativeCallback(void *arg);
-	PointValuesVector ThreadedDerivativeCompute(size_t start, size_t stop,
-			std::vector<PointsContainerPointer> points,
-			std::vector<NormalFilterAreasContainer> areas,
-			std::vector< double > totalAreas);
+	void ThreadedDerivativeCompute(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelGradientStruct& str);
+
+	struct ParallelContourStruct {
+		Self* selfptr;
+		size_t total;
+		size_t chunk;
+		std::atomic< size_t > next;
+		std::vector< size_t > changed;   // moved vertices, per thread
+		std::vector< size_t > invalid;   // vertices off the image domain, per thread
+		std::vector< size_t > offmask;   // vertices off the mask, per thread and contour
+		std::vector< size_t > cmoved;    // vertices that changed position, per thread and contour
+		std::vector< std::vector< size_t > > moved; // ids of the vertices that changed position, per thread
+	};
+
+	static ITK_THREAD_RETURN_TYPE ThreadedContourCallback(void *arg);
+	void ThreadedContourUpdate(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelContourStruct& str);
 
 
 
@@ -491,11 +577,20 @@ protected:
 	bool m_RegionsUpdated;
 	bool m_ApplySmoothing;
 	bool m_UseBackground;
+	bool m_UseIncrementalRegions;
+	bool m_EnergyCacheValid;
+	bool m_ContoursOutdated;
+	bool m_UseEnergyCache;
+	size_t m_EnergyCacheBand;
+	size_t m_IncrementalDescriptors;
+	size_t m_DescriptorUpdates;    // updates since the last robust estimation
+	bool m_UseSparseMaps;
 
 	mutable MeasureType m_Value;
 	mutable MeasureArray m_RegionValue;
+	MeasureArray m_RegionEnergy;   // sum of volume * energy per region, without offsets
+	MeasureArray m_RegionVolume;   // partial volume of each region
 	mutable MeasureType m_MaxEnergy;
-	FieldPointer m_ReferenceSamplingGrid;
 	VectorContourList m_CurrentContours;
 	VectorContourList m_Gradients;
 	ScalarConstContourList m_Priors;
@@ -505,9 +600,14 @@ protected:
 	// ROIList m_ROIs;
 	ROIList m_CurrentROIs;
 	PriorsImagePointer m_CurrentMaps;
+	SparsePriorsMapPointer m_SparseMaps;   // replaces m_CurrentMaps when UseSparseMaps is on
 	ProbabilityMapConstPointer m_BackgroundMask;
 	ROIPointer m_CurrentRegions;
+	std::vector< bool > m_DirtyBlocks;
+	ReferenceSizeType m_DirtyBlocksSize;
+	size_t m_DirtyBlockSize;
 	ReferenceImageConstPointer m_ReferenceImage;
+	SmoothingCacheType* m_SmoothingCache;
 	ReferencePointType m_Origin, m_End, m_FirstPixelCenter, m_LastPixelCenter;
 	ReferencePointType m_OldOrigin;
 	ReferenceSizeType m_ReferenceSize;
@@ -520,7 +620,24 @@ protected:
 
 	InterpolatorPointer m_Interp;
 	MaskInterpolatorPointer m_MaskInterp;
-	PointDataContainerPointer m_CurrentDisplacements;
+
+	// Contour state during the optimization, one entry per vertex (global id)
+	VNLVectorContainer m_PriorPositions;
+	VNLVectorContainer m_CurrentPositions;
+	VNLVectorContainer m_Displacements;
+	VNLVectorContainer m_Normals;
+	VNLVectorContainer m_ShapeGradients;
+	VNLVector m_Areas;                          // vertex area over the total area of its contour
+	ContourOuterRegions m_VertexContour;
+	std::vector< unsigned char > m_MovedVertices;
+	PointsVector m_PreviousPositions;
+
+	// Physical point to continuous index affines of the reference and the mask, set once per level
+	DirectionType m_PhysicalToIndex;
+	DirectionType m_MaskPhysicalToIndex;
+	ReferencePointType m_MaskOrigin;
+	ReferenceSizeType m_MaskSize;
+
 	PointsVector m_Vertices;
 	PointIdContainer m_ValidVertices;
 	PointIdContainer m_OuterRegion;
@@ -528,8 +645,11 @@ protected:
 	PointIdContainer m_Offsets;
 
 	std::vector<size_t> m_OffMaskVertices;
+	TopologyList m_Topologies;   // flat adjacency of each contour, built once per level
 
 	GradientStatsArray m_GradientStatistics;
+	PointValuesVector m_GradientSamples;
+	PointValuesVector m_GradientSelection;
 
 	mutable std::stringstream m_InfoBuffer;
 
@@ -539,7 +659,26 @@ private:
 
 	void UpdateContour();
 	void ComputeCurrentRegions();
+	void UpdateCurrentRegions();
+	void PatchRegionsInBox( const ReferenceRegionType& box, const PriorsImageType* maps, const ROIType* seg );
+	void MoveVoxelWeights( const ReferenceIndexType& idx, const PriorsValueType* w_old, const PriorsValueType* w_new,
+			size_t ncomps, MeasureType pixvol, bool delta, bool track );
+
+	/** Set the current maps, dense or sparse, as the priors of filter */
+	template< typename TFilter >
+	void ConnectCurrentMaps( TFilter* filter ) {
+		if ( this->m_SparseMaps.IsNotNull() ) {
+			filter->SetSparsePriorsMap( this->m_SparseMaps );
+		} else {
+			filter->SetPriorsMap( this->m_CurrentMaps );
+		}
+	}
+	void MarkDirtyTriangles( size_t contid, const std::vector< unsigned char >& moved, const PointsVector& previous );
 	void InitializeContours();
+	ProbeRasterizerPointer ComputeProbe();
+	ROIPixelType ProbeLabel( const ProbeRasterizerType* probe, const PointType& p, ProbeBufferType& buffer ) const;
+	void UpdateNormals();
+	void SyncCurrentContours();
 	void InitializeInterpolatorGrid();
 	double ComputePointArea( const PointIdentifier &iId, VectorContourType *mesh );
 
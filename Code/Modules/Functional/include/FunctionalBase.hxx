@@ -42,11 +42,13 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <math.h>
 #include <memory>
 #include <numeric>
 #include <vnl/vnl_random.h>
 #include <itkImageAlgorithm.h>
+#include <itkImageRegionIterator.h>
 #include <itkOrientImageFilter.h>
 #include "InternalOrientationFilter.h"
 #include <itkContinuousIndex.h>
@@ -60,6 +62,7 @@
 
 #define MAX_GRADIENT 20.0
 #define MIN_GRADIENT 1.0e-8
+#define MAX_DIRTY_BOXES 64
 
 namespace rstk {
 
@@ -76,8 +79,17 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
  m_RegionsUpdated(false),
  m_ApplySmoothing(false),
  m_UseBackground(false),
+ m_UseIncrementalRegions(true),
+ m_EnergyCacheValid(false),
+ m_ContoursOutdated(false),
+ m_UseEnergyCache(false),
+ m_EnergyCacheBand(0),
+ m_IncrementalDescriptors(0),
+ m_DescriptorUpdates(0),
+ m_UseSparseMaps(false),
  m_Value(0.0),
- m_MaxEnergy(0.0)
+ m_MaxEnergy(0.0),
+ m_SmoothingCache(NULL)
  {
 
 	this->m_Threader = itk::MultiThreader::New();
@@ -85,6 +97,8 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 
 	this->m_Value = itk::NumericTraits<MeasureType>::infinity();
 	this->m_Sigma.Fill(0.0);
+	this->m_DirtyBlockSize = 8;
+	this->m_DirtyBlocksSize.Fill(0);
 	this->m_Interp = InterpolatorType::New();
 	this->m_MaskInterp = MaskInterpolatorType::New();
 
@@ -98,11 +112,20 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	this->ParseSettings();
 
 	if( this->m_ApplySmoothing ) {
-		SmoothingFilterPointer s = SmoothingFilterType::New();
-		s->SetInput( this->m_ReferenceImage );
-		s->SetSigmaArray( this->m_Sigma );
-		s->Update();
-		this->m_ReferenceImage = s->GetOutput();
+		std::vector< double > key( this->m_Sigma.Begin(), this->m_Sigma.End() );
+		if( this->m_SmoothingCache != NULL && this->m_SmoothingCache->count( key ) ) {
+			this->m_ReferenceImage = (*this->m_SmoothingCache)[key];
+		} else {
+			SmoothingFilterPointer s = SmoothingFilterType::New();
+			s->SetInput( this->m_ReferenceImage );
+			s->SetSigmaArray( this->m_Sigma );
+			s->Update();
+			this->m_ReferenceImage = s->GetOutput();
+
+			if( this->m_SmoothingCache != NULL ) {
+				(*this->m_SmoothingCache)[key] = this->m_ReferenceImage;
+			}
+		}
 	}
 
 	if (this->m_BackgroundMask.IsNull()) {
@@ -117,16 +140,16 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 		this->m_BackgroundMask = p;
 	}
 
-	// Initialize corresponding ROI /////////////////////////////
-	// Check that high-res reference sampling grid has been initialized
-	if ( this->m_ReferenceSamplingGrid.IsNull() ) {
-			this->InitializeSamplingGrid();
-	}
-
 	// Initialize interpolators
 	this->m_Interp->SetInputImage( this->m_ReferenceImage );
 	this->m_MaskInterp->SetInputImage(this->m_BackgroundMask);
 
+	// Vertices are mapped to both grids at every iteration, keep the affines
+	this->m_PhysicalToIndex = this->m_ReferenceImage->GetPhysicalPointToIndexMatrix();
+	this->m_MaskPhysicalToIndex = this->m_BackgroundMask->GetPhysicalPointToIndexMatrix();
+	this->m_MaskOrigin = this->m_BackgroundMask->GetOrigin();
+	this->m_MaskSize = this->m_BackgroundMask->GetLargestPossibleRegion().GetSize();
+
 	// Compute and set regions in m_ROIs
 	this->ComputeCurrentRegions();
 
@@ -140,17 +163,22 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	this->m_Model = EnergyModelType::New();
 	this->m_Model->SetInput(this->m_ReferenceImage);
 	this->m_Model->SetMask(this->m_BackgroundMask);
-	this->m_Model->SetPriorsMap(this->m_CurrentMaps);
+	this->ConnectCurrentMaps(this->m_Model.GetPointer());
 	if(this->m_UseBackground)
 		this->m_Model->SetNumberOfSpecialRegions(2);
+	this->m_Model->SetUseEnergyCache(this->m_UseEnergyCache);
+	this->m_Model->SetEnergyCacheBand(this->m_EnergyCacheBand);
+	this->m_Model->SetUseDescriptorSums(this->m_IncrementalDescriptors > 0);
 	this->m_Model->Update();
+	this->m_DescriptorUpdates = 0;
 
 	this->m_EnergyCalculator = EnergyFilter::New();
 	this->m_EnergyCalculator->SetInput(this->m_ReferenceImage);
-	this->m_EnergyCalculator->SetPriorsMap(this->m_CurrentMaps);
+	this->ConnectCurrentMaps(this->m_EnergyCalculator.GetPointer());
 	this->m_EnergyCalculator->SetMask(this->m_BackgroundMask);
 	this->m_EnergyCalculator->SetModel(this->m_Model);
 	this->m_EnergyCalculator->Update();
+	this->m_EnergyCacheValid = false;
 
 	if( this->m_Priors.size() == this->m_Target.size() ) {
 		const MeasureArray finals = this->GetFinalEnergy();
@@ -203,139 +231,171 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 
 	size_t nvertices = this->m_ValidVertices.size();
 
-	PointValuesVector gradients;
+	// Buffers are kept between calls, they are only reallocated if the number of vertices grows
+	PointValuesVector& gradients = this->m_GradientSamples;
 	gradients.resize(nvertices);
-	std::fill(gradients.begin(), gradients.end(), -1.0);
 
 	struct ParallelGradientStruct str;
 	str.selfptr = this;
 	str.total = nvertices;
 	str.gradients = &gradients;
-
-
-	std::vector<PointDataContainerPointer> normals;
-	for (size_t i = 0; i < this->m_NumberOfContours; i++ ) {
-		NormalFilterPointer nfilter = NormalFilterType::New();
-		nfilter->SetWeight(NormalFilterType::AREA);
-		nfilter->SetInput(this->m_CurrentContours[i]);
-		nfilter->Update();
-		normals.push_back(nfilter->GetOutput()->GetPointData() );
-
-		str.areas.push_back(nfilter->GetVertexAreaContainer());
-		str.points.push_back(this->m_CurrentContours[i]->GetPoints());
-		str.totalAreas.push_back(nfilter->GetTotalArea());
+	str.next = 0;
+	// Small chunks handed out on demand, so that threads hitting costly vertices do not stall the rest
+	str.chunk = std::max< size_t >( 64, nvertices / ( 16 * this->GetNumberOfThreads() ) );
+
+	// Scratch buffers of the batched path, allocated once per thread
+	if ( !this->m_Model->HasEnergyCache() ) {
+		size_t ncomps = this->m_ReferenceImage->GetNumberOfComponentsPerPixel();
+		str.scratch.resize( this->GetNumberOfThreads() );
+		for ( size_t t = 0; t < str.scratch.size(); t++ ) {
+			GradientScratch& s = str.scratch[t];
+			s.cidx.resize( str.chunk );
+			s.samples.resize( str.chunk * ncomps );
+			s.subset.resize( str.chunk * ncomps );
+			s.ids.reserve( str.chunk );
+			s.energies.resize( str.chunk );
+			s.gin.resize( str.chunk );
+			s.gout.resize( str.chunk );
+		}
 	}
 
+	// Normals and areas of the current positions
+	this->UpdateNormals();
+
 	// Start multithreading engine
 	this->GetMultiThreader()->SetNumberOfThreads(this->GetNumberOfThreads());
 	this->GetMultiThreader()->SetSingleMethod(this->ThreadedDerivativeCallback, &str);
 	this->GetMultiThreader()->SingleMethodExecute();
 
 
-	PointValuesVector sample(gradients);
-	std::sort(sample.begin(), sample.end());
-
-	this->m_GradientStatistics[0] = sample.front();
-	this->m_GradientStatistics[1] = sample[int(0.05 * (sample.size()-1))];
-	this->m_GradientStatistics[2] = sample[int(0.25 * (sample.size()-1))];
-	this->m_GradientStatistics[3] = sample[int(0.50 * (sample.size()-1))];
-	this->m_GradientStatistics[4] = sample[int(0.75 * (sample.size()-1))];
-	this->m_GradientStatistics[5] = sample[int(0.95 * (sample.size()-1))];
-	this->m_GradientStatistics[6] = sample.back();
+	// Only the order statistics are needed, select them in increasing order
+	PointValuesVector& sample = this->m_GradientSelection;
+	sample.assign(gradients.begin(), gradients.end());
+	const double quantiles[7] = { 0.0, 0.05, 0.25, 0.50, 0.75, 0.95, 1.0 };
+	size_t prev = 0;
+	for ( size_t q = 0; q < 7 && nvertices > 0; q++ ) {
+		size_t k = int( quantiles[q] * ( nvertices - 1 ) );
+		std::nth_element( sample.begin() + prev, sample.begin() + k, sample.end() );
+		this->m_GradientStatistics[q] = sample[k];
+		prev = k;
+	}
 
-	VectorType ni, v;
-	PointValueType g;
-	PointIdentifier pid, cpid;     // id of vertex in its contour
-	ROIPixelType icid = 0;
+	PointValueType g, v;
+	PointIdentifier pid;
 	for(size_t vvid = 0; vvid < nvertices; vvid++ ) {
 		pid = this->m_ValidVertices[vvid];
-		icid = this->m_InnerRegion[vvid];
-		cpid = pid - this->m_Offsets[icid];
-		ni = normals[icid]->ElementAt(cpid);
 		g = gradients[vvid];
 		if ( g > this->m_GradientStatistics[5] ) g = this->m_GradientStatistics[5];
 		if ( g < this->m_GradientStatistics[1] ) g = this->m_GradientStatistics[1];
 
-		v.Fill(0.0);
 		for( size_t i = 0; i < Dimension; i++ ) {
+			v = 0.0;
 			if( scales[i] > 1.0e-8 ) {
-				v[i] = scales[i] * g * ni[i];
-				grad[vvid + i * nvertices] = static_cast<float>(v[i]);
-			} else {
-				grad[vvid + i * nvertices] = 0.0;
+				v = scales[i] * g * this->m_Normals[i][pid];
 			}
+			grad[vvid + i * nvertices] = static_cast<float>(v);
+			this->m_ShapeGradients[i][pid] = v;
 		}
-
-		this->m_CurrentContours[icid]->GetPointData()->SetElement( cpid, v );
 	}
+
+	// Gradients are copied to the contours point data on demand
+	this->m_ContoursOutdated = true;
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
 ITK_THREAD_RETURN_TYPE
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::ThreadedDerivativeCallback(void *arg) {
-	itk::ThreadIdType total, threadId, threadCount;
-	threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
-	threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
+	itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct *)( arg );
+	ParallelGradientStruct* str = (ParallelGradientStruct *)( info->UserData );
 
-	ParallelGradientStruct* str = (ParallelGradientStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
-
-	// Compute indices corresponding to each segment
+	// Claim chunks of vertices until none is left. Chunks do not overlap, so
+	// each thread writes its results straight in place
 	size_t nvertices = str->total;
-	size_t ssize = ceil(1.0 * nvertices / threadCount);
-	size_t start = threadId * ssize;
-	size_t stop = ( threadId + 1 ) * ssize - 1;
-
-	if (threadId == threadCount - 1)
-		stop = nvertices - 1;
-
-	PointValuesVector segment = str->selfptr->ThreadedDerivativeCompute(start, stop, str->points, str->areas, str->totalAreas);
-
-	str->mutex.lock();
-	typename PointValuesVector::const_iterator it = segment.begin();
-	typename PointValuesVector::const_iterator last = segment.end();
-	typename PointValuesVector::iterator dest = str->gradients->begin() + start;
-
-	while(it!=last) {
-		*dest = *it;
-		++it;
-		++dest;
+	size_t start;
+	while ( ( start = str->next.fetch_add( str->chunk ) ) < nvertices ) {
+		size_t stop = std::min( start + str->chunk, nvertices ) - 1;
+		str->selfptr->ThreadedDerivativeCompute( start, stop, info->ThreadID, *str );
 	}
-	str->mutex.unlock();
 
 	return ITK_THREAD_RETURN_VALUE;
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
-typename FunctionalBase<TReferenceImageType, TCoordRepType>::PointValuesVector
+void
 FunctionalBase<TReferenceImageType, TCoordRepType>
-::ThreadedDerivativeCompute(size_t start, size_t stop,
-		std::vector<PointsContainerPointer> points,
-		std::vector<NormalFilterAreasContainer> areas,
-		std::vector< double > totalAreas) {
-	size_t nvertices = stop - start;
-	size_t fullsize = nvertices * Dimension;
-
+::ThreadedDerivativeCompute(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelGradientStruct& str) {
 	PointIdentifier pid;      // universal id of vertex
-	PointIdentifier cpid;     // id of vertex in its contour
-
-	VectorContourPointType ci_prime;
-	PointValuesVector sample;
+	PointType ci_prime;
 	ROIPixelType ocid;
 	ROIPixelType icid = 0;
-	double wi = 0.0;
+	PointValueType* dest = &(*str.gradients)[0];
+
+	if ( this->m_Model->HasEnergyCache() ) {
+		for(size_t vvid = start; vvid <= stop; vvid++ ) {
+			icid = this->m_InnerRegion[vvid];
+			ocid = this->m_OuterRegion[vvid];
+			pid = this->m_ValidVertices[vvid];
+			for( size_t i = 0; i < Dimension; i++ ) ci_prime[i] = this->m_CurrentPositions[i][pid]; // Get c'_i
+			dest[vvid] = this->EvaluateGradient( ci_prime, ocid, icid ) * this->m_Areas[pid];
+		}
+		return;
+	}
 
-	for(size_t vvid = start; vvid <= stop; vvid++ ) {
-		icid = this->m_InnerRegion[vvid];
-		ocid = this->m_OuterRegion[vvid];
-		pid = this->m_ValidVertices[vvid];
-		cpid = pid - this->m_Offsets[icid];
-		ci_prime = points[icid]->ElementAt(cpid); // Get c'_i
-		wi = areas[icid][cpid] / totalAreas[icid];
-		sample.push_back(this->EvaluateGradient( ci_prime, ocid, icid )  * wi);
+	// Interpolate the whole chunk, then evaluate the samples of each region in one batch
+	size_t nsamples = stop - start + 1;
+	size_t ncomps = this->m_ReferenceImage->GetNumberOfComponentsPerPixel();
+	size_t nregions = ( this->m_SparseMaps.IsNotNull() )?this->m_SparseMaps->GetNumberOfComponents():this->m_CurrentMaps->GetNumberOfComponentsPerPixel();
+	GradientScratch& scratch = str.scratch[threadId];
+	std::vector< typename InterpolatorType::ContinuousIndexType >& cidx = scratch.cidx;
+	std::vector< ChannelPixelType >& samples = scratch.samples;  // component-major
+	std::vector< ChannelPixelType >& subset = scratch.subset;
+	std::vector< size_t >& ids = scratch.ids;
+	std::vector< MeasureType >& energies = scratch.energies;
+	std::vector< MeasureType >& gin = scratch.gin;
+	std::vector< MeasureType >& gout = scratch.gout;
+	std::fill( gin.begin(), gin.begin() + nsamples, 0.0 );
+	std::fill( gout.begin(), gout.begin() + nsamples, 0.0 );
+
+	for(size_t k = 0; k < nsamples; k++ ) {
+		pid = this->m_ValidVertices[start + k];
+		for( size_t r = 0; r < Dimension; r++ ) {
+			cidx[k][r] = 0.0;
+			for( size_t c = 0; c < Dimension; c++ ) {
+				cidx[k][r]+= this->m_PhysicalToIndex(r, c) * ( this->m_CurrentPositions[c][pid] - this->m_FirstPixelCenter[c] );
+			}
+		}
+	}
+	this->m_Interp->EvaluateBatchAtContinuousIndex( &cidx[0], nsamples, &samples[0] );
+
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		ids.clear();
+		for(size_t k = 0; k < nsamples; k++ ) {
+			icid = this->m_InnerRegion[start + k];
+			ocid = this->m_OuterRegion[start + k];
+			if ( icid != ocid && ( icid == roi || ocid == roi ) ) {
+				for( size_t c = 0; c < ncomps; c++ ) subset[ids.size() * ncomps + c] = samples[c * nsamples + k];
+				ids.push_back( k );
+			}
+		}
+
+		if ( ids.empty() )
+			continue;
+
+		this->m_Model->EvaluateBatch( &subset[0], ids.size(), roi, &energies[0] );
+		for( size_t j = 0; j < ids.size(); j++ ) {
+			if ( this->m_InnerRegion[start + ids[j]] == roi ) gin[ids[j]] = energies[j];
+			if ( this->m_OuterRegion[start + ids[j]] == roi ) gout[ids[j]] = energies[j];
+		}
 	}
 
-	return sample;
+	MeasureType grad;
+	for(size_t k = 0; k < nsamples; k++ ) {
+		pid = this->m_ValidVertices[start + k];
+		grad = gin[k] - gout[k];
+		grad = (fabs(grad)>MIN_GRADIENT)?grad:0.0;
+		dest[start + k] = grad * this->m_Areas[pid];
+	}
 }
 
 
@@ -347,75 +407,206 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 		return;
 	}
 
-	MeasureType norm;
-	ContinuousIndex point_idx;
-	size_t changed = 0;
-	size_t gpid = 0;
-	std::vector< size_t > invalid;
+	size_t nvertices = this->m_NumberOfVertices;
+	size_t ncontours = this->m_NumberOfContours;
+	itk::ThreadIdType nthreads = this->GetNumberOfThreads();
 
-	std::fill(this->m_OffMaskVertices.begin(), this->m_OffMaskVertices.end(), 0);
+	struct ParallelContourStruct str;
+	str.selfptr = this;
+	str.total = nvertices;
+	str.next = 0;
+	str.chunk = std::max< size_t >( 256, nvertices / ( 16 * nthreads ) );
+	str.changed.assign( nthreads, 0 );
+	str.invalid.assign( nthreads, 0 );
+	str.offmask.assign( nthreads * ncontours, 0 );
+	str.cmoved.assign( nthreads * ncontours, 0 );
+	str.moved.resize( nthreads );
+
+	this->GetMultiThreader()->SetNumberOfThreads( nthreads );
+	this->GetMultiThreader()->SetSingleMethod( this->ThreadedContourCallback, &str );
+	this->GetMultiThreader()->SingleMethodExecute();
 
-	for( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
-		typename VectorContourType::PointsContainerConstIterator p_it = this->m_Priors[contid]->GetPoints()->Begin();
-		typename VectorContourType::PointsContainerConstIterator p_end = this->m_Priors[contid]->GetPoints()->End();
-		PointsContainerPointer curPoints = this->m_CurrentContours[contid]->GetPoints();
-
-		VectorContourPointType ci, ci_prime;
-		VectorType disp;
-		size_t pid;
-
-		// For all the points in the mesh
-		while ( p_it != p_end ) {
-			ci = p_it.Value();
-			pid = p_it.Index();
-			disp = this->m_CurrentDisplacements->GetElement( gpid ); // Get the interpolated value of the field in the point
-			norm = disp.GetNorm();
-
-			if( norm > 1.0e-8 ) {
-				ci_prime = ci + disp; // Add displacement vector to the point
-				if( ! this->CheckExtent(ci_prime,point_idx) ) {
-					invalid.push_back( gpid );
-					this->InvokeEvent( WarningEvent() );
-				}
-				curPoints->SetElement( pid, ci_prime );
-				changed++;
-			}
+	// Reduce the per-thread counters
+	size_t changed = 0;
+	size_t invalid = 0;
+	std::vector< size_t > cmoved( ncontours, 0 );
+	std::fill(this->m_OffMaskVertices.begin(), this->m_OffMaskVertices.end(), 0);
+	for( itk::ThreadIdType t = 0; t < nthreads; t++ ) {
+		changed+= str.changed[t];
+		invalid+= str.invalid[t];
+		for( size_t c = 0; c < ncontours; c++ ) {
+			this->m_OffMaskVertices[c]+= str.offmask[t * ncontours + c];
+			cmoved[c]+= str.cmoved[t * ncontours + c];
+		}
+	}
 
-			if ( (1.0 - this->m_MaskInterp->Evaluate(ci_prime)) < 1.0e-5 ) {
-				this->m_OffMaskVertices[contid]++;
-			}
+	for( size_t c = 0; c < ncontours; c++ ) {
+		if ( cmoved[c] > 0 ) {
+			this->MarkDirtyTriangles( c, this->m_MovedVertices, this->m_PreviousPositions );
+			this->m_ContoursOutdated = true;
+		}
+	}
 
-			++p_it;
-			gpid++;
+	// Flags are kept across iterations, reset only those set in this update
+	for( itk::ThreadIdType t = 0; t < nthreads; t++ ) {
+		for( size_t k = 0; k < str.moved[t].size(); k++ ) {
+			this->m_MovedVertices[str.moved[t][k]] = 0;
 		}
 	}
 
-	if ( invalid.size() > 0 ) {
-		itkWarningMacro(<< "a total of " << invalid.size() << " mesh nodes were to be moved off the image domain." );
+	if ( invalid > 0 ) {
+		this->InvokeEvent( WarningEvent() );
+		itkWarningMacro(<< "a total of " << invalid << " mesh nodes were to be moved off the image domain." );
 	}
 
 	this->m_DisplacementsUpdated = true;
 	this->m_RegionsUpdated = (changed==0);
 	this->m_EnergyUpdated = (changed==0);
+	this->UpdateCurrentRegions();
+}
 
-	this->ComputeCurrentRegions();
+template< typename TReferenceImageType, typename TCoordRepType >
+ITK_THREAD_RETURN_TYPE
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::ThreadedContourCallback(void *arg) {
+	itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct *)( arg );
+	ParallelContourStruct* str = (ParallelContourStruct *)( info->UserData );
+
+	size_t nvertices = str->total;
+	size_t start;
+	while ( ( start = str->next.fetch_add( str->chunk ) ) < nvertices ) {
+		size_t stop = std::min( start + str->chunk, nvertices ) - 1;
+		str->selfptr->ThreadedContourUpdate( start, stop, info->ThreadID, *str );
+	}
+
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::ThreadedContourUpdate(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelContourStruct& str) {
+	size_t ncontours = this->m_NumberOfContours;
+	size_t* offmask = &str.offmask[threadId * ncontours];
+	size_t* cmoved = &str.cmoved[threadId * ncontours];
+	std::vector< size_t >& moved_ids = str.moved[threadId];
+	size_t changed = 0;
+	size_t invalid = 0;
+
+	const ProbabilityMapType* mask = this->m_BackgroundMask;
+	typename ProbabilityMapType::IndexType mask_idx;
+	PointType ci_prime, ci_old;
+	double idx;
+	double norm;
+	bool moved;
+	ROIPixelType contid;
+
+	for( size_t gpid = start; gpid <= stop; gpid++ ) {
+		contid = this->m_VertexContour[gpid];
+		norm = 0.0;
+		for( size_t i = 0; i < Dimension; i++ ) {
+			ci_prime[i] = this->m_CurrentPositions[i][gpid];
+			norm+= this->m_Displacements[i][gpid] * this->m_Displacements[i][gpid];
+		}
+
+		if( norm > 1.0e-16 ) {
+			ci_old = ci_prime;
+			for( size_t i = 0; i < Dimension; i++ ) {
+				ci_prime[i] = this->m_PriorPositions[i][gpid] + this->m_Displacements[i][gpid]; // Add displacement vector to the point
+			}
+
+			// Same test and clamping as CheckExtent, with the affine computed in Initialize
+			bool inside = true;
+			for( size_t r = 0; r < Dimension; r++ ) {
+				idx = 0.0;
+				for( size_t c = 0; c < Dimension; c++ ) {
+					idx+= this->m_PhysicalToIndex(r, c) * ( ci_prime[c] - this->m_FirstPixelCenter[c] );
+				}
+
+				if ( idx < 0.0 ) {
+					ci_prime[r] = this->m_FirstPixelCenter[r];
+					inside = false;
+				} else if ( idx > ( this->m_ReferenceSize[r] - 1 ) ) {
+					ci_prime[r] = this->m_LastPixelCenter[r];
+					inside = false;
+				}
+			}
+			if ( !inside ) {
+				invalid++;
+			}
+
+			moved = false;
+			for( size_t i = 0; i < Dimension; i++ ) {
+				if ( ci_prime[i] != ci_old[i] ) {
+					moved = true;
+					this->m_CurrentPositions[i][gpid] = ci_prime[i];
+				}
+			}
+
+			if ( moved ) {
+				this->m_MovedVertices[gpid] = 1;
+				this->m_PreviousPositions[gpid] = ci_old;
+				moved_ids.push_back( gpid );
+				cmoved[contid]++;
+			}
+			changed++;
+		}
+
+		// Nearest neighbor lookup in the mask
+		for( size_t r = 0; r < Dimension; r++ ) {
+			idx = 0.0;
+			for( size_t c = 0; c < Dimension; c++ ) {
+				idx+= this->m_MaskPhysicalToIndex(r, c) * ( ci_prime[c] - this->m_MaskOrigin[c] );
+			}
+			mask_idx[r] = static_cast< typename ProbabilityMapType::IndexValueType >( floor( idx + 0.5 ) );
+			if ( mask_idx[r] < 0 ) mask_idx[r] = 0;
+			if ( mask_idx[r] > long(this->m_MaskSize[r]) - 1 ) mask_idx[r] = this->m_MaskSize[r] - 1;
+		}
+
+		if ( (1.0 - mask->GetPixel( mask_idx )) < 1.0e-5 ) {
+			offmask[contid]++;
+		}
+	}
+
+	str.changed[threadId]+= changed;
+	str.invalid[threadId]+= invalid;
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
 typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureType
 FunctionalBase<TReferenceImageType, TCoordRepType>
 ::GetValue() {
-	if ( !this->m_EnergyUpdated ) {
-		this->m_EnergyCalculator->SetPriorsMap(this->m_CurrentMaps);
+	if ( this->m_EnergyUpdated ) {
+		return this->m_Value;
+	}
+
+	// The per-region sums are patched by PatchRegionsInBox, only
+	// a full pass is required after a descriptors update
+	if ( !this->m_EnergyCacheValid ) {
+		this->ConnectCurrentMaps(this->m_EnergyCalculator.GetPointer());
 		this->m_EnergyCalculator->Update();
-		this->m_RegionValue = this->m_EnergyCalculator->GetEnergies();
 
-		this->m_Value = 0.0;
-		for( size_t roi = 0; roi < this->m_RegionValue.Size(); roi++ ) {
-			this->m_Value+= this->m_RegionValue[roi];
+		const MeasureArray energies = this->m_EnergyCalculator->GetEnergies();
+		const typename EnergyFilter::TotalVolumeContainer volumes = this->m_EnergyCalculator->GetVolumes();
+		const typename EnergyModelType::MeasureTypeContainer offsets = this->m_Model->GetRegionOffsetContainer();
+
+		this->m_RegionEnergy.SetSize( energies.Size() );
+		this->m_RegionVolume.SetSize( energies.Size() );
+		for( size_t roi = 0; roi < energies.Size(); roi++ ) {
+			this->m_RegionVolume[roi] = volumes[roi];
+			this->m_RegionEnergy[roi] = energies[roi] - volumes[roi] * offsets[roi];
 		}
-		this->m_EnergyUpdated = true;
+		this->m_EnergyCacheValid = true;
+	}
+
+	const typename EnergyModelType::MeasureTypeContainer offsets = this->m_Model->GetRegionOffsetContainer();
+	this->m_RegionValue.SetSize( this->m_RegionEnergy.Size() );
+	this->m_Value = 0.0;
+	for( size_t roi = 0; roi < this->m_RegionEnergy.Size(); roi++ ) {
+		this->m_RegionValue[roi] = this->m_RegionEnergy[roi] + this->m_RegionVolume[roi] * offsets[roi];
+		this->m_Value+= this->m_RegionValue[roi];
 	}
+	this->m_EnergyUpdated = true;
 	return this->m_Value;
 }
 
@@ -444,51 +635,347 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 template< typename TReferenceImageType, typename TCoordRepType >
 void
 FunctionalBase<TReferenceImageType, TCoordRepType>
-::InitializeSamplingGrid() {
-	typename FieldType::SizeType exp_size;
+::ComputeCurrentRegions() {
+	this->SyncCurrentContours();
+
+	PartialVolumeFilterPointer pvf = PartialVolumeFilterType::New();
+	pvf->SetInputs( this->m_CurrentContours );
+	pvf->SetOutputReference( this->m_ReferenceImage );
+	pvf->SetSubsamplingFactor( this->m_SamplingFactor );
+	pvf->SetMaskImage( this->m_BackgroundMask );
+
+	// Once the model exists, energies (and the descriptor sums) are accumulated
+	// while the maps are computed, saving the full pass of m_EnergyCalculator
+	bool fused = this->m_Model.IsNotNull() && this->m_Model->GetRegionOffsetContainer().Size() > 0;
+	if ( fused ) {
+		pvf->SetReferenceImage( this->m_ReferenceImage );
+		pvf->SetModel( this->m_Model );
+		pvf->SetComputeDescriptorSums( this->m_IncrementalDescriptors > 0 && this->m_Model->HasDescriptorBounds() );
+	}
 
-	for (size_t i = 0; i<Dimension; i++ ){
-		exp_size[i] = (unsigned int) (this->m_ReferenceSize[i]*this->m_SamplingFactor);
+	// Sparse maps are filled row by row, the dense maps are never allocated
+	if ( this->m_UseSparseMaps ) {
+		if ( this->m_SparseMaps.IsNull() ) {
+			this->m_SparseMaps = SparsePriorsMapType::New();
+		}
+		pvf->SetSparseMap( this->m_SparseMaps );
+		pvf->WriteFractionsOff();
 	}
+	pvf->Update();
 
-	PointType firstPixelCenter;
-	VectorType step;
-	typename FieldType::SpacingType spacing;
+	// Keep the maps around, so that UpdateCurrentRegions can patch them in place
+	this->m_CurrentRegions = pvf->GetOutputSegmentation();
+	if ( this->m_UseSparseMaps ) {
+		this->m_CurrentMaps = NULL;
+	} else {
+		this->m_CurrentMaps = pvf->GetOutput();
+		this->m_CurrentMaps->DisconnectPipeline();
+	}
 
-	for (size_t i = 0; i<Dimension; i++ ){
-		step[i] = (this->m_End[i] - this->m_Origin[i]) / (1.0*exp_size[i]);
-		spacing[i]= fabs( step[i] );
-		firstPixelCenter[i] = this->m_Origin[i] + 0.5 * step[i];
+	size_t nblocks = 1;
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		this->m_DirtyBlocksSize[i] = (this->m_ReferenceSize[i] + this->m_DirtyBlockSize - 1) / this->m_DirtyBlockSize;
+		nblocks*= this->m_DirtyBlocksSize[i];
+	}
+	this->m_DirtyBlocks.assign( nblocks, false );
+
+	this->m_EnergyCacheValid = false;
+	if ( fused ) {
+		const MeasureArray energies = pvf->GetEnergies();
+		const typename PartialVolumeFilterType::TotalVolumeContainer volumes = pvf->GetVolumes();
+		const typename EnergyModelType::MeasureTypeContainer offsets = this->m_Model->GetRegionOffsetContainer();
+
+		this->m_RegionEnergy.SetSize( energies.Size() );
+		this->m_RegionVolume.SetSize( energies.Size() );
+		for( size_t roi = 0; roi < energies.Size(); roi++ ) {
+			this->m_RegionVolume[roi] = volumes[roi];
+			this->m_RegionEnergy[roi] = energies[roi] - volumes[roi] * offsets[roi];
+		}
+		this->m_EnergyCacheValid = true;
+	}
+
+	// Without sums of the new maps, the weight changes of this update are unknown to the model
+	if ( this->m_Model.IsNotNull() ) {
+		if ( pvf->GetDescriptorSums().size() > 0 ) {
+			this->m_Model->SetDescriptorSums( pvf->GetDescriptorSums() );
+		} else {
+			this->m_Model->InvalidateDescriptorSums();
+		}
 	}
 
-	this->m_ReferenceSamplingGrid = FieldType::New();
-	this->m_ReferenceSamplingGrid->SetOrigin( firstPixelCenter );
-	this->m_ReferenceSamplingGrid->SetDirection( this->m_Direction );
-	this->m_ReferenceSamplingGrid->SetRegions( exp_size );
-	this->m_ReferenceSamplingGrid->SetSpacing( spacing );
-	this->m_ReferenceSamplingGrid->Allocate();
+	this->m_RegionsUpdated = true;
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
 void
 FunctionalBase<TReferenceImageType, TCoordRepType>
-::ComputeCurrentRegions() {
-	BinarizeMeshFilterPointer newp = BinarizeMeshFilterType::New();
-	newp->SetInputs( this->m_CurrentContours );
-	newp->SetOutputReference( this->m_ReferenceSamplingGrid );
-	newp->Update();
-	this->m_CurrentRegions = newp->GetOutputSegmentation();
-
-	DownsamplePointer p = DownsampleFilter::New();
-	p->SetInput(newp->GetOutput());
-	p->SetOutputParametersFromImage( this->m_ReferenceImage );
-	p->SetMaskImage(m_BackgroundMask);
-	p->Update();
-
-	this->m_CurrentMaps = p->GetOutput();
+::UpdateCurrentRegions() {
+	if ( !this->m_UseIncrementalRegions || ( this->m_CurrentMaps.IsNull() && this->m_SparseMaps.IsNull() ) ) {
+		this->ComputeCurrentRegions();
+		return;
+	}
+
+	// Gather dirty blocks in boxes, merging consecutive blocks along the x axis
+	ReferenceRegionList boxes;
+	ReferenceIndexType start;
+	ReferenceSizeType size;
+	size_t nblocks = this->m_DirtyBlocks.size();
+	size_t rowlength = this->m_DirtyBlocksSize[0];
+	size_t bsize = this->m_DirtyBlockSize;
+	size_t ndirty = 0;
+
+	for ( size_t row = 0; row < nblocks; row+= rowlength ) {
+		size_t bx = 0;
+		while ( bx < rowlength ) {
+			if ( !this->m_DirtyBlocks[row + bx] ) {
+				bx++;
+				continue;
+			}
+
+			size_t first = bx;
+			while ( bx < rowlength && this->m_DirtyBlocks[row + bx] ) bx++;
+			ndirty+= bx - first;
+
+			start[0] = first * bsize;
+			size[0] = std::min< size_t >( bx * bsize, this->m_ReferenceSize[0] ) - start[0];
+
+			size_t rem = row / rowlength;
+			for ( size_t i = 1; i < Dimension; i++ ) {
+				size_t b = rem % this->m_DirtyBlocksSize[i];
+				rem/= this->m_DirtyBlocksSize[i];
+				start[i] = b * bsize;
+				size[i] = std::min< size_t >( (b + 1) * bsize, this->m_ReferenceSize[i] ) - start[i];
+			}
+			boxes.push_back( ReferenceRegionType( start, size ) );
+		}
+	}
+	std::fill( this->m_DirtyBlocks.begin(), this->m_DirtyBlocks.end(), false );
+
+	if ( boxes.size() == 0 ) {
+		this->m_RegionsUpdated = true;
+		return;
+	}
+
+	// Patching many scattered boxes is slower than starting over
+	if ( boxes.size() > MAX_DIRTY_BOXES || ndirty > 0.5 * nblocks ) {
+		this->ComputeCurrentRegions();
+		return;
+	}
+
+	// Rasterize all boxes in one run, within their bounding box
+	ReferenceIndexType lo = boxes[0].GetIndex();
+	ReferenceIndexType hi;
+	for ( size_t i = 0; i < Dimension; i++ ) hi[i] = 0;
+	for ( size_t b = 0; b < boxes.size(); b++ ) {
+		for ( size_t i = 0; i < Dimension; i++ ) {
+			lo[i] = std::min( lo[i], boxes[b].GetIndex()[i] );
+			hi[i] = std::max< long >( hi[i], boxes[b].GetIndex()[i] + boxes[b].GetSize()[i] );
+		}
+	}
+	for ( size_t i = 0; i < Dimension; i++ ) size[i] = hi[i] - lo[i];
+
+	this->SyncCurrentContours();
+
+	PartialVolumeFilterPointer pvf = PartialVolumeFilterType::New();
+	pvf->SetInputs( this->m_CurrentContours );
+	pvf->SetOutputReference( this->m_ReferenceImage );
+	pvf->SetIndex( lo );
+	pvf->SetSize( size );
+	pvf->SetRequestedRegions( boxes );
+	pvf->SetSubsamplingFactor( this->m_SamplingFactor );
+	pvf->SetMaskImage( this->m_BackgroundMask );
+	pvf->Update();
+
+	for ( size_t i = 0; i < boxes.size(); i++ ) {
+		this->PatchRegionsInBox( boxes[i], pvf->GetOutput(), pvf->GetOutputSegmentation() );
+	}
+
+	this->m_CurrentRegions->Modified();
+	if ( this->m_SparseMaps.IsNotNull() ) {
+		this->m_SparseMaps->Modified();
+	} else {
+		this->m_CurrentMaps->Modified();
+	}
 	this->m_RegionsUpdated = true;
 }
 
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::PatchRegionsInBox( const ReferenceRegionType& box, const PriorsImageType* maps, const ROIType* seg ) {
+	bool delta = this->m_EnergyCacheValid;
+	bool track = this->m_Model.IsNotNull() && this->m_Model->HasDescriptorSums();
+	MeasureType pixvol = 1.0;
+	for ( size_t i = 0; i < Dimension; i++ ) pixvol*= this->m_ReferenceSpacing[i];
+
+	// Sparse maps are patched row by row
+	if ( this->m_SparseMaps.IsNotNull() ) {
+		size_t ncomps = this->m_SparseMaps->GetNumberOfComponents();
+		size_t nx = box.GetSize()[0];
+		std::vector< PriorsValueType > w_old( nx * ncomps );
+
+		itk::ImageLinearConstIteratorWithIndex< ROIType > l_it( seg, box );
+		l_it.SetDirection( 0 );
+		for ( l_it.GoToBegin(); !l_it.IsAtEnd(); l_it.NextLine() ) {
+			ReferenceIndexType idx = l_it.GetIndex();
+			const PriorsValueType* w_new = maps->GetBufferPointer() + maps->ComputeOffset( idx ) * ncomps;
+			if ( delta || track ) {
+				this->m_SparseMaps->GetRow( idx, nx, &w_old[0] );
+				ReferenceIndexType pidx = idx;
+				for ( size_t i = 0; i < nx; i++ ) {
+					pidx[0] = idx[0] + i;
+					this->MoveVoxelWeights( pidx, &w_old[i * ncomps], w_new + i * ncomps, ncomps, pixvol, delta, track );
+				}
+			}
+			this->m_SparseMaps->SetRow( idx, nx, w_new );
+
+			const ROIPixelType* s_row = seg->GetBufferPointer() + seg->ComputeOffset( idx );
+			std::copy( s_row, s_row + nx, this->m_CurrentRegions->GetBufferPointer() + this->m_CurrentRegions->ComputeOffset( idx ) );
+		}
+		return;
+	}
+
+	itk::ImageRegionConstIterator< PriorsImageType > p_it( maps, box );
+	itk::ImageRegionIterator< PriorsImageType > m_it( this->m_CurrentMaps, box );
+	itk::ImageRegionConstIterator< ROIType > s_it( seg, box );
+	itk::ImageRegionIterator< ROIType > cs_it( this->m_CurrentRegions, box );
+	itk::ImageRegionConstIterator< ReferenceImageType > r_it( this->m_ReferenceImage, box );
+
+	size_t ncomps = this->m_CurrentMaps->GetNumberOfComponentsPerPixel();
+	PriorsPixelType w_old, w_new;
+	while( !p_it.IsAtEnd() ) {
+		if ( delta || track ) {
+			w_old = m_it.Get();
+			w_new = p_it.Get();
+			this->MoveVoxelWeights( r_it.GetIndex(), w_old.GetDataPointer(), w_new.GetDataPointer(), ncomps, pixvol, delta, track );
+			++r_it;
+		}
+
+		m_it.Set( p_it.Get() );
+		cs_it.Set( s_it.Get() );
+		++p_it;
+		++m_it;
+		++s_it;
+		++cs_it;
+	}
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::MoveVoxelWeights( const ReferenceIndexType& idx, const PriorsValueType* w_old, const PriorsValueType* w_new,
+		size_t ncomps, MeasureType pixvol, bool delta, bool track ) {
+	// Move the contribution of a voxel that changed membership in the energy
+	// sums, and in the descriptor sums of the model
+	MeasureType dvol;
+	for ( size_t roi = 0; roi < ncomps; roi++ ) {
+		dvol = ( ( w_new[roi] < 1.0e-8 )?0.0:w_new[roi] ) - ( ( w_old[roi] < 1.0e-8 )?0.0:w_old[roi] );
+		if ( dvol == 0.0 )
+			continue;
+
+		if ( track ) {
+			this->m_Model->UpdateSampleWeight( idx, roi, w_old[roi], w_new[roi] );
+		}
+
+		if ( delta ) {
+			dvol*= pixvol;
+			this->m_RegionVolume[roi]+= dvol;
+			this->m_RegionEnergy[roi]+= dvol * this->m_Model->EvaluateAtIndex( idx, roi );
+		}
+	}
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::MarkDirtyTriangles( size_t contid, const std::vector< unsigned char >& moved, const PointsVector& previous ) {
+	if ( this->m_DirtyBlocks.empty() ) {
+		return;
+	}
+
+	const VectorContourType* mesh = this->m_CurrentContours[contid];
+	typename VectorContourType::CellsContainerConstIterator c_it = mesh->GetCells()->Begin();
+	typename VectorContourType::CellsContainerConstIterator c_end = mesh->GetCells()->End();
+	typename CellType::PointIdConstIterator pit;
+
+	size_t offset = this->m_Offsets[contid];
+	ContinuousIndex idx;
+	PointType pos;
+	PointValueType lo[Dimension], hi[Dimension];
+	long first[Dimension], last[Dimension];
+	bool dirty;
+
+	while ( c_it != c_end ) {
+		const CellType* cell = c_it.Value();
+
+		dirty = false;
+		for ( pit = cell->PointIdsBegin(); pit != cell->PointIdsEnd(); ++pit ) {
+			if ( moved[offset + *pit] ) {
+				dirty = true;
+				break;
+			}
+		}
+
+		if ( !dirty ) {
+			++c_it;
+			continue;
+		}
+
+		// Bounding box of the old and new positions of the triangle, in reference grid coordinates
+		for ( size_t i = 0; i < Dimension; i++ ) {
+			lo[i] = itk::NumericTraits< PointValueType >::max();
+			hi[i] = itk::NumericTraits< PointValueType >::NonpositiveMin();
+		}
+
+		for ( pit = cell->PointIdsBegin(); pit != cell->PointIdsEnd(); ++pit ) {
+			for ( size_t k = 0; k < 2; k++ ) {
+				if ( k == 0 ) {
+					for ( size_t i = 0; i < Dimension; i++ ) pos[i] = this->m_CurrentPositions[i][offset + *pit];
+					this->m_ReferenceImage->TransformPhysicalPointToContinuousIndex( pos, idx );
+				} else if ( moved[offset + *pit] ) {
+					this->m_ReferenceImage->TransformPhysicalPointToContinuousIndex( previous[offset + *pit], idx );
+				} else {
+					break;
+				}
+
+				for ( size_t i = 0; i < Dimension; i++ ) {
+					if ( idx[i] < lo[i] ) lo[i] = idx[i];
+					if ( idx[i] > hi[i] ) hi[i] = idx[i];
+				}
+			}
+		}
+
+		// Reference voxels overlapped by the footprint
+		bool inside = true;
+		for ( size_t i = 0; i < Dimension; i++ ) {
+			first[i] = floor( lo[i] + 0.5 );
+			last[i] = floor( hi[i] + 0.5 );
+
+			if ( first[i] < 0 ) first[i] = 0;
+			if ( last[i] > long(this->m_ReferenceSize[i]) - 1 ) last[i] = this->m_ReferenceSize[i] - 1;
+			if ( last[i] < first[i] ) {
+				inside = false;
+				break;
+			}
+
+			first[i]/= this->m_DirtyBlockSize;
+			last[i]/= this->m_DirtyBlockSize;
+		}
+
+		if ( inside ) {
+			for ( long z = first[2]; z <= last[2]; z++ ) {
+				for ( long y = first[1]; y <= last[1]; y++ ) {
+					size_t row = ( z * this->m_DirtyBlocksSize[1] + y ) * this->m_DirtyBlocksSize[0];
+					for ( long x = first[0]; x <= last[0]; x++ ) {
+						this->m_DirtyBlocks[row + x] = true;
+					}
+				}
+			}
+		}
+		++c_it;
+	}
+}
+
 template< typename TReferenceImageType, typename TCoordRepType >
 const typename FunctionalBase<TReferenceImageType, TCoordRepType>::MeasureArray
 FunctionalBase<TReferenceImageType, TCoordRepType>
@@ -502,29 +989,25 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 		groundtruth.push_back(copy->GetOutput());
 	}
 
-	typedef MultilabelBinarizeMeshFilter< ScalarContourType > ScalarBinarizeMeshFilterType;
-	typename ScalarBinarizeMeshFilterType::Pointer newp = ScalarBinarizeMeshFilterType::New();
-	newp->SetInputs( groundtruth );
-	newp->SetOutputReference( this->m_ReferenceSamplingGrid );
-	newp->Update();
-
-	DownsamplePointer p = DownsampleFilter::New();
-	p->SetInput(newp->GetOutput());
-	p->SetOutputParametersFromImage( this->m_ReferenceImage );
-	p->SetMaskImage(m_BackgroundMask);
-	p->Update();
+	typedef MultilabelPartialVolumeMeshFilter< ScalarContourType, PriorsValueType > ScalarPartialVolumeFilterType;
+	typename ScalarPartialVolumeFilterType::Pointer pvf = ScalarPartialVolumeFilterType::New();
+	pvf->SetInputs( groundtruth );
+	pvf->SetOutputReference( this->m_ReferenceImage );
+	pvf->SetSubsamplingFactor( this->m_SamplingFactor );
+	pvf->SetMaskImage( this->m_BackgroundMask );
+	pvf->Update();
 
 	EnergyModelPointer m = EnergyModelType::New();
 	m->SetInput(this->m_ReferenceImage);
 	m->SetMask(this->m_BackgroundMask);
-	m->SetPriorsMap(p->GetOutput());
+	m->SetPriorsMap(pvf->GetOutput());
 	if(this->m_UseBackground)
 		m->SetNumberOfSpecialRegions(2);
 	m->Update();
 
 	EnergyFilterPointer calc = EnergyFilter::New();
 	calc->SetInput(this->m_ReferenceImage);
-	calc->SetPriorsMap(p->GetOutput());
+	calc->SetPriorsMap(pvf->GetOutput());
 	calc->SetMask(this->m_BackgroundMask);
 	calc->SetModel(m);
 	calc->Update();
@@ -546,24 +1029,53 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	this->m_OffMaskVertices.resize(this->m_NumberOfContours);
 	std::fill(this->m_OffMaskVertices.begin(), this->m_OffMaskVertices.end(), 0);
 
-	VectorType zerov; zerov.Fill(0.0);
-	this->m_CurrentDisplacements = PointDataContainer::New();
-	this->m_CurrentDisplacements->Reserve( this->m_NumberOfVertices );
+	size_t nvertices = this->m_NumberOfVertices;
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		this->m_PriorPositions[i].set_size( nvertices );
+		this->m_CurrentPositions[i].set_size( nvertices );
+		this->m_Displacements[i].set_size( nvertices );
+		this->m_Displacements[i].fill( 0.0 );
+		this->m_Normals[i].set_size( nvertices );
+		this->m_ShapeGradients[i].set_size( nvertices );
+		this->m_ShapeGradients[i].fill( 0.0 );
+	}
+	this->m_Areas.set_size( nvertices );
+	this->m_VertexContour.resize( nvertices );
+	this->m_MovedVertices.assign( nvertices, 0 );
+	this->m_PreviousPositions.resize( nvertices );
+
+	this->m_Topologies.resize(this->m_NumberOfContours);
+	for ( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
+		this->m_Topologies[contid] = TopologyType::New();
+		this->m_Topologies[contid]->SetInput(this->m_CurrentContours[contid]);
+
+		// Positions are kept in flat arrays indexed by global id
+		size_t offset = this->m_Offsets[contid];
+		PointsConstIterator c_it  = this->m_CurrentContours[contid]->GetPoints()->Begin();
+		PointsConstIterator c_end = this->m_CurrentContours[contid]->GetPoints()->End();
+		while( c_it != c_end ) {
+			size_t gpid = offset + c_it.Index();
+			for ( size_t i = 0; i < Dimension; i++ ) {
+				this->m_PriorPositions[i][gpid] = c_it.Value()[i];
+				this->m_CurrentPositions[i][gpid] = c_it.Value()[i];
+			}
+			this->m_VertexContour[gpid] = contid;
+			++c_it;
+		}
+	}
+	this->UpdateNormals();
+	this->m_ContoursOutdated = false;
 
 	if( this->m_NumberOfRegions > 3 ) {
-		// Set up ROI interpolator
-		typename ROIInterpolatorType::Pointer interp = ROIInterpolatorType::New();
-		interp->SetInputImage( this->m_CurrentRegions );
+		// Probe the labels at the points themselves, m_CurrentRegions only keeps
+		// the dominant region of each reference voxel and misses thin regions
+		ProbeRasterizerPointer probe = this->ComputeProbe();
+		ProbeBufferType buffer;
 
 		PointIdentifier tpid = 0;
 
 		// Set up outer regions
 		for ( size_t contid = 0; contid < this->m_NumberOfContours; contid ++) {
-			NormalFilterPointer nfilter = NormalFilterType::New();
-			nfilter->SetWeight(NormalFilterType::AREA);
-			nfilter->SetInput(this->m_CurrentContours[contid]);
-			nfilter->Update();
-			PointDataContainer* normals = nfilter->GetOutput()->GetPointData();
 			PointsConstIterator c_it  = this->m_CurrentContours[contid]->GetPoints()->Begin();
 			PointsConstIterator c_end = this->m_CurrentContours[contid]->GetPoints()->End();
 
@@ -578,19 +1090,18 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 				ci = c_it.Value();
 
 				this->m_Vertices.push_back( ci );
-				this->m_CurrentDisplacements->SetElement(tpid, zerov);
 
 				if ( (1.0 - this->m_MaskInterp->Evaluate(ci)) < 1.0e-5 ) {
 					this->m_OffMaskVertices[contid]++;
 				}
 
-				ni = normals->GetElement( pid );
-				ROIPixelType inner = interp->Evaluate( ci + ni );
-				ROIPixelType outer = interp->Evaluate( ci - ni );
+				for ( size_t i = 0; i < Dimension; i++ ) ni[i] = this->m_Normals[i][tpid];
+				ROIPixelType inner = this->ProbeLabel( probe, ci + ni, buffer );
+				ROIPixelType outer = this->ProbeLabel( probe, ci - ni, buffer );
 
 				if ((inner == contid)) {
 					while (outer==inner) {
-						outer = interp->Evaluate( ci - (ni * step * 0.1) );
+						outer = this->ProbeLabel( probe, ci - (ni * step * 0.1), buffer );
 						if (step == 9)
 							break;
 						step++;
@@ -616,6 +1127,84 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	std::cout << "Valid vertices: " << this->m_ValidVertices.size() << " of " << this->m_Vertices.size() << "." << std::endl;
 }
 
+template< typename TReferenceImageType, typename TCoordRepType >
+typename FunctionalBase<TReferenceImageType, TCoordRepType>::ProbeRasterizerPointer
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::ComputeProbe() {
+	// Only the triangles are bucketed on the reference grid, no label image is rasterized
+	typename ProbeRasterizerType::InputMeshList meshes( this->m_NumberOfContours );
+	for ( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
+		meshes[contid] = this->m_CurrentContours[contid];
+	}
+
+	ProbeRasterizerPointer probe = ProbeRasterizerType::New();
+	probe->InitializeProbe( meshes, this->m_ReferenceImage );
+	return probe;
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+typename FunctionalBase<TReferenceImageType, TCoordRepType>::ROIPixelType
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::ProbeLabel( const ProbeRasterizerType* probe, const PointType& p, ProbeBufferType& buffer ) const {
+	typename ProbeRasterizerType::PointType pp;
+	typename ProbeRasterizerType::ContinuousIndexType ci;
+	pp.CastFrom( p );
+	this->m_ReferenceImage->TransformPhysicalPointToContinuousIndex( pp, ci );
+	return static_cast< ROIPixelType >( probe->EvaluateLabel( ci, buffer ) );
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::UpdateNormals() {
+	for ( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
+		size_t offset = this->m_Offsets[contid];
+		TopologyType* topology = this->m_Topologies[contid];
+		topology->Compute( this->m_CurrentPositions[0].data_block() + offset,
+				           this->m_CurrentPositions[1].data_block() + offset,
+				           this->m_CurrentPositions[2].data_block() + offset );
+
+		size_t npoints = topology->GetNumberOfVertices();
+		double total = topology->GetTotalArea();
+		for ( size_t pid = 0; pid < npoints; pid++ ) {
+			const double* n = topology->GetVertexNormal( pid );
+			for ( size_t i = 0; i < Dimension; i++ ) {
+				this->m_Normals[i][offset + pid] = n[i];
+			}
+			this->m_Areas[offset + pid] = topology->GetVertexArea( pid ) / total;
+		}
+	}
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::SyncCurrentContours() {
+	if ( !this->m_ContoursOutdated ) {
+		return;
+	}
+
+	VectorContourPointType ci;
+	VectorType v;
+	for ( size_t contid = 0; contid < this->m_NumberOfContours; contid++ ) {
+		size_t offset = this->m_Offsets[contid];
+		PointsContainerPointer points = this->m_CurrentContours[contid]->GetPoints();
+		PointDataContainerPointer data = this->m_CurrentContours[contid]->GetPointData();
+		size_t npoints = points->Size();
+
+		for ( size_t pid = 0; pid < npoints; pid++ ) {
+			for ( size_t i = 0; i < Dimension; i++ ) {
+				ci[i] = this->m_CurrentPositions[i][offset + pid];
+				v[i] = this->m_ShapeGradients[i][offset + pid];
+			}
+			points->SetElement( pid, ci );
+			data->SetElement( pid, v );
+		}
+		this->m_CurrentContours[contid]->Modified();
+	}
+	this->m_ContoursOutdated = false;
+}
+
 template< typename TReferenceImageType, typename TCoordRepType >
 double
 FunctionalBase<TReferenceImageType, TCoordRepType>
@@ -655,7 +1244,11 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 			("smoothing", bpo::value< float > (), "apply isotropic smoothing filter on target image, with kernel sigma=S mm.")
 			("smooth-auto", bpo::bool_switch(), "apply isotropic smoothing filter on target image, with automatic computation of kernel sigma.")
 			("uniform-bg-membership", bpo::bool_switch(), "consider last ROI as background and do not compute descriptors.")
-			("decile-threshold,d", bpo::value< float > (), "set (decile) threshold to consider a computed gradient as outlier (ranges 0.0-0.5)");
+			("decile-threshold,d", bpo::value< float > (), "set (decile) threshold to consider a computed gradient as outlier (ranges 0.0-0.5)")
+			("energy-cache", bpo::bool_switch(), "precompute the energy of each voxel for each region when descriptors are updated. Off-grid energies are then interpolated from the cached voxel energies, instead of evaluated on the interpolated sample.")
+			("energy-cache-band", bpo::value< size_t > (), "only cache energies within this distance (voxels) of region boundaries (0 caches the whole image).")
+			("incremental-descriptors", bpo::value< size_t > (), "update descriptors from the voxels that changed region, with a full robust estimation every N updates (0 disables).")
+			("sparse-maps", bpo::bool_switch(), "store region maps as labels plus the fractions of boundary voxels, to save memory.");
 }
 
 template< typename TReferenceImageType, typename TCoordRepType >
@@ -687,6 +1280,26 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 		bpo::variable_value v = this->m_Settings["decile-threshold"];
 		this->SetDecileThreshold( v.as<float> () );
 	}
+
+	if( this->m_Settings.count( "energy-cache" ) ) {
+		bpo::variable_value v = this->m_Settings["energy-cache"];
+		this->SetUseEnergyCache( v.as<bool>() );
+	}
+
+	if( this->m_Settings.count( "energy-cache-band" ) ) {
+		bpo::variable_value v = this->m_Settings["energy-cache-band"];
+		this->SetEnergyCacheBand( v.as<size_t> () );
+	}
+
+	if( this->m_Settings.count( "incremental-descriptors" ) ) {
+		bpo::variable_value v = this->m_Settings["incremental-descriptors"];
+		this->SetIncrementalDescriptors( v.as<size_t> () );
+	}
+
+	if( this->m_Settings.count( "sparse-maps" ) ) {
+		bpo::variable_value v = this->m_Settings["sparse-maps"];
+		this->SetUseSparseMaps( v.as<bool>() );
+	}
 	this->Modified();
 }
 
@@ -703,23 +1316,20 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 		itkExceptionMacro( << "vals contains a wrong number of vectors");
 	}
 
-	VectorType new_ci, old_ci;
-	MeasureType norm;
+	MeasureType norm, diff;
 	size_t modified = 0;
 	for( size_t id = 0; id<npoints; id++ ) {
-		new_ci.Fill( 0.0 );
 		norm = 0.0;
-
 		for( size_t d = 0; d < Dimension; d++) {
-			new_ci[d] = vals[d][id];
+			diff = vals[d][id] - this->m_Displacements[d][id];
+			norm+= diff * diff;
 		}
 
-		old_ci = this->m_CurrentDisplacements->GetElement( id );
-		norm = (new_ci-old_ci).GetNorm();
-
-		if ( norm > 1.0e-8 ) {
+		if ( norm > 1.0e-16 ) {
 			modified++;
-			this->m_CurrentDisplacements->SetElement( id, new_ci );
+			for( size_t d = 0; d < Dimension; d++) {
+				this->m_Displacements[d][id] = vals[d][id];
+			}
 		}
 	}
 
@@ -747,6 +1357,17 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	orient->Update();
 
 	this->SetReferenceImage(orient->GetOutput());
+}
+
+template< typename TReferenceImageType, typename TCoordRepType >
+void
+FunctionalBase<TReferenceImageType, TCoordRepType>
+::SetReferenceImage ( const ReferenceImageType * _arg ) {
+	if ( this->m_ReferenceImage == _arg ) {
+		return;
+	}
+	this->m_ReferenceImage = _arg;
+	this->Modified();
 
 	// Cache image properties
 	this->m_FirstPixelCenter  = this->m_ReferenceImage->GetOrigin();
@@ -838,9 +1459,19 @@ FunctionalBase<TReferenceImageType, TCoordRepType>
 	if ( outer_roi == inner_roi ) {
 		return 0.0;
 	}
-	ReferencePixelType value = this->m_Interp->Evaluate( point );
-	MeasureType gin  = this->m_Model->Evaluate( value, inner_roi );
-	MeasureType gout = this->m_Model->Evaluate( value, outer_roi );
+	MeasureType gin, gout;
+	if ( this->m_Model->HasEnergyCache() ) {
+		ReferencePointType ref;
+		typename EnergyModelType::ContinuousIndexType idx;
+		ref.CastFrom( point );
+		this->m_ReferenceImage->TransformPhysicalPointToContinuousIndex( ref, idx );
+		gin  = this->m_Model->EvaluateAtContinuousIndex( idx, inner_roi );
+		gout = this->m_Model->EvaluateAtContinuousIndex( idx, outer_roi );
+	} else {
+		ReferencePixelType value = this->m_Interp->Evaluate( point );
+		gin  = this->m_Model->Evaluate( value, inner_roi );
+		gout = this->m_Model->Evaluate( value, outer_roi );
+	}
 
 	MeasureType grad = gin - gout;
 	grad = (fabs(grad)>MIN_GRADIENT)?grad:0.0;
@@ -44,6 +44,9 @@
 #define _MAHALANOBISDISTANCEMODEL_H_
 
 
+#include <vector>
+#include <atomic>
+#include <itkContinuousIndex.h>
 #include <itkImageToListSampleAdaptor.h>
 #include "ModelBase.h"
 #include "MahalanobisDistanceMembershipFunction.h"
@@ -116,9 +119,71 @@ public:
 
 	typedef std::vector< MeasurementVectorType >                               MeansContainer;
 	typedef std::vector< CovarianceMatrixType >                                CovariancesContainer;
+	typedef itk::ContinuousIndex< double, Dimension >                          ContinuousIndexType;
+
+	/** Neumaier compensated summation */
+	struct CompensatedSum {
+		double sum;
+		double c;
+		CompensatedSum(): sum(0.0), c(0.0) {}
+		inline void Add(double v) {
+			double t = sum + v;
+			c+= ( fabs(sum) >= fabs(v) )?( (sum - t) + v ):( (v - t) + sum );
+			sum = t;
+		}
+		inline double Get() const { return sum + c; }
+	};
+
+	typedef std::vector< CompensatedSum >                                     DescriptorSumsContainer;
 
 	itkGetConstMacro(RegionOffsetContainer, MeasureTypeContainer);
 
+	/** Precompute the energy of every voxel for every region after each estimation */
+	itkSetMacro(UseEnergyCache, bool);
+	itkGetConstMacro(UseEnergyCache, bool);
+	itkBooleanMacro(UseEnergyCache);
+
+	/** Only cache voxels within this distance (in voxels) of partial volume voxels, 0 caches the whole image */
+	itkSetMacro(EnergyCacheBand, size_t);
+	itkGetConstMacro(EnergyCacheBand, size_t);
+
+	/** Keep the weighted sums of the last robust estimation, so that the
+	 *  descriptors can be refreshed from the voxels that change weight */
+	itkSetMacro(UseDescriptorSums, bool);
+	itkGetConstMacro(UseDescriptorSums, bool);
+	itkBooleanMacro(UseDescriptorSums);
+
+	bool HasDescriptorSums() const { return !this->m_DescriptorSums.empty(); }
+	bool HasDescriptorBounds() const { return !this->m_DescriptorShift.empty(); }
+	void InvalidateDescriptorSums() { this->m_DescriptorSums.clear(); }
+
+	/** Move the sample at idx from weight w_old to w_new in region roi. Samples
+	 *  are selected as in the last robust estimation, outlier bounds included */
+	void UpdateSampleWeight(const IndexType& idx, const RegionIdentifier roi, double w_old, double w_new);
+
+	/** Recompute the descriptors from the patched sums, without re-estimating
+	 *  the outlier bounds */
+	void UpdateDescriptorsFromSums();
+
+	/** Number of weighted sums kept per region (W, W2, S1 and the lower triangle of S2) */
+	size_t GetNumberOfDescriptorSums() const {
+		size_t ncomps = this->m_DescriptorShift.size() / ( this->m_NumberOfRegions - this->m_NumberOfSpecialRegions );
+		return 2 + ncomps + ncomps * ( ncomps + 1 ) / 2;
+	}
+
+	/** Add the sample x with weight w in region roi to sums (the sums of that region), with
+	 *  the sample selection of the last robust estimation. Does nothing before one was run */
+	void AddSampleToSums(const PixelValueType* x, const RegionIdentifier roi, double w, CompensatedSum* sums) const;
+
+	/** Replace the sums, e.g. by those gathered while the regions were computed */
+	void SetDescriptorSums(const DescriptorSumsContainer& sums) { this->m_DescriptorSums = sums; }
+
+	/** Descriptors of the last estimation, one per region */
+	const MeansContainer& GetMeans() const { return this->m_Means; }
+	const CovariancesContainer& GetCovariances() const { return this->m_Covariances; }
+	const MeansContainer& GetRangeLower() const { return this->m_RangeLower; }
+	const MeansContainer& GetRangeUpper() const { return this->m_RangeUpper; }
+
 	std::string PrintFormattedDescriptors();
 	virtual void ReadDescriptorsFromFile(std::string filename);
 
@@ -128,6 +193,34 @@ public:
 		return this->m_Memberships[roi]->Evaluate(x);
 	}
 
+	virtual bool HasEnergyCache() const { return !this->m_CacheValues.empty(); }
+
+	/** Batch evaluation, one call to the membership function of roi for all the samples */
+	virtual void EvaluateBatch(const PixelValueType* samples, size_t nsamples, const RegionIdentifier roi, MeasureType* out) const;
+
+	/** Energy of the input voxel at idx, read from the cache when available */
+	virtual double EvaluateAtIndex(const IndexType & idx, const RegionIdentifier roi) const {
+		size_t off = this->GetInput()->ComputeOffset(idx);
+		if( this->m_CacheValues.empty() )
+			return this->Evaluate(this->GetInput()->GetPixel(idx), roi);
+		if( this->m_CacheRowRuns.empty() )
+			return this->m_CacheValues[off * this->m_NumberOfRegions + roi];
+
+		size_t row = off / this->m_CacheRowLength;
+		for( size_t r = this->m_CacheRowRuns[row]; r < this->m_CacheRowRuns[row + 1]; r++ ) {
+			const CacheRun& run = this->m_CacheRuns[r];
+			if( off < run.first )
+				break;
+			if( off < run.first + run.length )
+				return this->m_CacheValues[( run.slot + off - run.first ) * this->m_NumberOfRegions + roi];
+		}
+		return this->Evaluate(this->GetInput()->GetPixel(idx), roi);
+	}
+
+	/** Linear interpolation of the energies of the neighboring voxels (cached
+	 *  when available), not the energy of the interpolated sample */
+	double EvaluateAtContinuousIndex(const ContinuousIndexType & cidx, const RegionIdentifier roi) const;
+
 protected:
 	MahalanobisDistanceModel();
 	virtual ~MahalanobisDistanceModel() {}
@@ -150,6 +243,48 @@ private:
 
 	void Estimate();
 	void EstimateRobust();
+	void ComputeEnergyCache();
+
+	/** Shared state of the sweeps of EstimateRobust. Each pass walks the
+	 *  image once for all the regions; threads write to their own slice of
+	 *  the accumulators, which are reduced after the pass. */
+	struct ParallelEstimateStruct {
+		Self* selfptr;
+		size_t total;
+		size_t chunk;
+		std::atomic< size_t > next;
+		unsigned int pass;                       // 0: range, 1: histograms, 2: moments
+		const PixelValueType* input;
+		size_t ncomps;
+		size_t offset;                           // components of the priors map, read with GetPriors
+		size_t nregions;
+		std::vector< double > lower, upper;      // per thread and component
+		std::vector< double > origin, scale;     // histogram bins, per component
+		std::vector< size_t > histograms;        // per thread, region, component and bin
+		std::vector< double > bottom, top, shift;// per region and component
+		std::vector< CompensatedSum > moments;   // per thread and region: W, W2, S1 (ncomps), S2 (lower triangle)
+	};
+
+	/** Shared state of ComputeEnergyCache, with the chunks of EstimateRobust */
+	struct ParallelCacheStruct {
+		Self* selfptr;
+		size_t total;
+		size_t chunk;
+		std::atomic< size_t > next;
+		unsigned int pass;                       // 0: seed the band (rows), 1: evaluate (runs)
+		size_t rowlength;
+		std::vector< char >* band;
+		std::vector< std::vector< MeasureType > > energies;   // per thread
+	};
+
+	static ITK_THREAD_RETURN_TYPE ThreadedCacheCallback(void *arg);
+	void ThreadedCache(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelCacheStruct& str);
+
+	static ITK_THREAD_RETURN_TYPE ThreadedEstimateCallback(void *arg);
+	void ThreadedEstimate(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelEstimateStruct& str);
+	static double HistogramQuantile(const size_t* hist, double q, double origin, double width);
+
+	void ComputeDescriptorsFromSums(size_t roi);
 
 	MahalanobisDistanceModel(const Self &);   //purposely not implemented
 	void operator=(const Self &);             //purposely not implemented
@@ -160,6 +295,26 @@ private:
 	CovariancesContainer  m_Covariances;
 	MeasureTypeContainer  m_RegionOffsetContainer;
 	MeasurementVectorType m_InvalidValue;
+
+	bool                  m_UseEnergyCache;
+	size_t                m_EnergyCacheBand;
+	/** Run of consecutive cached voxels along x */
+	struct CacheRun {
+		size_t first;                        // offset of the first voxel
+		unsigned int length;
+		unsigned int slot;                   // row of the first voxel in m_CacheValues
+	};
+
+	std::vector< CacheRun >     m_CacheRuns;     // sorted by first, one per image row when caching the whole image
+	std::vector< unsigned int > m_CacheRowRuns;  // runs of row r are [m_CacheRowRuns[r], m_CacheRowRuns[r+1]). Empty when caching the whole image
+	size_t                      m_CacheRowLength;
+	std::vector< float >        m_CacheValues;   // m_NumberOfRegions energies per cached voxel
+
+	bool                          m_UseDescriptorSums;
+	DescriptorSumsContainer       m_DescriptorSums;    // per region: W, W2, S1, S2 as in ParallelEstimateStruct
+	std::vector< double >         m_DescriptorShift;   // per region and component, median
+	std::vector< double >         m_DescriptorBottom;  // per region and component, outlier bounds
+	std::vector< double >         m_DescriptorTop;
 };
 }
 
@@ -59,11 +59,20 @@
 #include <jsoncpp/json/json.h>
 
 #include <itkNumericTraitsVariableLengthVectorPixel.h>
+#include <boost/math/special_functions/digamma.hpp>
+
+#define ESTIMATE_HISTOGRAM_BINS 2048
+#define ESTIMATE_ROBUST_WEIGHT 0.9
+#define ESTIMATE_MIN_WEIGHT 1.0e-8
 
 namespace rstk {
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
 MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
-::MahalanobisDistanceModel(): Superclass() {}
+::MahalanobisDistanceModel(): Superclass(),
+ m_UseEnergyCache(false),
+ m_EnergyCacheBand(0),
+ m_CacheRowLength(0),
+ m_UseDescriptorSums(false) {}
 
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
 void
@@ -76,7 +85,7 @@ template< typename TInputVectorImage, typename TPriorsPrecisionType >
 void
 MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 ::InitializeMemberships() {
-	this->m_NumberOfRegions = this->GetPriorsMap()->GetNumberOfComponentsPerPixel();
+	this->m_NumberOfRegions = this->GetNumberOfPriors();
 
 	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
 	this->m_Memberships.resize(this->m_NumberOfRegions);
@@ -112,6 +121,235 @@ MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 	for( size_t i = 0; i < ncomps; i++ ) {
 		m_InvalidValue = 0.0;
 	}
+
+	this->ComputeEnergyCache();
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ComputeEnergyCache() {
+	this->m_CacheRuns.clear();
+	this->m_CacheRowRuns.clear();
+	this->m_CacheValues.clear();
+
+	const InputImageType* input = this->GetInput();
+	if( !this->m_UseEnergyCache || input == NULL ) {
+		return;
+	}
+
+	RegionType region = input->GetLargestPossibleRegion();
+	SizeType size = region.GetSize();
+	size_t npix = region.GetNumberOfPixels();
+	size_t nrows = npix / size[0];
+	itk::ThreadIdType nthreads = this->GetNumberOfThreads();
+
+	ParallelCacheStruct str;
+	str.selfptr = this;
+	str.rowlength = size[0];
+	str.energies.resize( nthreads );
+
+	this->GetMultiThreader()->SetNumberOfThreads( nthreads );
+	this->GetMultiThreader()->SetSingleMethod( this->ThreadedCacheCallback, &str );
+	this->m_CacheRowLength = size[0];
+
+	CacheRun run;
+	size_t nslots = 0;
+	if( this->m_EnergyCacheBand > 0 ) {
+		// Seed the band with the partial volume voxels, row by row
+		std::vector< char > band( npix, 0 );
+		str.band = &band;
+		str.pass = 0;
+		str.total = nrows;
+		str.chunk = std::max< size_t >( 1, nrows / ( 16 * nthreads ) );
+		str.next = 0;
+		this->GetMultiThreader()->SingleMethodExecute();
+
+		// Dilate it along each axis, forward and backward
+		long w = this->m_EnergyCacheBand;
+		size_t stride = 1;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			long len = size[d];
+			for( size_t first = 0; first < npix; first++ ) {
+				if( (first / stride) % len != 0 )
+					continue;
+
+				long dist = w + 1;
+				for( long k = 0; k < len; k++ ) {
+					char& v = band[first + k * stride];
+					if( v == 1 ) dist = 0;
+					else if( ++dist <= w ) v = 2;
+				}
+				dist = w + 1;
+				for( long k = len - 1; k >= 0; k-- ) {
+					char& v = band[first + k * stride];
+					if( v == 1 ) dist = 0;
+					else if( ++dist <= w ) v = 2;
+				}
+				for( long k = 0; k < len; k++ ) {
+					if( band[first + k * stride] == 2 ) band[first + k * stride] = 1;
+				}
+			}
+			stride*= len;
+		}
+
+		// Index the runs of cached voxels of each row
+		this->m_CacheRowRuns.resize( nrows + 1 );
+		for( size_t row = 0; row < nrows; row++ ) {
+			this->m_CacheRowRuns[row] = this->m_CacheRuns.size();
+			size_t i = row * size[0];
+			size_t end = i + size[0];
+			while( i < end ) {
+				if( !band[i] ) {
+					i++;
+					continue;
+				}
+				run.first = i;
+				run.slot = nslots;
+				while( i < end && band[i] ) i++;
+				run.length = i - run.first;
+				nslots+= run.length;
+				this->m_CacheRuns.push_back( run );
+			}
+		}
+		this->m_CacheRowRuns[nrows] = this->m_CacheRuns.size();
+	} else {
+		// One run per row, slots are the voxel offsets
+		this->m_CacheRuns.resize( nrows );
+		for( size_t row = 0; row < nrows; row++ ) {
+			run.first = row * size[0];
+			run.length = size[0];
+			run.slot = run.first;
+			this->m_CacheRuns[row] = run;
+		}
+		nslots = npix;
+	}
+
+	this->m_CacheValues.resize( nslots * this->m_NumberOfRegions );
+
+	// Evaluate the runs in batches
+	str.pass = 1;
+	str.total = this->m_CacheRuns.size();
+	str.chunk = std::max< size_t >( 1, str.total / ( 16 * nthreads ) );
+	str.next = 0;
+	this->GetMultiThreader()->SingleMethodExecute();
+
+	// Full image caches need no index
+	if( this->m_EnergyCacheBand == 0 ) {
+		this->m_CacheRuns.clear();
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+ITK_THREAD_RETURN_TYPE
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ThreadedCacheCallback(void *arg) {
+	itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct *)( arg );
+	ParallelCacheStruct* str = (ParallelCacheStruct *)( info->UserData );
+
+	size_t start;
+	while ( ( start = str->next.fetch_add( str->chunk ) ) < str->total ) {
+		size_t stop = std::min( start + str->chunk, str->total ) - 1;
+		str->selfptr->ThreadedCache( start, stop, info->ThreadID, *str );
+	}
+
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ThreadedCache(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelCacheStruct& str) {
+	if( str.pass == 0 ) {
+		// Partial volume voxels of rows start..stop
+		size_t pcomps = this->GetNumberOfPriors();
+		size_t nx = str.rowlength;
+		std::vector< PriorsPrecisionType > pbuffer;
+		const PriorsPrecisionType* p = this->GetPriors( start * nx, ( stop - start + 1 ) * nx, pbuffer );
+		char* band = &( *str.band )[start * nx];
+		for( size_t i = 0; i < ( stop - start + 1 ) * nx; i++ ) {
+			PriorsPrecisionType wmax = 0.0;
+			for( size_t roi = 0; roi < pcomps; roi++ ) {
+				if( p[i * pcomps + roi] > wmax ) wmax = p[i * pcomps + roi];
+			}
+			band[i] = ( wmax < 1.0 - 1.0e-5 )?1:0;
+		}
+		return;
+	}
+
+	const PixelValueType* buffer = this->GetInput()->GetBufferPointer();
+	size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+	size_t nregions = this->m_NumberOfRegions;
+	std::vector< MeasureType >& energies = str.energies[threadId];
+
+	for( size_t r = start; r <= stop; r++ ) {
+		const CacheRun& run = this->m_CacheRuns[r];
+		energies.resize( run.length );
+		float* values = &this->m_CacheValues[size_t( run.slot ) * nregions];
+		for( size_t roi = 0; roi < nregions; roi++ ) {
+			this->EvaluateBatch( buffer + run.first * ncomps, run.length, roi, &energies[0] );
+			for( size_t k = 0; k < run.length; k++ ) {
+				values[k * nregions + roi] = energies[k];
+			}
+		}
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::EvaluateBatch(const PixelValueType* samples, size_t nsamples, const RegionIdentifier roi, MeasureType* out) const {
+	const InternalFunctionType* mf = dynamic_cast< const InternalFunctionType* >( this->m_Memberships[roi].GetPointer() );
+	if( mf != NULL ) {
+		mf->EvaluateBatch( samples, nsamples, out );
+	} else {
+		// Special regions have a constant energy
+		double value = this->m_Memberships[roi]->Evaluate( this->m_InvalidValue );
+		std::fill( out, out + nsamples, value );
+	}
+
+	// Pixels with no data have no energy, as in Evaluate
+	size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+	for( size_t s = 0; s < nsamples; s++ ) {
+		const PixelValueType* x = samples + s * ncomps;
+		bool invalid = true;
+		for( size_t c = 0; c < ncomps && invalid; c++ ) {
+			invalid = ( x[c] == 0 );
+		}
+		if( invalid ) out[s] = 0.0;
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+double
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::EvaluateAtContinuousIndex(const ContinuousIndexType & cidx, const RegionIdentifier roi) const {
+	RegionType region = this->GetInput()->GetLargestPossibleRegion();
+	IndexType base, idx;
+	double frac[Dimension];
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		double c = cidx[d];
+		double last = region.GetIndex()[d] + region.GetSize()[d] - 1;
+		if( c < region.GetIndex()[d] ) c = region.GetIndex()[d];
+		if( c > last ) c = last;
+		base[d] = floor(c);
+		frac[d] = c - base[d];
+	}
+
+	double value = 0.0;
+	for( size_t corner = 0; corner < (1u << Dimension); corner++ ) {
+		double w = 1.0;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			bool upper = (corner >> d) & 1;
+			idx[d] = base[d] + (upper?1:0);
+			w*= upper?frac[d]:(1.0 - frac[d]);
+		}
+		if( w < 1.0e-8 )
+			continue;
+		value+= w * this->EvaluateAtIndex(idx, roi);
+	}
+	return value;
 }
 
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
@@ -132,8 +370,9 @@ MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 	size_t npix = sample->Size();
 	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
 
-	const PriorsPrecisionType* priors = this->GetPriorsMap()->GetBufferPointer();
-	size_t offset = this->GetPriorsMap()->GetNumberOfComponentsPerPixel();
+	size_t offset = this->GetNumberOfPriors();
+	std::vector< PriorsPrecisionType > pbuffer;
+	const PriorsPrecisionType* priors = this->GetPriors( 0, npix, pbuffer );
 
 	std::vector<WeightArrayType> weights;
 	for( size_t roi = 0; roi < nregions; roi++ ) {
@@ -174,72 +413,391 @@ template< typename TInputVectorImage, typename TPriorsPrecisionType >
 void
 MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
 ::EstimateRobust() {
-	size_t npix = this->GetInput()->GetLargestPossibleRegion().GetNumberOfPixels();
+	// Same estimator as WeightedCovarianceSampleFilter: samples out of the
+	// 2-98 percentiles of voxels with weight >= 0.9 are rejected, then the
+	// weighted mean and (bias corrected) covariance are computed. Here, all
+	// the regions are estimated together: a first sweep finds the range of
+	// each component, a second one fills fixed-size histograms to locate
+	// the percentiles and a third one accumulates the weighted moments.
+	size_t nbins = ESTIMATE_HISTOGRAM_BINS;
+	itk::ThreadIdType nthreads = this->GetNumberOfThreads();
+
+	ParallelEstimateStruct str;
+	str.selfptr = this;
+	str.total = this->GetInput()->GetLargestPossibleRegion().GetNumberOfPixels();
+	str.chunk = std::max< size_t >( 4096, str.total / ( 16 * nthreads ) );
+	str.input = this->GetInput()->GetBufferPointer();
+	str.ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+	str.offset = this->GetNumberOfPriors();
+	str.nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+
+	size_t ncomps = str.ncomps;
+	size_t nregions = str.nregions;
+	size_t nsums = 2 + ncomps + ncomps * ( ncomps + 1 ) / 2;
+
+	str.lower.resize( nthreads * ncomps, itk::NumericTraits< double >::max() );
+	str.upper.resize( nthreads * ncomps, itk::NumericTraits< double >::NonpositiveMin() );
+	str.histograms.resize( nthreads * nregions * ncomps * nbins, 0 );
+	str.moments.resize( nthreads * nregions * nsums );
+
+	this->GetMultiThreader()->SetNumberOfThreads( nthreads );
+	this->GetMultiThreader()->SetSingleMethod( this->ThreadedEstimateCallback, &str );
+
+	for( str.pass = 0; str.pass < 3; str.pass++ ) {
+		str.next = 0;
+		this->GetMultiThreader()->SingleMethodExecute();
+
+		if( str.pass == 0 ) {
+			// Bins of the histograms span the range of each component
+			str.origin.resize( ncomps );
+			str.scale.resize( ncomps );
+			for( size_t c = 0; c < ncomps; c++ ) {
+				double lo = itk::NumericTraits< double >::max();
+				double hi = itk::NumericTraits< double >::NonpositiveMin();
+				for( size_t t = 0; t < nthreads; t++ ) {
+					lo = std::min( lo, str.lower[t * ncomps + c] );
+					hi = std::max( hi, str.upper[t * ncomps + c] );
+				}
+				if( hi < lo ) hi = lo = 0.0;
+				str.origin[c] = lo;
+				str.scale[c] = ( hi > lo )?( nbins / ( hi - lo ) ):0.0;
+			}
+		} else if ( str.pass == 1 ) {
+			// Percentiles of each region
+			str.bottom.resize( nregions * ncomps );
+			str.top.resize( nregions * ncomps );
+			str.shift.resize( nregions * ncomps );
+			std::vector< size_t > hist( nbins );
+			for( size_t roi = 0; roi < nregions; roi++ ) {
+				for( size_t c = 0; c < ncomps; c++ ) {
+					std::fill( hist.begin(), hist.end(), 0 );
+					for( size_t t = 0; t < nthreads; t++ ) {
+						const size_t* th = &str.histograms[( ( t * nregions + roi ) * ncomps + c ) * nbins];
+						for( size_t b = 0; b < nbins; b++ ) hist[b]+= th[b];
+					}
+
+					double width = ( str.scale[c] > 0.0 )?( 1.0 / str.scale[c] ):0.0;
+					size_t k = roi * ncomps + c;
+					str.bottom[k] = HistogramQuantile( &hist[0], 0.02, str.origin[c], width );
+					str.top[k] = HistogramQuantile( &hist[0], 0.98, str.origin[c], width );
+					str.shift[k] = HistogramQuantile( &hist[0], 0.50, str.origin[c], width );
+				}
+			}
+		}
+	}
+
+	// Reduce the moments of all threads, and keep them together with the
+	// rejection bounds so that UpdateSampleWeight can patch them
+	this->m_DescriptorSums.assign( nregions * nsums, CompensatedSum() );
+	for( size_t t = 0; t < nthreads; t++ ) {
+		for( size_t k = 0; k < nregions * nsums; k++ ) {
+			const CompensatedSum& ts = str.moments[t * nregions * nsums + k];
+			this->m_DescriptorSums[k].Add( ts.sum );
+			this->m_DescriptorSums[k].Add( ts.c );
+		}
+	}
+	this->m_DescriptorShift = str.shift;
+	this->m_DescriptorBottom = str.bottom;
+	this->m_DescriptorTop = str.top;
+
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		this->ComputeDescriptorsFromSums( roi );
+	}
+
+	if( !this->m_UseDescriptorSums ) {
+		this->InvalidateDescriptorSums();
+	}
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ComputeDescriptorsFromSums( size_t roi ) {
 	size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+	size_t nsums = 2 + ncomps + ncomps * ( ncomps + 1 ) / 2;
+	const CompensatedSum* sums = &this->m_DescriptorSums[roi * nsums];
+
+	double totalWeight = sums[0].Get();
+	double totalSquaredWeight = sums[1].Get();
+	if( totalWeight <= 0.0 ) {
+		itkExceptionMacro( << "No samples left to estimate region " << roi );
+	}
+
+	// Moments were accumulated about the median, to avoid cancellation
+	MeasurementVectorType mean;
+	itk::NumericTraits< MeasurementVectorType >::SetLength( mean, ncomps );
+	std::vector< double > d( ncomps );
+	for( size_t c = 0; c < ncomps; c++ ) {
+		d[c] = sums[2 + c].Get() / totalWeight;
+		mean[c] = this->m_DescriptorShift[roi * ncomps + c] + d[c];
+	}
+
+	CovarianceMatrixType cov( ncomps, ncomps );
+	size_t k = 2 + ncomps;
+	for( size_t r = 0; r < ncomps; r++ ) {
+		for( size_t c = 0; c <= r; c++ ) {
+			cov( r, c ) = sums[k++].Get() - totalWeight * d[r] * d[c];
+			cov( c, r ) = cov( r, c );
+		}
+	}
+
+	const double normalizationFactor = ( totalWeight - ( totalSquaredWeight / totalWeight ) );
+	if( normalizationFactor > vnl_math::eps ) {
+		cov *= 1.0 / normalizationFactor;
+	} else {
+		itkExceptionMacro( << "Normalization factor was too close to zero. Value = " << normalizationFactor );
+	}
+
+	// Bias estimation
+	// See http://en.wikipedia.org/wiki/Estimation_of_covariance_matrices#Bias_of_the_sample_covariance_matrix
+	float p = ncomps;
+	float n = totalWeight;
+	float beta = (1/p) * (p * log(n) + p - boost::math::digamma(n-p+1) + (n - p + 1) * boost::math::digamma(n - p + 2) + boost::math::digamma(n+1) - (n+1)* boost::math::digamma(n+2));
+	cov+= cov * exp( -beta );
+
+	MeasurementVectorType lower, upper;
+	itk::NumericTraits< MeasurementVectorType >::SetLength( lower, ncomps );
+	itk::NumericTraits< MeasurementVectorType >::SetLength( upper, ncomps );
+	for( size_t c = 0; c < ncomps; c++ ) {
+		lower[c] = this->m_DescriptorBottom[roi * ncomps + c];
+		upper[c] = this->m_DescriptorTop[roi * ncomps + c];
+	}
+
+	InternalFunctionPointer mf = InternalFunctionType::New();
+	mf->SetMean( mean );
+	mf->SetCovariance( cov );
+
+	this->m_RangeLower[roi] = lower;
+	this->m_RangeUpper[roi] = upper;
+	mf->SetRange(this->m_RangeLower[roi], this->m_RangeUpper[roi]);
+
+	mf->Initialize();
 
-	size_t offset = this->GetPriorsMap()->GetNumberOfComponentsPerPixel();
+	this->m_Memberships[roi] = mf;
+	this->m_RegionOffsetContainer[roi] = mf->GetOffsetTerm();
+
+	double maxv = mf->GetMaximumValue() * 1.0e3;
+	if( maxv > this->m_MaxEnergy ) {
+		this->m_MaxEnergy = maxv;
+	}
+	this->m_Means[roi] = mean;
+	this->m_Covariances[roi] = cov;
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::UpdateSampleWeight( const IndexType& idx, const RegionIdentifier roi, double w_old, double w_new ) {
+	size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
 	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+	if( roi >= nregions || this->m_DescriptorSums.empty() ) {
+		return;
+	}
 
-	const PriorsPrecisionType* priors = this->GetPriorsMap()->GetBufferPointer();
-	const PixelValueType * input = this->GetInput()->GetBufferPointer();
+	// Same sample selection as EstimateRobust
+	const PixelValueType* x = this->GetInput()->GetBufferPointer() + this->GetInput()->ComputeOffset( idx ) * ncomps;
+	if( x[0] == 0 && ( ncomps == 1 || x[1] == 0 ) ) {
+		return;
+	}
 
+	const double* bottom = &this->m_DescriptorBottom[roi * ncomps];
+	const double* top = &this->m_DescriptorTop[roi * ncomps];
+	for( size_t c = 0; c < ncomps; c++ ) {
+		if( x[c] > top[c] || x[c] < bottom[c] ) return;
+	}
 
-	std::vector<WeightArrayType> weights;
-	for( size_t roi = 0; roi < nregions; roi++ ) {
-		WeightArrayType warr;
-		warr.SetSize(npix);
-		warr.Fill(0.0);
-		weights.push_back(warr);
+	w_old = ( w_old < ESTIMATE_MIN_WEIGHT )?0.0:w_old;
+	w_new = ( w_new < ESTIMATE_MIN_WEIGHT )?0.0:w_new;
+	double dw = w_new - w_old;
+	if( dw == 0.0 ) {
+		return;
 	}
 
-	PriorsPrecisionType w;
-	for( size_t i = 0; i < npix; i++ ) {
-		if( *(input + i * ncomps) == 0 && *(input + i * ncomps + 1) == 0) {
-			continue;
+	size_t nsums = 2 + ncomps + ncomps * ( ncomps + 1 ) / 2;
+	const double* shift = &this->m_DescriptorShift[roi * ncomps];
+	CompensatedSum* s = &this->m_DescriptorSums[roi * nsums];
+	s[0].Add( dw );
+	s[1].Add( w_new * w_new - w_old * w_old );
+	for( size_t c = 0; c < ncomps; c++ ) {
+		s[2 + c].Add( dw * ( x[c] - shift[c] ) );
+	}
+	size_t k = 2 + ncomps;
+	for( size_t r = 0; r < ncomps; r++ ) {
+		for( size_t c = 0; c <= r; c++ ) {
+			s[k++].Add( dw * ( x[r] - shift[r] ) * ( x[c] - shift[c] ) );
 		}
+	}
+}
 
-		for( size_t roi = 0; roi < nregions; roi++ ) {
-			w = *(priors + offset * i + roi);
-			weights[roi][i] = w;
-		}
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::AddSampleToSums( const PixelValueType* x, const RegionIdentifier roi, double w, CompensatedSum* sums ) const {
+	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+	if( roi >= nregions || w < ESTIMATE_MIN_WEIGHT || this->m_DescriptorShift.empty() ) {
+		return;
 	}
 
-	ReferenceSamplePointer sample = ReferenceSampleType::New();
-	sample->SetImage( this->GetInput() );
-	for( size_t roi = 0; roi < nregions; roi++ ) {
-		InternalFunctionPointer mf = InternalFunctionType::New();
+	size_t ncomps = this->m_DescriptorShift.size() / nregions;
+	if( x[0] == 0 && ( ncomps == 1 || x[1] == 0 ) ) {
+		return;
+	}
 
-		CovarianceFilterPointer covFilter = CovarianceFilter::New();
-		covFilter->SetInput( sample );
-		covFilter->SetWeights( weights[roi] );
-		covFilter->Update();
+	const double* bottom = &this->m_DescriptorBottom[roi * ncomps];
+	const double* top = &this->m_DescriptorTop[roi * ncomps];
+	for( size_t c = 0; c < ncomps; c++ ) {
+		if( x[c] > top[c] || x[c] < bottom[c] ) return;
+	}
 
-		MeasurementVectorType mean = covFilter->GetMean();
-		mf->SetMean(mean);
+	const double* shift = &this->m_DescriptorShift[roi * ncomps];
+	sums[0].Add( w );
+	sums[1].Add( w * w );
+	for( size_t c = 0; c < ncomps; c++ ) {
+		sums[2 + c].Add( w * ( x[c] - shift[c] ) );
+	}
+	size_t k = 2 + ncomps;
+	for( size_t r = 0; r < ncomps; r++ ) {
+		for( size_t c = 0; c <= r; c++ ) {
+			sums[k++].Add( w * ( x[r] - shift[r] ) * ( x[c] - shift[c] ) );
+		}
+	}
+}
 
-		CovarianceMatrixType cov = covFilter->GetCovarianceMatrix();
-		mf->SetCovariance( cov );
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::UpdateDescriptorsFromSums() {
+	if( this->m_DescriptorSums.empty() ) {
+		itkExceptionMacro( << "No weighted sums available, a full estimation is required" );
+	}
 
-		MeasurementVectorType range[2];
+	size_t nregions = this->m_NumberOfRegions - this->m_NumberOfSpecialRegions;
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		this->ComputeDescriptorsFromSums( roi );
+	}
+	this->PostGenerateData();
+}
+
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+ITK_THREAD_RETURN_TYPE
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ThreadedEstimateCallback(void *arg) {
+	itk::MultiThreader::ThreadInfoStruct* info = (itk::MultiThreader::ThreadInfoStruct *)( arg );
+	ParallelEstimateStruct* str = (ParallelEstimateStruct *)( info->UserData );
+
+	size_t start;
+	while ( ( start = str->next.fetch_add( str->chunk ) ) < str->total ) {
+		size_t stop = std::min( start + str->chunk, str->total ) - 1;
+		str->selfptr->ThreadedEstimate( start, stop, info->ThreadID, *str );
+	}
 
-		this->m_RangeLower[roi] = covFilter->GetRangeMin();
-		this->m_RangeUpper[roi] = covFilter->GetRangeMax();
-		mf->SetRange(this->m_RangeLower[roi], this->m_RangeUpper[roi]);
+	return ITK_THREAD_RETURN_VALUE;
+}
 
-		mf->Initialize();
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+void
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::ThreadedEstimate(size_t start, size_t stop, itk::ThreadIdType threadId, ParallelEstimateStruct& str) {
+	const size_t ncomps = str.ncomps;
+	const size_t nregions = str.nregions;
+	const size_t nbins = ESTIMATE_HISTOGRAM_BINS;
+	const size_t nsums = 2 + ncomps + ncomps * ( ncomps + 1 ) / 2;
+
+	double* lower = &str.lower[threadId * ncomps];
+	double* upper = &str.upper[threadId * ncomps];
+	size_t* hist = &str.histograms[threadId * nregions * ncomps * nbins];
+	CompensatedSum* moments = &str.moments[threadId * nregions * nsums];
+	std::vector< double > d( ncomps );
+	std::vector< PriorsPrecisionType > pbuffer;
+	const PriorsPrecisionType* priors = this->GetPriors( start, stop - start + 1, pbuffer );
+
+	for( size_t i = start; i <= stop; i++ ) {
+		const PixelValueType* x = str.input + i * ncomps;
+		const PriorsPrecisionType* w = priors + ( i - start ) * str.offset;
+
+		// Voxels with no data
+		if( x[0] == 0 && ( ncomps == 1 || x[1] == 0 ) ) {
+			continue;
+		}
 
-		this->m_Memberships[roi] = mf;
-		this->m_RegionOffsetContainer[roi] = mf->GetOffsetTerm();
+		if( str.pass == 0 ) {
+			bool robust = false;
+			for( size_t roi = 0; roi < nregions && !robust; roi++ ) {
+				robust = ( w[roi] >= ESTIMATE_ROBUST_WEIGHT );
+			}
+			if( !robust ) continue;
 
-		double maxv = mf->GetMaximumValue() * 1.0e3;
-		if( maxv > this->m_MaxEnergy ) {
-			this->m_MaxEnergy = maxv;
+			for( size_t c = 0; c < ncomps; c++ ) {
+				if( x[c] < lower[c] ) lower[c] = x[c];
+				if( x[c] > upper[c] ) upper[c] = x[c];
+			}
+		} else if( str.pass == 1 ) {
+			for( size_t roi = 0; roi < nregions; roi++ ) {
+				if( w[roi] < ESTIMATE_ROBUST_WEIGHT ) continue;
+
+				size_t* h = hist + roi * ncomps * nbins;
+				for( size_t c = 0; c < ncomps; c++ ) {
+					long b = long( ( x[c] - str.origin[c] ) * str.scale[c] );
+					if( b < 0 ) b = 0;
+					if( b > long(nbins) - 1 ) b = nbins - 1;
+					h[c * nbins + b]++;
+				}
+			}
+		} else {
+			for( size_t roi = 0; roi < nregions; roi++ ) {
+				double wr = w[roi];
+				if( wr < ESTIMATE_MIN_WEIGHT ) continue;
+
+				// Reject outliers
+				const double* bottom = &str.bottom[roi * ncomps];
+				const double* top = &str.top[roi * ncomps];
+				bool outlier = false;
+				for( size_t c = 0; c < ncomps && !outlier; c++ ) {
+					outlier = ( x[c] > top[c] || x[c] < bottom[c] );
+				}
+				if( outlier ) continue;
+
+				const double* shift = &str.shift[roi * ncomps];
+				CompensatedSum* s = moments + roi * nsums;
+				s[0].Add( wr );
+				s[1].Add( wr * wr );
+				for( size_t c = 0; c < ncomps; c++ ) {
+					d[c] = x[c] - shift[c];
+					s[2 + c].Add( wr * d[c] );
+				}
+				size_t k = 2 + ncomps;
+				for( size_t r = 0; r < ncomps; r++ ) {
+					for( size_t c = 0; c <= r; c++ ) {
+						s[k++].Add( wr * d[r] * d[c] );
+					}
+				}
+			}
 		}
-		this->m_Means[roi] = mean;
-		this->m_Covariances[roi] = cov;
 	}
 }
 
+template< typename TInputVectorImage, typename TPriorsPrecisionType >
+double
+MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
+::HistogramQuantile(const size_t* hist, double q, double origin, double width) {
+	size_t nbins = ESTIMATE_HISTOGRAM_BINS;
+	size_t total = 0;
+	for( size_t b = 0; b < nbins; b++ ) total+= hist[b];
+
+	// No samples: do not reject anything
+	if( total == 0 ) {
+		return ( q < 0.5 )?itk::NumericTraits< double >::NonpositiveMin():( ( q > 0.5 )?itk::NumericTraits< double >::max():origin );
+	}
+
+	// Same rank as the sorted samples of WeightedCovarianceSampleFilter,
+	// located within its bin assuming samples are evenly spread
+	size_t rank = size_t( q * ( total - 1 ) );
+	size_t cum = 0;
+	size_t b = 0;
+	while( cum + hist[b] <= rank ) cum+= hist[b++];
+	return origin + ( b + ( rank - cum + 0.5 ) / hist[b] ) * width;
+}
+
 template< typename TInputVectorImage, typename TPriorsPrecisionType >
 typename MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >::MeasureType
 MahalanobisDistanceModel< TInputVectorImage, TPriorsPrecisionType >
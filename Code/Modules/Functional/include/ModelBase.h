@@ -48,6 +48,7 @@
 #include <itkMeasurementVectorTraits.h>
 #include <itkNumericTraitsCovariantVectorPixel.h>
 #include <itkVectorImageToImageAdaptor.h>
+#include "SparsePriorsMap.h"
 
 namespace rstk {
 
@@ -90,6 +91,7 @@ public:
 	typedef typename PriorsImageType::Pointer                                 PriorsImagePointer;
 	typedef itk::ImageRegionConstIterator< PriorsImageType >                  PriorsImageIteratorType;
 
+	typedef SparsePriorsMap< PriorsPrecisionType, Dimension >                 SparsePriorsMapType;
 	typedef itk::VectorImageToImageAdaptor<PriorsPrecisionType, Dimension>    PriorsAdaptor;
 	typedef typename PriorsAdaptor::Pointer                                   PriorsAdaptorPointer;
 
@@ -110,6 +112,22 @@ public:
 	 * to a real number. */
 	virtual double Evaluate(const MeasurementVectorType & x, const RegionIdentifier roi) const = 0;
 
+	/** Evaluate the input voxel at idx. Models caching energies per voxel override it */
+	virtual double EvaluateAtIndex(const IndexType & idx, const RegionIdentifier roi) const {
+		return this->Evaluate(this->GetInput()->GetPixel(idx), roi);
+	}
+
+	virtual bool HasEnergyCache() const { return false; }
+
+	/** Evaluate nsamples pixels stored one after the other, as in the input buffer */
+	virtual void EvaluateBatch(const PixelValueType* samples, size_t nsamples, const RegionIdentifier roi, MeasureType* out) const {
+		size_t ncomps = this->GetInput()->GetNumberOfComponentsPerPixel();
+		for( size_t s = 0; s < nsamples; s++ ) {
+			PixelType x( const_cast< PixelValueType* >( samples + s * ncomps ), ncomps, false );
+			out[s] = this->Evaluate(x, roi);
+		}
+	}
+
     /** Set/Get priors
      *
      */
@@ -118,7 +136,18 @@ public:
     }
 
     virtual const PriorsImageType * GetPriorsMap() {
-    	return static_cast<const PriorsImageType*>(this->Superclass::ProcessObject::GetInput(1));
+    	return dynamic_cast<const PriorsImageType*>(this->Superclass::ProcessObject::GetInput(1));
+    }
+
+    /** Set/Get the priors in compact form, replaces the dense priors map
+     *
+     */
+    virtual void SetSparsePriorsMap(const SparsePriorsMapType *priors) {
+    	this->SetNthInput(1, const_cast<SparsePriorsMapType *>(priors));
+    }
+
+    virtual const SparsePriorsMapType * GetSparsePriorsMap() {
+    	return dynamic_cast<const SparsePriorsMapType*>(this->Superclass::ProcessObject::GetInput(1));
     }
 
     /** Set/Get priors
@@ -140,9 +169,10 @@ public:
 	virtual void ReadDescriptorsFromFile(std::string filename) = 0;
 
 	itkGetConstMacro(MaxEnergy, MeasureType);
+	itkGetConstMacro(NumberOfRegions, RegionIdentifier);
 
 	itkSetMacro(NumberOfSpecialRegions, size_t);
-	itkGetMacro(NumberOfSpecialRegions, size_t);
+	itkGetConstMacro(NumberOfSpecialRegions, size_t);
 
 protected:
 	ModelBase();
@@ -163,6 +193,28 @@ protected:
 
 	virtual MembershipFunctionType* GetNewFunction() = 0;
 
+	/** Number of components of the priors, dense or sparse */
+	size_t GetNumberOfPriors() const {
+		const itk::DataObject* priors = this->Superclass::ProcessObject::GetInput(1);
+		const SparsePriorsMapType* sparse = dynamic_cast<const SparsePriorsMapType*>(priors);
+		if( sparse != NULL ) return sparse->GetNumberOfComponents();
+		return static_cast<const PriorsImageType*>(priors)->GetNumberOfComponentsPerPixel();
+	}
+
+	/** Priors of n voxels starting at the buffer offset. Dense maps are read in
+	 *  place, sparse maps are decompressed into buffer */
+	const PriorsPrecisionType* GetPriors(size_t offset, size_t n, std::vector< PriorsPrecisionType >& buffer) const {
+		const itk::DataObject* priors = this->Superclass::ProcessObject::GetInput(1);
+		const SparsePriorsMapType* sparse = dynamic_cast<const SparsePriorsMapType*>(priors);
+		if( sparse == NULL ) {
+			const PriorsImageType* dense = static_cast<const PriorsImageType*>(priors);
+			return dense->GetBufferPointer() + offset * dense->GetNumberOfComponentsPerPixel();
+		}
+		buffer.resize( n * sparse->GetNumberOfComponents() );
+		sparse->GetFractions( offset, n, &buffer[0] );
+		return &buffer[0];
+	}
+
 	inline MembershipFunctionType* GetFunction(size_t id) {
 		return dynamic_cast<MembershipFunctionType*>( this->m_Memberships[id].GetPointer());
 	}
@@ -0,0 +1,170 @@
+// --------------------------------------------------------------------------------------
+// File:          PartialVolumeEnergyFilter.h
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _PARTIALVOLUMEENERGYFILTER_H_
+#define _PARTIALVOLUMEENERGYFILTER_H_
+
+#include <vector>
+#include <itkArray.h>
+#include "MultilabelPartialVolumeMeshFilter.h"
+#include "SparsePriorsMap.h"
+
+namespace rstk {
+/** \class PartialVolumeEnergyFilter
+ *  \brief Computes the region fractions and, in the same pass, the energy of each region
+ *
+ *  Rows of fractions are handed to the model as soon as they are computed, so that
+ *  the energies and volumes EnergyCalculatorFilter would obtain from the output are
+ *  accumulated without reading the priors map again. Optionally, the descriptor
+ *  sums of the model (see MahalanobisDistanceModel::AddSampleToSums) are gathered too,
+ *  and the fractions can be stored in a SparsePriorsMap.
+ *  Without a model it behaves as MultilabelPartialVolumeMeshFilter. Turn
+ *  WriteFractions off when the priors map itself is not needed.
+ */
+template< typename TInputMesh, typename TModel >
+class PartialVolumeEnergyFilter: public MultilabelPartialVolumeMeshFilter< TInputMesh,
+                                                  typename TModel::PriorsPrecisionType,
+                                                  TModel::Dimension >
+{
+public:
+	/** Standard class typedefs. */
+	typedef PartialVolumeEnergyFilter                                     Self;
+	typedef MultilabelPartialVolumeMeshFilter< TInputMesh,
+			typename TModel::PriorsPrecisionType, TModel::Dimension >     Superclass;
+	typedef itk::SmartPointer< Self >                                     Pointer;
+	typedef itk::SmartPointer< const Self >                               ConstPointer;
+
+	/** Method for creation through the object factory. */
+	itkNewMacro(Self);
+
+	/** Run-time type information (and related methods). */
+	itkTypeMacro(PartialVolumeEnergyFilter, MultilabelPartialVolumeMeshFilter);
+
+	itkStaticConstMacro( Dimension, unsigned int, TModel::Dimension );
+
+	typedef typename Superclass::IndexType                        IndexType;
+	typedef typename Superclass::RegionType                       RegionType;
+	typedef typename Superclass::OutputPixelValueType             OutputPixelValueType;
+	typedef typename Superclass::OutputImageRegionType            OutputImageRegionType;
+
+	typedef TModel                                                EnergyModelType;
+	typedef typename EnergyModelType::ConstPointer                EnergyModelConstPointer;
+	typedef typename EnergyModelType::InputImageType              ReferenceImageType;
+	typedef typename ReferenceImageType::ConstPointer             ReferenceImageConstPointer;
+	typedef typename EnergyModelType::PixelValueType              PixelValueType;
+	typedef typename EnergyModelType::MeasureType                 MeasureType;
+	typedef itk::Array< MeasureType >                             MeasureArrayType;
+	typedef itk::Array< MeasureType >                             TotalVolumeContainer;
+	typedef typename EnergyModelType::CompensatedSum              CompensatedSum;
+	typedef typename EnergyModelType::DescriptorSumsContainer     DescriptorSumsContainer;
+	typedef SparsePriorsMap< OutputPixelValueType, Dimension >    SparsePriorsMapType;
+	typedef typename SparsePriorsMapType::Pointer                 SparsePriorsMapPointer;
+
+	/** Image the model evaluates. It also defines the output grid */
+	void SetReferenceImage(const ReferenceImageType* reference) {
+		if ( this->m_ReferenceImage != reference ) {
+			this->m_ReferenceImage = reference;
+			this->SetOutputReference( reference );
+			this->Modified();
+		}
+	}
+	itkGetConstObjectMacro(ReferenceImage, ReferenceImageType);
+
+	/** Model of the regions, no energies are computed if not set */
+	itkSetConstObjectMacro(Model, EnergyModelType);
+	itkGetConstObjectMacro(Model, EnergyModelType);
+
+	/** Store the fractions in this map too, which is reset to the output grid */
+	itkSetObjectMacro(SparseMap, SparsePriorsMapType);
+	itkGetObjectMacro(SparseMap, SparsePriorsMapType);
+
+	/** Also gather the descriptor sums of the model */
+	itkSetMacro(ComputeDescriptorSums, bool);
+	itkGetConstMacro(ComputeDescriptorSums, bool);
+	itkBooleanMacro(ComputeDescriptorSums);
+
+	/** Energies of each region, offsets included, as EnergyCalculatorFilter::GetEnergies */
+	const MeasureArrayType GetEnergies() const { return this->m_TotalEnergies; }
+	/** Total volume (partial volume weighted) of each region */
+	const TotalVolumeContainer GetVolumes() const { return this->m_TotalVolumes; }
+	/** Descriptor sums of all the regions, as MahalanobisDistanceModel::SetDescriptorSums expects */
+	const DescriptorSumsContainer& GetDescriptorSums() const { return this->m_TotalSums; }
+
+protected:
+	PartialVolumeEnergyFilter();
+	~PartialVolumeEnergyFilter() {}
+	virtual void PrintSelf(std::ostream & os, itk::Indent indent) const;
+
+	void BeforeThreadedGenerateData();
+	void AfterThreadedGenerateData();
+	virtual void ThreadedProcessRow(const IndexType & first, size_t nx,
+			const OutputPixelValueType* fractions, itk::ThreadIdType threadId);
+
+private:
+	PartialVolumeEnergyFilter(const Self &); //purposely not implemented
+	void operator=(const Self &);            //purposely not implemented
+
+	ReferenceImageConstPointer m_ReferenceImage;
+	EnergyModelConstPointer m_Model;
+	SparsePriorsMapPointer m_SparseMap;
+	bool m_ComputeDescriptorSums;
+	size_t m_NumberOfComponents;   // of the fractions
+	size_t m_NumberOfSums;         // descriptor sums per region
+	double m_PixelVolume;
+
+	std::vector< MeasureArrayType > m_Energies;           // per thread
+	std::vector< TotalVolumeContainer > m_Volumes;        // per thread
+	std::vector< DescriptorSumsContainer > m_Sums;        // per thread
+	std::vector< std::vector< MeasureType > > m_RowEnergies;  // per thread scratch
+	MeasureArrayType m_TotalEnergies;
+	TotalVolumeContainer m_TotalVolumes;
+	DescriptorSumsContainer m_TotalSums;
+}; // class
+
+} // namespace rstk
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "PartialVolumeEnergyFilter.hxx"
+#endif
+
+#endif /* _PARTIALVOLUMEENERGYFILTER_H_ */
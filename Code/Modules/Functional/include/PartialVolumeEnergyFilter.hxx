@@ -0,0 +1,216 @@
+// --------------------------------------------------------------------------------------
+// File:          PartialVolumeEnergyFilter.hxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _PARTIALVOLUMEENERGYFILTER_HXX_
+#define _PARTIALVOLUMEENERGYFILTER_HXX_
+
+#include "PartialVolumeEnergyFilter.h"
+
+namespace rstk
+{
+
+template< typename TInputMesh, typename TModel >
+PartialVolumeEnergyFilter< TInputMesh, TModel >
+::PartialVolumeEnergyFilter():
+ Superclass(),
+ m_ComputeDescriptorSums(false),
+ m_NumberOfComponents(0),
+ m_NumberOfSums(0),
+ m_PixelVolume(1.0) {}
+
+template< typename TInputMesh, typename TModel >
+void
+PartialVolumeEnergyFilter< TInputMesh, TModel >
+::PrintSelf(std::ostream & os, itk::Indent indent) const {
+	Superclass::PrintSelf(os, indent);
+	os << indent << "ComputeDescriptorSums: " << m_ComputeDescriptorSums << std::endl;
+}
+
+template< typename TInputMesh, typename TModel >
+void
+PartialVolumeEnergyFilter< TInputMesh, TModel >
+::BeforeThreadedGenerateData() {
+	Superclass::BeforeThreadedGenerateData();
+
+	this->m_Energies.clear();
+	this->m_Volumes.clear();
+	this->m_Sums.clear();
+	this->m_TotalSums.clear();
+	this->m_NumberOfComponents = this->GetOutput()->GetNumberOfComponentsPerPixel();
+	if ( this->m_SparseMap.IsNotNull() ) {
+		this->m_SparseMap->Allocate( this->GetOutput(), this->m_NumberOfComponents );
+	}
+
+	if ( this->m_Model.IsNull() ) {
+		return;
+	}
+
+	if ( this->m_ReferenceImage.IsNull() ) {
+		itkExceptionMacro( << "A reference image is required to evaluate the model" );
+	}
+
+	// find the actual number of threads
+	long nbOfThreads = this->GetNumberOfThreads();
+	if ( itk::MultiThreader::GetGlobalMaximumNumberOfThreads() != 0 ) {
+		nbOfThreads = vnl_math_min( this->GetNumberOfThreads(), itk::MultiThreader::GetGlobalMaximumNumberOfThreads() );
+	}
+	OutputImageRegionType splitRegion;  // dummy region - just to call the following method
+	nbOfThreads = this->SplitRequestedRegion(0, nbOfThreads, splitRegion);
+
+	MeasureArrayType energies( this->m_NumberOfComponents );
+	energies.Fill( 0.0 );
+	TotalVolumeContainer volumes( this->m_NumberOfComponents );
+	volumes.Fill( 0.0 );
+	this->m_Energies.assign( nbOfThreads, energies );
+	this->m_Volumes.assign( nbOfThreads, volumes );
+	this->m_RowEnergies.assign( nbOfThreads, std::vector< MeasureType >( this->GetOutput()->GetLargestPossibleRegion().GetSize()[0] ) );
+
+	this->m_NumberOfSums = 0;
+	if ( this->m_ComputeDescriptorSums && this->m_Model->HasDescriptorBounds() ) {
+		this->m_NumberOfSums = this->m_Model->GetNumberOfDescriptorSums();
+		size_t nregions = this->m_Model->GetNumberOfRegions() - this->m_Model->GetNumberOfSpecialRegions();
+		if ( nregions > this->m_NumberOfComponents ) {
+			itkExceptionMacro( << "The model describes more regions than fractions are computed" );
+		}
+		this->m_Sums.assign( nbOfThreads, DescriptorSumsContainer( nregions * this->m_NumberOfSums ) );
+	}
+
+	this->m_PixelVolume = 1.0;
+	for( size_t i = 0; i < Dimension; i++ ) this->m_PixelVolume*= this->m_ReferenceImage->GetSpacing()[i];
+}
+
+template< typename TInputMesh, typename TModel >
+void
+PartialVolumeEnergyFilter< TInputMesh, TModel >
+::ThreadedProcessRow(const IndexType & first, size_t nx, const OutputPixelValueType* fractions, itk::ThreadIdType threadId) {
+	if ( this->m_SparseMap.IsNotNull() ) {
+		this->m_SparseMap->SetRow( first, nx, fractions );
+	}
+
+	if ( this->m_Energies.empty() ) {
+		return;
+	}
+
+	// Same accumulation as EnergyCalculatorFilter::ThreadedGenerateData
+	const ReferenceImageType* reference = this->m_ReferenceImage;
+	size_t ncomps = reference->GetNumberOfComponentsPerPixel();
+	size_t nrois = this->m_NumberOfComponents;
+	const PixelValueType* x = reference->GetBufferPointer() + reference->ComputeOffset( first ) * ncomps;
+	const OutputPixelValueType* w = fractions;
+	bool cached = this->m_Model->HasEnergyCache();
+
+	MeasureArrayType& energies = this->m_Energies[threadId];
+	TotalVolumeContainer& volumes = this->m_Volumes[threadId];
+	std::vector< MeasureType >& rowEnergies = this->m_RowEnergies[threadId];
+
+	MeasureType vol;
+	for( size_t roi = 0; roi < nrois; roi++ ) {
+		size_t start = 0;
+		while( start < nx && w[start * nrois + roi] < 1.0e-8 ) start++;
+		if( start == nx )
+			continue;
+
+		if( cached ) {
+			IndexType pidx = first;
+			for( size_t i = start; i < nx; i++ ) {
+				pidx[0] = first[0] + i;
+				rowEnergies[i] = ( w[i * nrois + roi] < 1.0e-8 )?0.0:this->m_Model->EvaluateAtIndex( pidx, roi );
+			}
+		} else {
+			this->m_Model->EvaluateBatch( x + start * ncomps, nx - start, roi, &rowEnergies[start] );
+		}
+
+		for( size_t i = start; i < nx; i++ ) {
+			if( w[i * nrois + roi] < 1.0e-8 )
+				continue;
+			vol = w[i * nrois + roi] * this->m_PixelVolume;
+			volumes[roi]+= vol;
+			energies[roi]+= vol * rowEnergies[i];
+		}
+	}
+
+	if ( !this->m_Sums.empty() ) {
+		CompensatedSum* sums = &this->m_Sums[threadId][0];
+		size_t nregions = this->m_Sums[threadId].size() / this->m_NumberOfSums;
+		for( size_t i = 0; i < nx; i++ ) {
+			for( size_t roi = 0; roi < nregions; roi++ ) {
+				this->m_Model->AddSampleToSums( x + i * ncomps, roi, w[i * nrois + roi], sums + roi * this->m_NumberOfSums );
+			}
+		}
+	}
+}
+
+template< typename TInputMesh, typename TModel >
+void
+PartialVolumeEnergyFilter< TInputMesh, TModel >
+::AfterThreadedGenerateData() {
+	if ( this->m_Energies.empty() ) {
+		return;
+	}
+
+	size_t nrois = this->m_NumberOfComponents;
+	this->m_TotalEnergies.SetSize( nrois );
+	this->m_TotalEnergies.Fill( 0.0 );
+	this->m_TotalVolumes.SetSize( nrois );
+	this->m_TotalVolumes.Fill( 0.0 );
+
+	for( size_t roi = 0; roi < nrois; roi++ ) {
+		for( size_t th = 0; th < this->m_Volumes.size(); th++ ) {
+			this->m_TotalVolumes[roi]+= this->m_Volumes[th][roi];
+			this->m_TotalEnergies[roi]+= this->m_Energies[th][roi];
+		}
+		this->m_TotalEnergies[roi]+= this->m_TotalVolumes[roi] * this->m_Model->GetRegionOffsetContainer()[roi];
+	}
+
+	if ( !this->m_Sums.empty() ) {
+		this->m_TotalSums.assign( this->m_Sums[0].size(), CompensatedSum() );
+		for( size_t th = 0; th < this->m_Sums.size(); th++ ) {
+			for( size_t k = 0; k < this->m_TotalSums.size(); k++ ) {
+				this->m_TotalSums[k].Add( this->m_Sums[th][k].sum );
+				this->m_TotalSums[k].Add( this->m_Sums[th][k].c );
+			}
+		}
+	}
+}
+
+} // namespace rstk
+#endif /* _PARTIALVOLUMEENERGYFILTER_HXX_ */
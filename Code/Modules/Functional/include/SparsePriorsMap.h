@@ -0,0 +1,147 @@
+// --------------------------------------------------------------------------------------
+// File:          SparsePriorsMap.h
+// Date:          Mar 02, 2015
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _SPARSEPRIORSMAP_H_
+#define _SPARSEPRIORSMAP_H_
+
+#include <vector>
+#include <itkDataObject.h>
+#include <itkImage.h>
+#include <itkVectorImage.h>
+
+namespace rstk {
+/** \class SparsePriorsMap
+ *  \brief Compact storage of partial volume maps
+ *
+ *  Most voxels of a partial volume map belong to one region only. Here,
+ *  those voxels are stored as a label image (one byte per voxel) and only
+ *  the fractions of the remaining (boundary) voxels are kept, in sorted
+ *  lists per image row. Rows are decompressed on demand with GetRow or
+ *  GetFractions, and replaced with SetRow. Calls on different rows are
+ *  thread-safe.
+ *
+ *  Being a DataObject, it can be set as the priors input of the models and
+ *  of EnergyCalculatorFilter instead of the dense map.
+ */
+template< typename TPrecisionType = float, unsigned int VDimension = 3 >
+class SparsePriorsMap: public itk::DataObject {
+public:
+	/** Standard class typedefs */
+	typedef SparsePriorsMap                                    Self;
+	typedef itk::DataObject                                    Superclass;
+	typedef itk::SmartPointer< Self >                          Pointer;
+	typedef itk::SmartPointer< const Self >                    ConstPointer;
+
+	itkNewMacro(Self);
+	itkTypeMacro(SparsePriorsMap, DataObject);
+	itkStaticConstMacro(Dimension, unsigned int, VDimension);
+
+	typedef TPrecisionType                                     PrecisionType;
+	typedef unsigned char                                      LabelType;
+	typedef itk::Image< LabelType, VDimension >                LabelImageType;
+	typedef typename LabelImageType::Pointer                   LabelImagePointer;
+	typedef typename LabelImageType::IndexType                 IndexType;
+	typedef typename LabelImageType::SizeType                  SizeType;
+	typedef typename LabelImageType::RegionType                RegionType;
+	typedef itk::ImageBase< VDimension >                       ImageBaseType;
+	typedef itk::VectorImage< PrecisionType, VDimension >      PriorsImageType;
+	typedef typename PriorsImageType::Pointer                  PriorsImagePointer;
+
+	/** Labels of the voxels that are not one-hot */
+	static const LabelType EmptyLabel = 254;
+	static const LabelType BoundaryLabel = 255;
+
+	/** Set the grid after reference and clear the map (all voxels empty) */
+	void Allocate(const ImageBaseType* reference, size_t ncomps);
+	virtual void Initialize();
+
+	itkGetConstMacro(NumberOfComponents, size_t);
+	itkGetConstObjectMacro(Labels, LabelImageType);
+	const RegionType GetLargestPossibleRegion() const { return this->m_Labels->GetLargestPossibleRegion(); }
+
+	/** Store the fractions of nx voxels (NumberOfComponents each) starting at first */
+	void SetRow(const IndexType& first, size_t nx, const PrecisionType* fractions);
+
+	/** Fractions of nx voxels starting at first, written to out */
+	void GetRow(const IndexType& first, size_t nx, PrecisionType* out) const;
+
+	/** Fractions of n voxels starting at the (buffer) offset, across rows */
+	void GetFractions(size_t offset, size_t n, PrecisionType* out) const;
+
+	size_t GetNumberOfBoundaryVoxels() const;
+
+	/** Fill from/convert to the dense map */
+	void SetFromImage(const PriorsImageType* priors);
+	PriorsImagePointer ToImage() const;
+
+protected:
+	SparsePriorsMap();
+	~SparsePriorsMap() {}
+	void PrintSelf(std::ostream & os, itk::Indent indent) const;
+
+private:
+	SparsePriorsMap(const Self &); //purposely not implemented
+	void operator=(const Self &);  //purposely not implemented
+
+	/** Boundary voxels of one row, sorted by x */
+	struct Row {
+		std::vector< unsigned int > x;
+		std::vector< PrecisionType > values;
+	};
+
+	void SetRowSegment(size_t row, size_t x0, size_t nx, const PrecisionType* fractions);
+	void GetRowSegment(size_t row, size_t x0, size_t nx, PrecisionType* out) const;
+
+	LabelImagePointer m_Labels;
+	std::vector< Row > m_Rows;
+	size_t m_NumberOfComponents;
+	size_t m_RowLength;
+}; // class
+
+} // namespace rstk
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "SparsePriorsMap.hxx"
+#endif
+
+#endif /* _SPARSEPRIORSMAP_H_ */
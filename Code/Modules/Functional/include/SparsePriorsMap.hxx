@@ -0,0 +1,243 @@
+// --------------------------------------------------------------------------------------
+// File:          SparsePriorsMap.hxx
+// Date:          Mar 02, 2015
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _SPARSEPRIORSMAP_HXX_
+#define _SPARSEPRIORSMAP_HXX_
+
+#include "SparsePriorsMap.h"
+#include <algorithm>
+
+namespace rstk {
+
+template< typename TPrecisionType, unsigned int VDimension >
+const typename SparsePriorsMap< TPrecisionType, VDimension >::LabelType
+SparsePriorsMap< TPrecisionType, VDimension >::EmptyLabel;
+
+template< typename TPrecisionType, unsigned int VDimension >
+const typename SparsePriorsMap< TPrecisionType, VDimension >::LabelType
+SparsePriorsMap< TPrecisionType, VDimension >::BoundaryLabel;
+
+template< typename TPrecisionType, unsigned int VDimension >
+SparsePriorsMap< TPrecisionType, VDimension >
+::SparsePriorsMap():
+ m_NumberOfComponents(0),
+ m_RowLength(0) {
+	this->m_Labels = LabelImageType::New();
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::PrintSelf(std::ostream & os, itk::Indent indent) const {
+	Superclass::PrintSelf(os, indent);
+	os << indent << "NumberOfComponents: " << this->m_NumberOfComponents << std::endl;
+	os << indent << "NumberOfBoundaryVoxels: " << this->GetNumberOfBoundaryVoxels() << std::endl;
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::Initialize() {
+	Superclass::Initialize();
+	this->m_Labels = LabelImageType::New();
+	this->m_Rows.clear();
+	this->m_NumberOfComponents = 0;
+	this->m_RowLength = 0;
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::Allocate(const ImageBaseType* reference, size_t ncomps) {
+	if ( ncomps >= EmptyLabel ) {
+		itkExceptionMacro( << "Too many components (" << ncomps << ") for the label image" );
+	}
+
+	this->m_Labels = LabelImageType::New();
+	this->m_Labels->SetRegions( reference->GetLargestPossibleRegion() );
+	this->m_Labels->SetOrigin( reference->GetOrigin() );
+	this->m_Labels->SetSpacing( reference->GetSpacing() );
+	this->m_Labels->SetDirection( reference->GetDirection() );
+	this->m_Labels->Allocate();
+	this->m_Labels->FillBuffer( EmptyLabel );
+
+	RegionType region = this->m_Labels->GetLargestPossibleRegion();
+	this->m_NumberOfComponents = ncomps;
+	this->m_RowLength = region.GetSize()[0];
+	this->m_Rows.clear();
+	this->m_Rows.resize( ( this->m_RowLength > 0 )?( region.GetNumberOfPixels() / this->m_RowLength ):0 );
+	this->Modified();
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::SetRow(const IndexType& first, size_t nx, const PrecisionType* fractions) {
+	size_t off = this->m_Labels->ComputeOffset( first );
+	this->SetRowSegment( off / this->m_RowLength, off % this->m_RowLength, nx, fractions );
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::SetRowSegment(size_t row, size_t x0, size_t nx, const PrecisionType* fractions) {
+	size_t nc = this->m_NumberOfComponents;
+	LabelType* labels = this->m_Labels->GetBufferPointer() + row * this->m_RowLength + x0;
+	Row& r = this->m_Rows[row];
+
+	// Entries out of [x0, x0 + nx) are kept
+	size_t lo = std::lower_bound( r.x.begin(), r.x.end(), x0 ) - r.x.begin();
+	size_t hi = std::lower_bound( r.x.begin(), r.x.end(), x0 + nx ) - r.x.begin();
+	std::vector< unsigned int > xs( r.x.begin(), r.x.begin() + lo );
+	std::vector< PrecisionType > vs( r.values.begin(), r.values.begin() + lo * nc );
+
+	for( size_t i = 0; i < nx; i++ ) {
+		const PrecisionType* w = fractions + i * nc;
+
+		// One-hot and empty voxels only need their label
+		LabelType label = EmptyLabel;
+		bool boundary = false;
+		for( size_t c = 0; c < nc && !boundary; c++ ) {
+			if( w[c] == 0.0 ) continue;
+			if( w[c] == 1.0 && label == EmptyLabel ) label = c;
+			else boundary = true;
+		}
+
+		if( boundary ) {
+			labels[i] = BoundaryLabel;
+			xs.push_back( x0 + i );
+			vs.insert( vs.end(), w, w + nc );
+		} else {
+			labels[i] = label;
+		}
+	}
+
+	xs.insert( xs.end(), r.x.begin() + hi, r.x.end() );
+	vs.insert( vs.end(), r.values.begin() + hi * nc, r.values.end() );
+	r.x.swap( xs );
+	r.values.swap( vs );
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::GetRow(const IndexType& first, size_t nx, PrecisionType* out) const {
+	size_t off = this->m_Labels->ComputeOffset( first );
+	this->GetRowSegment( off / this->m_RowLength, off % this->m_RowLength, nx, out );
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::GetFractions(size_t offset, size_t n, PrecisionType* out) const {
+	size_t nc = this->m_NumberOfComponents;
+	while( n > 0 ) {
+		size_t x0 = offset % this->m_RowLength;
+		size_t len = std::min( n, this->m_RowLength - x0 );
+		this->GetRowSegment( offset / this->m_RowLength, x0, len, out );
+		offset+= len;
+		out+= len * nc;
+		n-= len;
+	}
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::GetRowSegment(size_t row, size_t x0, size_t nx, PrecisionType* out) const {
+	size_t nc = this->m_NumberOfComponents;
+	const LabelType* labels = this->m_Labels->GetBufferPointer() + row * this->m_RowLength + x0;
+
+	std::fill( out, out + nx * nc, 0.0 );
+	for( size_t i = 0; i < nx; i++ ) {
+		if( labels[i] < nc ) out[i * nc + labels[i]] = 1.0;
+	}
+
+	const Row& r = this->m_Rows[row];
+	size_t k = std::lower_bound( r.x.begin(), r.x.end(), x0 ) - r.x.begin();
+	for( ; k < r.x.size() && r.x[k] < x0 + nx; k++ ) {
+		std::copy( r.values.begin() + k * nc, r.values.begin() + ( k + 1 ) * nc, out + ( r.x[k] - x0 ) * nc );
+	}
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+size_t
+SparsePriorsMap< TPrecisionType, VDimension >
+::GetNumberOfBoundaryVoxels() const {
+	size_t n = 0;
+	for( size_t row = 0; row < this->m_Rows.size(); row++ ) {
+		n+= this->m_Rows[row].x.size();
+	}
+	return n;
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+void
+SparsePriorsMap< TPrecisionType, VDimension >
+::SetFromImage(const PriorsImageType* priors) {
+	size_t nc = priors->GetNumberOfComponentsPerPixel();
+	this->Allocate( priors, nc );
+
+	const PrecisionType* buffer = priors->GetBufferPointer();
+	for( size_t row = 0; row < this->m_Rows.size(); row++ ) {
+		this->SetRowSegment( row, 0, this->m_RowLength, buffer + row * this->m_RowLength * nc );
+	}
+}
+
+template< typename TPrecisionType, unsigned int VDimension >
+typename SparsePriorsMap< TPrecisionType, VDimension >::PriorsImagePointer
+SparsePriorsMap< TPrecisionType, VDimension >
+::ToImage() const {
+	PriorsImagePointer priors = PriorsImageType::New();
+	priors->SetRegions( this->m_Labels->GetLargestPossibleRegion() );
+	priors->SetOrigin( this->m_Labels->GetOrigin() );
+	priors->SetSpacing( this->m_Labels->GetSpacing() );
+	priors->SetDirection( this->m_Labels->GetDirection() );
+	priors->SetNumberOfComponentsPerPixel( this->m_NumberOfComponents );
+	priors->Allocate();
+
+	this->GetFractions( 0, this->m_Labels->GetLargestPossibleRegion().GetNumberOfPixels(), priors->GetBufferPointer() );
+	return priors;
+}
+
+} // namespace rstk
+#endif /* _SPARSEPRIORSMAP_HXX_ */
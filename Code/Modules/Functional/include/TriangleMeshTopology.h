@@ -0,0 +1,160 @@
+// --------------------------------------------------------------------------------------
+// File:          TriangleMeshTopology.h
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _TRIANGLEMESHTOPOLOGY_H_
+#define _TRIANGLEMESHTOPOLOGY_H_
+
+#include <vector>
+#include <itkObject.h>
+#include <itkObjectFactory.h>
+#include <itkMultiThreader.h>
+
+namespace rstk {
+
+/** \class TriangleMeshTopology
+ *  \brief Flat adjacency of a triangle mesh, to recompute normals and areas as vertices move
+ *
+ *  The face to vertex and vertex to face (CSR) adjacencies are built once in
+ *  SetInput. Compute() then only copies the current coordinates to a flat array
+ *  and evaluates face normals, AREA-weighted vertex normals and vertex areas
+ *  (mean area of the incident faces) in parallel, without allocating. Normals
+ *  follow the winding convention of NormalQuadEdgeMeshFilter.
+ */
+template< typename TInputMesh >
+class TriangleMeshTopology: public itk::Object {
+public:
+	typedef TriangleMeshTopology                     Self;
+	typedef itk::Object                              Superclass;
+	typedef itk::SmartPointer< Self >                Pointer;
+	typedef itk::SmartPointer< const Self >          ConstPointer;
+
+	itkNewMacro(Self);
+	itkTypeMacro(TriangleMeshTopology, itk::Object);
+
+	typedef TInputMesh                               MeshType;
+	typedef typename MeshType::ConstPointer          MeshConstPointer;
+	typedef typename MeshType::PointsContainer       PointsContainer;
+	typedef typename MeshType::CellType              CellType;
+	typedef typename MeshType::CoordRepType          CoordRepType;
+
+	typedef std::vector< size_t >                    IndexVector;
+	typedef std::vector< double >                    ValueVector;
+
+	/** Builds the adjacency of the mesh */
+	void SetInput(const MeshType* mesh);
+	itkGetConstObjectMacro(Input, MeshType);
+
+	/** Recomputes normals and areas from the current points of the input */
+	void Compute();
+	/** Recomputes normals and areas from a different set of points (same ids) */
+	void Compute(const PointsContainer* points);
+	/** Recomputes normals and areas from flat coordinate arrays, indexed by point id */
+	void Compute(const CoordRepType* x, const CoordRepType* y, const CoordRepType* z);
+
+	size_t GetNumberOfVertices() const { return this->m_VertexFaceOffsets.size() - 1; }
+	size_t GetNumberOfFaces() const { return this->m_FaceVertices.size() / 3; }
+
+	const IndexVector& GetFaceVertices() const { return this->m_FaceVertices; }
+	const IndexVector& GetVertexFaceOffsets() const { return this->m_VertexFaceOffsets; }
+	const IndexVector& GetVertexFaces() const { return this->m_VertexFaces; }
+
+	const double* GetCoordinates(size_t vid) const { return &this->m_Coordinates[3 * vid]; }
+	const double* GetVertexNormal(size_t vid) const { return &this->m_VertexNormals[3 * vid]; }
+	double GetVertexArea(size_t vid) const { return this->m_VertexAreas[vid]; }
+	const ValueVector& GetVertexAreas() const { return this->m_VertexAreas; }
+	const double* GetFaceNormal(size_t fid) const { return &this->m_FaceNormals[3 * fid]; }
+	double GetFaceArea(size_t fid) const { return this->m_FaceAreas[fid]; }
+
+	itkGetConstMacro(TotalArea, double);
+	itkGetConstMacro(IsWindingCCW, bool);
+
+	/** Return the multithreader used by this class. */
+	itk::MultiThreader * GetMultiThreader() const { return m_Threader; }
+	itkSetClampMacro( NumberOfThreads, itk::ThreadIdType, 1, ITK_MAX_THREADS);
+	itkGetConstReferenceMacro(NumberOfThreads, itk::ThreadIdType);
+
+protected:
+	TriangleMeshTopology();
+	~TriangleMeshTopology() {}
+	void PrintSelf(std::ostream & os, itk::Indent indent) const;
+
+	void ComputeNormalsAndAreas();
+	void CheckTriangleWinding();
+	void ComputeFaces(size_t first, size_t last);
+	void ComputeVertices(size_t first, size_t last, itk::ThreadIdType threadId);
+
+	struct ThreadStruct {
+		Self* selfptr;
+		bool vertices;
+	};
+	static ITK_THREAD_RETURN_TYPE ComputeThreaderCallback(void *arg);
+
+private:
+	TriangleMeshTopology(const Self &); //purposely not implemented
+	void operator=(const Self &);       //purposely not implemented
+
+	MeshConstPointer m_Input;
+	IndexVector m_FaceVertices;         // three vertex ids per face
+	IndexVector m_VertexFaceOffsets;    // faces of vertex v are m_VertexFaces[offsets[v]..offsets[v+1])
+	IndexVector m_VertexFaces;
+
+	ValueVector m_Coordinates;          // x, y, z per vertex
+	ValueVector m_FaceNormals;          // x, y, z per face
+	ValueVector m_FaceAreas;
+	ValueVector m_VertexNormals;        // x, y, z per vertex
+	ValueVector m_VertexAreas;
+	ValueVector m_ThreadAreas;          // partial sums of the vertex areas
+
+	double m_TotalArea;
+	bool m_IsWindingCCW;
+
+	itk::MultiThreader::Pointer m_Threader;
+	itk::ThreadIdType m_NumberOfThreads;
+}; // class TriangleMeshTopology
+
+} // namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "TriangleMeshTopology.hxx"
+#endif
+
+#endif /* _TRIANGLEMESHTOPOLOGY_H_ */
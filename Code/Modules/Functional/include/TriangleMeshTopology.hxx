@@ -0,0 +1,325 @@
+// --------------------------------------------------------------------------------------
+// File:          TriangleMeshTopology.hxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of ACWEReg
+//
+// ACWEReg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// ACWEReg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with ACWEReg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef _TRIANGLEMESHTOPOLOGY_HXX_
+#define _TRIANGLEMESHTOPOLOGY_HXX_
+
+#include "TriangleMeshTopology.h"
+#include <math.h>
+#include <algorithm>
+
+namespace rstk {
+
+template< typename TInputMesh >
+TriangleMeshTopology< TInputMesh >
+::TriangleMeshTopology():
+ m_TotalArea(0.0),
+ m_IsWindingCCW(false) {
+	this->m_Threader = itk::MultiThreader::New();
+	this->m_NumberOfThreads = this->m_Threader->GetNumberOfThreads();
+	this->m_VertexFaceOffsets.resize(1, 0);
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::PrintSelf(std::ostream & os, itk::Indent indent) const {
+	Superclass::PrintSelf(os, indent);
+	os << indent << "NumberOfVertices: " << this->GetNumberOfVertices() << std::endl;
+	os << indent << "NumberOfFaces: " << this->GetNumberOfFaces() << std::endl;
+	os << indent << "TotalArea: " << this->m_TotalArea << std::endl;
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::SetInput(const MeshType* mesh) {
+	this->m_Input = mesh;
+
+	size_t nvertices = mesh->GetNumberOfPoints();
+	typename PointsContainer::ConstIterator p_it = mesh->GetPoints()->Begin();
+	typename PointsContainer::ConstIterator p_end = mesh->GetPoints()->End();
+	for( ; p_it != p_end; ++p_it ) {
+		if( p_it.Index() >= nvertices ) nvertices = p_it.Index() + 1;
+	}
+
+	// Face to vertex
+	this->m_FaceVertices.clear();
+	typename MeshType::CellsContainerConstIterator c_it = mesh->GetCells()->Begin();
+	typename MeshType::CellsContainerConstIterator c_end = mesh->GetCells()->End();
+	for( ; c_it != c_end; ++c_it ) {
+		const CellType* cell = c_it.Value();
+		if( cell->GetNumberOfPoints() != 3 ) {
+			continue;
+		}
+
+		typename CellType::PointIdConstIterator pit = cell->PointIdsBegin();
+		for( ; pit != cell->PointIdsEnd(); ++pit ) {
+			this->m_FaceVertices.push_back(*pit);
+		}
+	}
+	size_t nfaces = this->m_FaceVertices.size() / 3;
+
+	// Vertex to face, compressed rows
+	this->m_VertexFaceOffsets.assign(nvertices + 1, 0);
+	for( size_t i = 0; i < this->m_FaceVertices.size(); i++ ) {
+		this->m_VertexFaceOffsets[this->m_FaceVertices[i] + 1]++;
+	}
+	for( size_t v = 0; v < nvertices; v++ ) {
+		this->m_VertexFaceOffsets[v + 1]+= this->m_VertexFaceOffsets[v];
+	}
+
+	IndexVector fill(this->m_VertexFaceOffsets.begin(), this->m_VertexFaceOffsets.end() - 1);
+	this->m_VertexFaces.resize(this->m_FaceVertices.size());
+	for( size_t f = 0; f < nfaces; f++ ) {
+		for( size_t k = 0; k < 3; k++ ) {
+			this->m_VertexFaces[fill[this->m_FaceVertices[3 * f + k]]++] = f;
+		}
+	}
+
+	this->m_Coordinates.assign(3 * nvertices, 0.0);
+	this->m_FaceNormals.assign(3 * nfaces, 0.0);
+	this->m_FaceAreas.assign(nfaces, 0.0);
+	this->m_VertexNormals.assign(3 * nvertices, 0.0);
+	this->m_VertexAreas.assign(nvertices, 0.0);
+	this->m_TotalArea = 0.0;
+	this->Modified();
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::Compute() {
+	if( this->m_Input.IsNull() ) {
+		itkExceptionMacro(<< "input mesh is not set");
+	}
+	this->Compute(this->m_Input->GetPoints());
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::Compute(const PointsContainer* points) {
+	size_t nvertices = this->GetNumberOfVertices();
+	if( nvertices == 0 ) {
+		return;
+	}
+
+	typename PointsContainer::ConstIterator p_it = points->Begin();
+	typename PointsContainer::ConstIterator p_end = points->End();
+	double* coords = &this->m_Coordinates[0];
+	for( ; p_it != p_end; ++p_it ) {
+		size_t vid = p_it.Index();
+		if( vid >= nvertices ) {
+			itkExceptionMacro(<< "point id " << vid << " is not in the topology");
+		}
+		for( size_t i = 0; i < 3; i++ ) {
+			coords[3 * vid + i] = p_it.Value()[i];
+		}
+	}
+
+	this->ComputeNormalsAndAreas();
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::Compute(const CoordRepType* x, const CoordRepType* y, const CoordRepType* z) {
+	size_t nvertices = this->GetNumberOfVertices();
+	if( nvertices == 0 ) {
+		return;
+	}
+
+	double* coords = &this->m_Coordinates[0];
+	for( size_t vid = 0; vid < nvertices; vid++ ) {
+		coords[3 * vid] = x[vid];
+		coords[3 * vid + 1] = y[vid];
+		coords[3 * vid + 2] = z[vid];
+	}
+	this->ComputeNormalsAndAreas();
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::ComputeNormalsAndAreas() {
+	this->CheckTriangleWinding();
+
+	ThreadStruct str;
+	str.selfptr = this;
+	this->m_ThreadAreas.assign(this->m_NumberOfThreads, 0.0);
+	this->GetMultiThreader()->SetNumberOfThreads(this->m_NumberOfThreads);
+
+	// Face normals must be ready before any vertex is computed
+	str.vertices = false;
+	this->GetMultiThreader()->SetSingleMethod(this->ComputeThreaderCallback, &str);
+	this->GetMultiThreader()->SingleMethodExecute();
+
+	str.vertices = true;
+	this->GetMultiThreader()->SetSingleMethod(this->ComputeThreaderCallback, &str);
+	this->GetMultiThreader()->SingleMethodExecute();
+
+	this->m_TotalArea = 0.0;
+	for( size_t th = 0; th < this->m_ThreadAreas.size(); th++ ) {
+		this->m_TotalArea+= this->m_ThreadAreas[th];
+	}
+}
+
+template< typename TInputMesh >
+ITK_THREAD_RETURN_TYPE
+TriangleMeshTopology< TInputMesh >
+::ComputeThreaderCallback(void *arg) {
+	itk::ThreadIdType threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
+	itk::ThreadIdType threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
+	ThreadStruct* str = (ThreadStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+	size_t total = str->vertices?str->selfptr->GetNumberOfVertices():str->selfptr->GetNumberOfFaces();
+	size_t ssize = ( total + threadCount - 1 ) / threadCount;
+	size_t first = threadId * ssize;
+	size_t last = std::min( first + ssize, total );
+
+	if( first < last ) {
+		if( str->vertices )
+			str->selfptr->ComputeVertices(first, last, threadId);
+		else
+			str->selfptr->ComputeFaces(first, last);
+	}
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::ComputeFaces(size_t first, size_t last) {
+	const double* coords = &this->m_Coordinates[0];
+	const size_t* ids = &this->m_FaceVertices[0];
+	double* normals = &this->m_FaceNormals[0];
+	double* areas = &this->m_FaceAreas[0];
+	double sign = this->m_IsWindingCCW?-1.0:1.0;
+
+	for( size_t f = first; f < last; f++ ) {
+		const double* a = coords + 3 * ids[3 * f];
+		const double* b = coords + 3 * ids[3 * f + 1];
+		const double* c = coords + 3 * ids[3 * f + 2];
+
+		double u0 = b[0] - a[0], u1 = b[1] - a[1], u2 = b[2] - a[2];
+		double v0 = c[0] - a[0], v1 = c[1] - a[1], v2 = c[2] - a[2];
+		double n0 = u1 * v2 - u2 * v1;
+		double n1 = u2 * v0 - u0 * v2;
+		double n2 = u0 * v1 - u1 * v0;
+		double l = sqrt( n0 * n0 + n1 * n1 + n2 * n2 );
+
+		areas[f] = 0.5 * l;
+		l = ( l > 0.0 )?( sign / l ):0.0;
+		normals[3 * f] = n0 * l;
+		normals[3 * f + 1] = n1 * l;
+		normals[3 * f + 2] = n2 * l;
+	}
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::ComputeVertices(size_t first, size_t last, itk::ThreadIdType threadId) {
+	const size_t* offsets = &this->m_VertexFaceOffsets[0];
+	const size_t* faces = this->m_VertexFaces.empty()?NULL:&this->m_VertexFaces[0];
+	const double* fnormals = this->m_FaceNormals.empty()?NULL:&this->m_FaceNormals[0];
+	const double* fareas = this->m_FaceAreas.empty()?NULL:&this->m_FaceAreas[0];
+	double* normals = &this->m_VertexNormals[0];
+	double* areas = &this->m_VertexAreas[0];
+	double total = 0.0;
+
+	for( size_t v = first; v < last; v++ ) {
+		double n0 = 0.0, n1 = 0.0, n2 = 0.0, a = 0.0;
+		size_t nfaces = offsets[v + 1] - offsets[v];
+
+		for( size_t k = offsets[v]; k < offsets[v + 1]; k++ ) {
+			size_t f = faces[k];
+			double w = fareas[f];
+			n0+= w * fnormals[3 * f];
+			n1+= w * fnormals[3 * f + 1];
+			n2+= w * fnormals[3 * f + 2];
+			a+= w;
+		}
+
+		double l = sqrt( n0 * n0 + n1 * n1 + n2 * n2 );
+		l = ( l > 0.0 )?( 1.0 / l ):0.0;
+		normals[3 * v] = n0 * l;
+		normals[3 * v + 1] = n1 * l;
+		normals[3 * v + 2] = n2 * l;
+
+		areas[v] = ( nfaces > 0 )?( a / nfaces ):0.0;
+		total+= areas[v];
+	}
+	this->m_ThreadAreas[threadId] = total;
+}
+
+template< typename TInputMesh >
+void
+TriangleMeshTopology< TInputMesh >
+::CheckTriangleWinding() {
+	// Same test as NormalQuadEdgeMeshFilter, on the centroids of the first three faces
+	this->m_IsWindingCCW = false;
+	if( this->GetNumberOfFaces() < 3 ) {
+		return;
+	}
+
+	double pt[3][2];
+	for( size_t f = 0; f < 3; f++ ) {
+		for( size_t i = 0; i < 2; i++ ) {
+			pt[f][i] = 0.0;
+			for( size_t k = 0; k < 3; k++ ) {
+				pt[f][i]+= this->m_Coordinates[3 * this->m_FaceVertices[3 * f + k] + i];
+			}
+			pt[f][i]/= 3.0;
+		}
+	}
+
+	double test = (pt[1][0] - pt[0][0]) * (pt[1][1] + pt[0][1]) +
+			      (pt[2][0] - pt[1][0]) * (pt[2][1] + pt[1][1]) +
+			      (pt[0][0] - pt[2][0]) * (pt[0][1] + pt[2][1]);
+	this->m_IsWindingCCW = (test < 0);
+}
+
+} // namespace rstk
+
+#endif /* _TRIANGLEMESHTOPOLOGY_HXX_ */
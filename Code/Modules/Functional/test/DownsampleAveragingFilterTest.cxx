@@ -0,0 +1,151 @@
+// --------------------------------------------------------------------------------------
+// File:          DownsampleAveragingFilterTest.cxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+
+#include "DownsampleAveragingFilter.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+typedef itk::VectorImage< float, 3u >                                   ImageType;
+typedef DownsampleAveragingFilter< ImageType, ImageType >               DownsampleFilter;
+typedef DownsampleFilter::MaskImageType                                 MaskType;
+
+class DownsampleAveragingFilterTest : public ::testing::Test {
+public:
+	virtual void SetUp() {
+		m_factor[0] = 2; m_factor[1] = 3; m_factor[2] = 4;
+
+		ImageType::SizeType size;
+		ImageType::SpacingType spacing;
+		ImageType::PointType origin;
+		for ( size_t d = 0; d < 3; d++ ) {
+			m_outsize[d] = 5 + d;
+			size[d] = m_outsize[d] * m_factor[d];
+			spacing[d] = 0.5 + 0.25 * d;
+			origin[d] = -3.0 + d;
+
+			// Output voxels cover m_factor input voxels exactly
+			m_outspacing[d] = spacing[d] * m_factor[d];
+			m_outorigin[d] = origin[d] + 0.5 * ( m_factor[d] - 1 ) * spacing[d];
+		}
+
+		m_input = ImageType::New();
+		m_input->SetRegions( size );
+		m_input->SetSpacing( spacing );
+		m_input->SetOrigin( origin );
+		m_input->SetNumberOfComponentsPerPixel( m_ncomps );
+		m_input->Allocate();
+
+		float* buffer = m_input->GetBufferPointer();
+		size_t npix = m_input->GetLargestPossibleRegion().GetNumberOfPixels();
+		for ( size_t i = 0; i < npix * m_ncomps; i++ ) {
+			buffer[i] = 0.5 + 0.5 * sin( 0.31 * i );
+		}
+	}
+
+	DownsampleFilter::Pointer NewFilter() {
+		DownsampleFilter::Pointer ds = DownsampleFilter::New();
+		ds->SetInput( m_input );
+		ds->SetOutputSpacing( m_outspacing );
+		ds->SetOutputOrigin( m_outorigin );
+		ds->SetSize( m_outsize );
+		return ds;
+	}
+
+	/** Old window averaging: plain mean of the input voxels whose centers fall in the output voxel */
+	double WindowAverage( const ImageType::IndexType& out, size_t comp ) {
+		ImageType::IndexType idx;
+		double sum = 0.0;
+		size_t n = 0;
+		for ( size_t k = 0; k < m_factor[2]; k++ ) {
+			for ( size_t j = 0; j < m_factor[1]; j++ ) {
+				for ( size_t i = 0; i < m_factor[0]; i++ ) {
+					idx[0] = out[0] * m_factor[0] + i;
+					idx[1] = out[1] * m_factor[1] + j;
+					idx[2] = out[2] * m_factor[2] + k;
+					sum+= m_input->GetPixel( idx )[comp];
+					n++;
+				}
+			}
+		}
+		return sum / n;
+	}
+
+	ImageType::Pointer m_input;
+	ImageType::SizeType m_outsize;
+	ImageType::SpacingType m_outspacing;
+	ImageType::PointType m_outorigin;
+	size_t m_factor[3];
+	static const size_t m_ncomps = 3;
+};
+
+TEST_F( DownsampleAveragingFilterTest, AlignedGridMatchesWindowAverage ) {
+	DownsampleFilter::Pointer ds = this->NewFilter();
+	ds->Update();
+	ImageType::Pointer out = ds->GetOutput();
+
+	ASSERT_EQ( m_ncomps + 1, out->GetNumberOfComponentsPerPixel() );
+	ASSERT_EQ( m_outsize, out->GetLargestPossibleRegion().GetSize() );
+
+	itk::ImageRegionConstIteratorWithIndex< ImageType > it( out, out->GetLargestPossibleRegion() );
+	for ( it.GoToBegin(); !it.IsAtEnd(); ++it ) {
+		ImageType::PixelType px = it.Get();
+		for ( size_t comp = 0; comp < m_ncomps; comp++ ) {
+			EXPECT_NEAR( this->WindowAverage( it.GetIndex(), comp ), px[comp], 1.0e-5 )
+					<< "at " << it.GetIndex() << ", component " << comp;
+		}
+		// No mask: the off-mask component is left empty
+		EXPECT_EQ( 0.0, px[m_ncomps] );
+	}
+}
+
+TEST_F( DownsampleAveragingFilterTest, MaskedVoxels ) {
+	MaskType::Pointer mask = MaskType::New();
+	mask->SetRegions( m_outsize );
+	mask->SetSpacing( m_outspacing );
+	mask->SetOrigin( m_outorigin );
+	mask->Allocate();
+	mask->FillBuffer( 0.0 );
+
+	ImageType::IndexType masked;
+	masked[0] = 1; masked[1] = 2; masked[2] = 3;
+	mask->SetPixel( masked, 1.0 );
+
+	DownsampleFilter::Pointer ds = this->NewFilter();
+	ds->SetMaskImage( mask );
+	ds->Update();
+	ImageType::Pointer out = ds->GetOutput();
+
+	// Masked voxels with any coverage only keep the off-mask flag
+	ImageType::PixelType px = out->GetPixel( masked );
+	for ( size_t comp = 0; comp < m_ncomps; comp++ ) {
+		EXPECT_EQ( 0.0, px[comp] );
+	}
+	EXPECT_EQ( 1.0, px[m_ncomps] );
+
+	ImageType::IndexType other;
+	other.Fill( 0 );
+	px = out->GetPixel( other );
+	for ( size_t comp = 0; comp < m_ncomps; comp++ ) {
+		EXPECT_NEAR( this->WindowAverage( other, comp ), px[comp], 1.0e-5 );
+	}
+	EXPECT_EQ( 0.0, px[m_ncomps] );
+}
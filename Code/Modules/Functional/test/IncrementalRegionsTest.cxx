@@ -0,0 +1,168 @@
+// --------------------------------------------------------------------------------------
+// File:          IncrementalRegionsTest.cxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <itkVectorImage.h>
+#include <itkQuadEdgeMesh.h>
+#include <itkRegularSphereMeshSource.h>
+
+#include "FunctionalBase.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+typedef itk::VectorImage< float, 3u >                                   ImageType;
+typedef FunctionalBase< ImageType >                                     FunctionalType;
+typedef FunctionalType::ScalarContourType                               ContourType;
+typedef itk::RegularSphereMeshSource< ContourType >                     SphereSource;
+typedef FunctionalType::VNLVectorContainer                              VNLVectorContainer;
+typedef FunctionalType::MeasureArray                                    MeasureArray;
+typedef FunctionalType::ROIType                                         ROIType;
+typedef FunctionalType::PriorsImageType                                 PriorsImageType;
+
+class IncrementalRegionsTest : public ::testing::Test {
+public:
+	virtual void SetUp() {
+		ImageType::SizeType size;
+		size.Fill( 40 );
+		m_reference = ImageType::New();
+		m_reference->SetRegions( size );
+		m_reference->SetNumberOfComponentsPerPixel( 2 );
+		m_reference->Allocate();
+
+		// Two channels, a sphere of radius 10 brighter than the background
+		ImageType::IndexType idx;
+		ImageType::PixelType px( 2 );
+		for( size_t i = 0; i < m_reference->GetLargestPossibleRegion().GetNumberOfPixels(); i++ ) {
+			idx = m_reference->ComputeIndex( i );
+			double r2 = 0.0;
+			for( size_t d = 0; d < 3; d++ ) r2+= ( idx[d] - 20.0 ) * ( idx[d] - 20.0 );
+			bool inside = r2 < 100.0;
+			px[0] = ( inside?100.0:30.0 ) + 5.0 * sin( 0.37 * i );
+			px[1] = ( inside?50.0:80.0 ) + 3.0 * cos( 0.11 * i ) + 2.0 * sin( 0.37 * i );
+			m_reference->SetPixel( idx, px );
+		}
+
+		// Prior slightly smaller than the sphere, so that it is not on the optimum
+		SphereSource::PointType center;
+		center.Fill( 20.0 );
+		SphereSource::VectorType scale;
+		scale.Fill( 8.5 );
+		SphereSource::Pointer sphere = SphereSource::New();
+		sphere->SetCenter( center );
+		sphere->SetScale( scale );
+		sphere->SetResolution( 3 );
+		sphere->Update();
+		m_prior = sphere->GetOutput();
+	}
+
+	FunctionalType::Pointer NewFunctional( bool incremental, bool sparse ) {
+		FunctionalType::Pointer f = FunctionalType::New();
+		f->SetReferenceImage( m_reference );
+		f->AddShapePrior( m_prior );
+		f->SetUseIncrementalRegions( incremental );
+		f->SetUseSparseMaps( sparse );
+		f->Initialize();
+		f->GetValue();
+		return f;
+	}
+
+	/** Pushes the vertices with x beyond 23 outwards along x, by up to amplitude at the tip */
+	VNLVectorContainer Displacements( double amplitude ) {
+		size_t npoints = m_prior->GetNumberOfPoints();
+		VNLVectorContainer vals;
+		for( size_t d = 0; d < 3; d++ ) {
+			vals[d].set_size( npoints );
+			vals[d].fill( 0.0 );
+		}
+
+		ContourType::PointsContainerConstIterator p_it = m_prior->GetPoints()->Begin();
+		for( ; p_it != m_prior->GetPoints()->End(); ++p_it ) {
+			double x = p_it.Value()[0];
+			if( x > 23.0 ) {
+				vals[0][p_it.Index()] = amplitude * ( x - 23.0 ) / 5.5;
+			}
+		}
+		return vals;
+	}
+
+	void Move( FunctionalType* f, const VNLVectorContainer& vals ) {
+		f->SetCurrentDisplacements( vals );
+		FunctionalType::ScalesType scales;
+		scales.Fill( 1.0 );
+		std::vector< FunctionalType::PointValueType > grad( 3 * m_prior->GetNumberOfPoints() );
+		f->ComputeDerivative( &grad[0], scales );
+	}
+
+	void ExpectSameState( FunctionalType* inc, FunctionalType* full ) {
+		const ROIType* sinc = inc->GetCurrentRegions();
+		const ROIType* sfull = full->GetCurrentRegions();
+		size_t npix = sfull->GetLargestPossibleRegion().GetNumberOfPixels();
+		size_t mismatch = 0;
+		for( size_t i = 0; i < npix; i++ ) {
+			if( sinc->GetBufferPointer()[i] != sfull->GetBufferPointer()[i] ) mismatch++;
+		}
+		EXPECT_EQ( 0u, mismatch ) << "voxels with a different region";
+
+		PriorsImageType::ConstPointer minc = inc->GetCurrentMaps();
+		PriorsImageType::ConstPointer mfull = full->GetCurrentMaps();
+		ASSERT_EQ( mfull->GetNumberOfComponentsPerPixel(), minc->GetNumberOfComponentsPerPixel() );
+		size_t n = npix * mfull->GetNumberOfComponentsPerPixel();
+		mismatch = 0;
+		for( size_t i = 0; i < n; i++ ) {
+			if( fabs( minc->GetBufferPointer()[i] - mfull->GetBufferPointer()[i] ) > 1.0e-5 ) mismatch++;
+		}
+		EXPECT_EQ( 0u, mismatch ) << "partial volume fractions that differ";
+
+		double value = full->GetValue();
+		EXPECT_NEAR( value, inc->GetValue(), 1.0e-4 * std::max( 1.0, fabs( value ) ) );
+
+		const MeasureArray& vinc = inc->GetRegionVolume();
+		const MeasureArray& vfull = full->GetRegionVolume();
+		const MeasureArray& einc = inc->GetRegionValue();
+		const MeasureArray& efull = full->GetRegionValue();
+		ASSERT_EQ( vfull.Size(), vinc.Size() );
+		for( size_t roi = 0; roi < vfull.Size(); roi++ ) {
+			EXPECT_NEAR( vfull[roi], vinc[roi], 1.0e-4 * std::max( 1.0, vfull[roi] ) ) << "volume of region " << roi;
+			EXPECT_NEAR( efull[roi], einc[roi], 1.0e-4 * std::max( 1.0, fabs( efull[roi] ) ) ) << "energy of region " << roi;
+		}
+	}
+
+	void CompareWithFullRecompute( bool sparse ) {
+		FunctionalType::Pointer inc = this->NewFunctional( true, sparse );
+		FunctionalType::Pointer full = this->NewFunctional( false, sparse );
+		this->ExpectSameState( inc, full );
+
+		// Two steps, so that the second one patches over an already patched state
+		for( size_t step = 1; step <= 2; step++ ) {
+			VNLVectorContainer vals = this->Displacements( 1.5 * step );
+			this->Move( inc, vals );
+			this->Move( full, vals );
+			this->ExpectSameState( inc, full );
+		}
+	}
+
+	ImageType::Pointer m_reference;
+	ContourType::Pointer m_prior;
+};
+
+TEST_F( IncrementalRegionsTest, DenseMapsMatchFullRecompute ) {
+	this->CompareWithFullRecompute( false );
+}
+
+TEST_F( IncrementalRegionsTest, SparseMapsMatchFullRecompute ) {
+	this->CompareWithFullRecompute( true );
+}
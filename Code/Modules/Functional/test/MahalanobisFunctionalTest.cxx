@@ -51,12 +51,269 @@
 #include <itkVTKPolyDataReader.h>
 #include <itkVTKPolyDataWriter.h>
 #include <itkVectorImageToImageAdaptor.h>
+#include <itkMersenneTwisterRandomVariateGenerator.h>
 #include "MahalanobisFunctional.h"
+#include "MahalanobisDistanceModel.h"
 #include "DisplacementFieldFileWriter.h"
 
 using namespace rstk;
 
+// EvaluateBatch must return the energies of Evaluate, pixel by pixel
+int TestEvaluateBatch() {
+	typedef itk::VectorImage<float, 3u>                          ModelImageType;
+	typedef MahalanobisDistanceModel<ModelImageType>             ModelType;
+	typedef ModelType::PriorsImageType                           PriorsType;
+	typedef ModelType::MaskType                                  MaskType;
+
+	ModelImageType::SizeType size; size.Fill( 16 );
+	size_t ncomps = 2;
+	size_t npix = size[0] * size[1] * size[2];
+
+	ModelImageType::Pointer im = ModelImageType::New();
+	im->SetRegions( size );
+	im->SetNumberOfComponentsPerPixel( ncomps );
+	im->Allocate();
+
+	PriorsType::Pointer priors = PriorsType::New();
+	priors->SetRegions( size );
+	priors->SetNumberOfComponentsPerPixel( 3 );  // two regions and the off-mask
+	priors->Allocate();
+
+	MaskType::Pointer mask = MaskType::New();
+	mask->SetRegions( size );
+	mask->Allocate();
+	mask->FillBuffer( 0.0 );
+
+	// Two regions split along x, with correlated and deterministic noise
+	float* x = im->GetBufferPointer();
+	float* w = priors->GetBufferPointer();
+	for( size_t i = 0; i < npix; i++ ) {
+		bool second = ( i % size[0] ) >= size[0] / 2;
+		x[i * ncomps] = ( second?180.0:100.0 ) + 10.0 * sin( 0.37 * i );
+		x[i * ncomps + 1] = ( second?60.0:120.0 ) + 4.0 * cos( 0.11 * i ) + 3.0 * sin( 0.37 * i );
+		w[i * 3] = second?0.0:1.0;
+		w[i * 3 + 1] = second?1.0:0.0;
+		w[i * 3 + 2] = 0.0;
+	}
+
+	ModelType::Pointer model = ModelType::New();
+	model->SetInput( im );
+	model->SetPriorsMap( priors );
+	model->SetMask( mask );
+	model->Update();
+
+	std::vector< ModelType::MeasureType > batch( npix );
+	size_t failed = 0;
+	for( size_t roi = 0; roi < model->GetNumberOfRegions(); roi++ ) {
+		model->EvaluateBatch( x, npix, roi, &batch[0] );
+		for( size_t i = 0; i < npix; i++ ) {
+			ModelImageType::PixelType px( x + i * ncomps, ncomps, false );
+			double e = model->Evaluate( px, roi );
+			if( fabs( e - batch[i] ) > 1.0e-5 * std::max( 1.0, fabs( e ) ) ) {
+				if( failed++ < 10 )
+					std::cerr << "EvaluateBatch mismatch at pixel " << i << ", region " << roi << ": " << batch[i] << " != " << e << std::endl;
+			}
+		}
+	}
+
+	// Outliers: both paths must give the full quadratic form clamped to the
+	// maximum, i.e. the distance at the farthest corner of the range
+	size_t nside = 21;
+	size_t nout = nside * nside;
+	std::vector< float > outliers( nout * ncomps );
+	std::vector< ModelType::MeasureType > obatch( nout );
+	for( size_t roi = 0; roi < model->GetNumberOfRegions(); roi++ ) {
+		const ModelType::MeasurementVectorType& mu = model->GetMeans()[roi];
+		const ModelType::CovarianceMatrixType& cov = model->GetCovariances()[roi];
+		const ModelType::MeasurementVectorType& lo = model->GetRangeLower()[roi];
+		const ModelType::MeasurementVectorType& hi = model->GetRangeUpper()[roi];
+
+		double det = cov(0, 0) * cov(1, 1) - cov(0, 1) * cov(1, 0);
+		double inv[2][2] = { { cov(1, 1) / det, -cov(0, 1) / det }, { -cov(1, 0) / det, cov(0, 0) / det } };
+
+		double dlo[2] = { lo[0] - mu[0], lo[1] - mu[1] };
+		double dhi[2] = { hi[0] - mu[0], hi[1] - mu[1] };
+		double maxlo = 0.0, maxhi = 0.0;
+		for( size_t r = 0; r < 2; r++ ) {
+			for( size_t c = 0; c < 2; c++ ) {
+				maxlo+= dlo[r] * inv[r][c] * dlo[c];
+				maxhi+= dhi[r] * inv[r][c] * dhi[c];
+			}
+		}
+		double maxval = std::max( maxlo, maxhi );
+
+		// Grid over twice the range around the mean, so that many samples
+		// are beyond the maximum in one component and not in the other
+		for( size_t j = 0; j < nside; j++ ) {
+			for( size_t i = 0; i < nside; i++ ) {
+				float* o = &outliers[( j * nside + i ) * ncomps];
+				o[0] = mu[0] + ( 2.0 * i / ( nside - 1 ) - 1.0 ) * 2.0 * ( hi[0] - lo[0] );
+				o[1] = mu[1] + ( 2.0 * j / ( nside - 1 ) - 1.0 ) * 2.0 * ( hi[1] - lo[1] );
+			}
+		}
+
+		model->EvaluateBatch( &outliers[0], nout, roi, &obatch[0] );
+		for( size_t i = 0; i < nout; i++ ) {
+			const float* o = &outliers[i * ncomps];
+			double d[2] = { o[0] - mu[0], o[1] - mu[1] };
+			double expected = 0.0;
+			for( size_t r = 0; r < 2; r++ ) {
+				for( size_t c = 0; c < 2; c++ ) {
+					expected+= d[r] * inv[r][c] * d[c];
+				}
+			}
+			expected = std::min( expected, maxval );
+
+			ModelImageType::PixelType px( &outliers[i * ncomps], ncomps, false );
+			double e = model->Evaluate( px, roi );
+			double tol = 1.0e-4 * std::max( 1.0, expected );
+			if( fabs( e - expected ) > tol || fabs( obatch[i] - expected ) > tol ) {
+				if( failed++ < 10 )
+					std::cerr << "Outlier mismatch at sample " << i << ", region " << roi << ": Evaluate=" << e << ", EvaluateBatch=" << obatch[i] << ", expected=" << expected << std::endl;
+			}
+		}
+	}
+	return ( failed == 0 )?EXIT_SUCCESS:EXIT_FAILURE;
+}
+
+// EstimateRobust must match the WeightedCovarianceSampleFilter estimate
+// up to the width of the bins of its percentile histograms
+int TestEstimateRobust() {
+	typedef itk::VectorImage<float, 3u>                          ModelImageType;
+	typedef MahalanobisDistanceModel<ModelImageType>             ModelType;
+	typedef ModelType::PriorsImageType                           PriorsType;
+	typedef ModelType::MaskType                                  MaskType;
+	typedef ModelType::ReferenceSampleType                       SampleType;
+	typedef ModelType::CovarianceFilter                          CovarianceFilter;
+	typedef ModelType::WeightArrayType                           WeightArrayType;
+	typedef itk::Statistics::MersenneTwisterRandomVariateGenerator RandomGenerator;
+
+	ModelImageType::SizeType size; size.Fill( 24 );
+	size_t ncomps = 2;
+	size_t nregions = 2;
+	size_t npix = size[0] * size[1] * size[2];
+
+	ModelImageType::Pointer im = ModelImageType::New();
+	im->SetRegions( size );
+	im->SetNumberOfComponentsPerPixel( ncomps );
+	im->Allocate();
+
+	PriorsType::Pointer priors = PriorsType::New();
+	priors->SetRegions( size );
+	priors->SetNumberOfComponentsPerPixel( nregions + 1 );
+	priors->Allocate();
+
+	MaskType::Pointer mask = MaskType::New();
+	mask->SetRegions( size );
+	mask->Allocate();
+	mask->FillBuffer( 0.0 );
+
+	// Two regions with correlated gaussian noise, blended along x,
+	// and a slab of voxels with no data
+	RandomGenerator::Pointer rng = RandomGenerator::New();
+	rng->Initialize( 1234 );
+	float* x = im->GetBufferPointer();
+	float* w = priors->GetBufferPointer();
+	for( size_t i = 0; i < npix; i++ ) {
+		size_t ix = i % size[0];
+		double w1 = std::min( 1.0, std::max( 0.0, ( ix - 10.0 ) / 4.0 ) );
+		double n0 = rng->GetNormalVariate();
+		double n1 = rng->GetNormalVariate();
+		bool second = rng->GetUniformVariate( 0.0, 1.0 ) < w1;
+		x[i * ncomps] = ( second?180.0:100.0 ) + 12.0 * n0;
+		x[i * ncomps + 1] = ( second?60.0:120.0 ) + 4.0 * n1 + 6.0 * n0;
+		w[i * 3] = 1.0 - w1;
+		w[i * 3 + 1] = w1;
+		w[i * 3 + 2] = 0.0;
+
+		if( i / ( size[0] * size[1] ) == 0 ) {
+			x[i * ncomps] = 0.0;
+			x[i * ncomps + 1] = 0.0;
+		}
+	}
+
+	ModelType::Pointer model = ModelType::New();
+	model->SetInput( im );
+	model->SetPriorsMap( priors );
+	model->SetMask( mask );
+	model->Update();
+
+	// Bins span the range of each component over voxels with weight >= 0.9
+	std::vector< double > lo( ncomps, itk::NumericTraits< double >::max() );
+	std::vector< double > hi( ncomps, itk::NumericTraits< double >::NonpositiveMin() );
+	for( size_t i = 0; i < npix; i++ ) {
+		if( x[i * ncomps] == 0 && x[i * ncomps + 1] == 0 ) continue;
+		if( w[i * 3] < 0.9 && w[i * 3 + 1] < 0.9 ) continue;
+		for( size_t c = 0; c < ncomps; c++ ) {
+			lo[c] = std::min< double >( lo[c], x[i * ncomps + c] );
+			hi[c] = std::max< double >( hi[c], x[i * ncomps + c] );
+		}
+	}
+
+	SampleType::Pointer sample = SampleType::New();
+	sample->SetImage( im );
+
+	size_t failed = 0;
+	for( size_t roi = 0; roi < nregions; roi++ ) {
+		WeightArrayType weights;
+		weights.SetSize( npix );
+		for( size_t i = 0; i < npix; i++ ) {
+			bool empty = ( x[i * ncomps] == 0 && x[i * ncomps + 1] == 0 );
+			weights[i] = empty?0.0:w[i * 3 + roi];
+		}
+
+		CovarianceFilter::Pointer covFilter = CovarianceFilter::New();
+		covFilter->SetInput( sample );
+		covFilter->SetWeights( weights );
+		covFilter->Update();
+
+		CovarianceFilter::MeasurementVectorRealType mean = covFilter->GetMean();
+		CovarianceFilter::MatrixType cov = covFilter->GetCovarianceMatrix();
+		CovarianceFilter::MeasurementVectorRealType bottom = covFilter->GetRangeMin();
+		CovarianceFilter::MeasurementVectorRealType top = covFilter->GetRangeMax();
+
+		const ModelType::MeasurementVectorType& rmean = model->GetMeans()[roi];
+		const ModelType::CovarianceMatrixType& rcov = model->GetCovariances()[roi];
+		const ModelType::MeasurementVectorType& rbottom = model->GetRangeLower()[roi];
+		const ModelType::MeasurementVectorType& rtop = model->GetRangeUpper()[roi];
+
+		for( size_t r = 0; r < ncomps; r++ ) {
+			// Percentiles are read from the histograms within one bin
+			double width = ( hi[r] - lo[r] ) / 2048.0;
+			if( fabs( bottom[r] - rbottom[r] ) > width || fabs( top[r] - rtop[r] ) > width ) {
+				failed++;
+				std::cerr << "EstimateRobust range mismatch in region " << roi << ", component " << r << ": ["
+						<< rbottom[r] << ", " << rtop[r] << "] != [" << bottom[r] << ", " << top[r] << "]" << std::endl;
+			}
+
+			// Samples within one bin of the percentiles may be rejected differently
+			if( fabs( mean[r] - rmean[r] ) > 0.01 * sqrt( cov( r, r ) ) ) {
+				failed++;
+				std::cerr << "EstimateRobust mean mismatch in region " << roi << ", component " << r << ": "
+						<< rmean[r] << " != " << mean[r] << std::endl;
+			}
+
+			for( size_t c = 0; c < ncomps; c++ ) {
+				if( fabs( cov( r, c ) - rcov( r, c ) ) > 0.02 * sqrt( cov( r, r ) * cov( c, c ) ) ) {
+					failed++;
+					std::cerr << "EstimateRobust covariance mismatch in region " << roi << " at (" << r << ", " << c << "): "
+							<< rcov( r, c ) << " != " << cov( r, c ) << std::endl;
+				}
+			}
+		}
+	}
+	return ( failed == 0 )?EXIT_SUCCESS:EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
+	if( TestEvaluateBatch() != EXIT_SUCCESS ) {
+		return EXIT_FAILURE;
+	}
+
+	if( TestEstimateRobust() != EXIT_SUCCESS ) {
+		return EXIT_FAILURE;
+	}
+
 	typedef itk::Vector<float, 1u>               VectorPixelType;
 	typedef itk::Image<VectorPixelType, 3u>      ImageType;
 	typedef MahalanobisFunctional<ImageType>      FunctionalType;
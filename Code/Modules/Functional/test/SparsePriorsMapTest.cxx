@@ -0,0 +1,144 @@
+// --------------------------------------------------------------------------------------
+// File:          SparsePriorsMapTest.cxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+
+#include "gtest/gtest.h"
+
+#include <vector>
+#include <itkVectorImage.h>
+
+#include "SparsePriorsMap.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+typedef SparsePriorsMap< float, 3u >                                    SparseMapType;
+typedef SparseMapType::PriorsImageType                                  PriorsImageType;
+typedef SparseMapType::IndexType                                        IndexType;
+
+class SparsePriorsMapTest : public ::testing::Test {
+public:
+	virtual void SetUp() {
+		m_ncomps = 4;
+		PriorsImageType::SizeType size;
+		size[0] = 9; size[1] = 7; size[2] = 5;
+
+		m_dense = PriorsImageType::New();
+		m_dense->SetRegions( size );
+		m_dense->SetNumberOfComponentsPerPixel( m_ncomps );
+		m_dense->Allocate();
+
+		// One-hot voxels of every region, empty voxels and boundary voxels
+		float* w = m_dense->GetBufferPointer();
+		size_t npix = m_dense->GetLargestPossibleRegion().GetNumberOfPixels();
+		m_nboundary = 0;
+		for ( size_t i = 0; i < npix; i++ ) {
+			float* p = w + i * m_ncomps;
+			std::fill( p, p + m_ncomps, 0.0 );
+			switch ( i % 7 ) {
+			case 0:
+				break;
+			case 3:
+			case 5:
+				p[i % m_ncomps] = 0.25;
+				p[( i + 1 ) % m_ncomps] = 0.75;
+				m_nboundary++;
+				break;
+			default:
+				p[( i / 7 ) % m_ncomps] = 1.0;
+			}
+		}
+	}
+
+	void ExpectEqualMaps( const PriorsImageType* expected, const PriorsImageType* actual ) {
+		ASSERT_EQ( expected->GetLargestPossibleRegion(), actual->GetLargestPossibleRegion() );
+		ASSERT_EQ( expected->GetNumberOfComponentsPerPixel(), actual->GetNumberOfComponentsPerPixel() );
+		size_t n = expected->GetLargestPossibleRegion().GetNumberOfPixels() * m_ncomps;
+		const float* a = expected->GetBufferPointer();
+		const float* b = actual->GetBufferPointer();
+		for ( size_t i = 0; i < n; i++ ) {
+			EXPECT_EQ( a[i], b[i] ) << "at voxel " << i / m_ncomps << ", component " << i % m_ncomps;
+		}
+	}
+
+	PriorsImageType::Pointer m_dense;
+	size_t m_nboundary;
+	size_t m_ncomps;
+};
+
+TEST_F( SparsePriorsMapTest, RoundTrip ) {
+	SparseMapType::Pointer sparse = SparseMapType::New();
+	sparse->SetFromImage( m_dense );
+
+	EXPECT_EQ( m_ncomps, sparse->GetNumberOfComponents() );
+	EXPECT_EQ( m_nboundary, sparse->GetNumberOfBoundaryVoxels() );
+	this->ExpectEqualMaps( m_dense, sparse->ToImage() );
+}
+
+TEST_F( SparsePriorsMapTest, GetFractionsAcrossRows ) {
+	SparseMapType::Pointer sparse = SparseMapType::New();
+	sparse->SetFromImage( m_dense );
+
+	// Start in the middle of a row and span three rows
+	size_t offset = 5;
+	size_t n = 2 * 9 + 7;
+	std::vector< float > out( n * m_ncomps );
+	sparse->GetFractions( offset, n, &out[0] );
+
+	const float* w = m_dense->GetBufferPointer() + offset * m_ncomps;
+	for ( size_t i = 0; i < n * m_ncomps; i++ ) {
+		EXPECT_EQ( w[i], out[i] ) << "at voxel " << offset + i / m_ncomps;
+	}
+}
+
+TEST_F( SparsePriorsMapTest, SetRowSegment ) {
+	SparseMapType::Pointer sparse = SparseMapType::New();
+	sparse->SetFromImage( m_dense );
+
+	// Replace the middle of a row: boundary voxels become one-hot or empty, and
+	// one-hot voxels become boundary. The rest of the row must be kept.
+	IndexType first;
+	first[0] = 2; first[1] = 3; first[2] = 1;
+	size_t nx = 5;
+	std::vector< float > segment( nx * m_ncomps, 0.0 );
+	for ( size_t i = 0; i < nx; i++ ) {
+		float* p = &segment[i * m_ncomps];
+		if ( i % 2 ) {
+			p[i % m_ncomps] = 0.5;
+			p[( i + 2 ) % m_ncomps] = 0.5;
+		} else if ( i != 2 ) {
+			p[m_ncomps - 1] = 1.0;
+		}
+	}
+	sparse->SetRow( first, nx, &segment[0] );
+
+	float* w = m_dense->GetBufferPointer() + m_dense->ComputeOffset( first ) * m_ncomps;
+	std::copy( segment.begin(), segment.end(), w );
+
+	std::vector< float > row( 9 * m_ncomps );
+	IndexType start = first;
+	start[0] = 0;
+	sparse->GetRow( start, 9, &row[0] );
+	const float* expected = m_dense->GetBufferPointer() + m_dense->ComputeOffset( start ) * m_ncomps;
+	for ( size_t i = 0; i < row.size(); i++ ) {
+		EXPECT_EQ( expected[i], row[i] ) << "at x = " << i / m_ncomps << ", component " << i % m_ncomps;
+	}
+
+	this->ExpectEqualMaps( m_dense, sparse->ToImage() );
+
+	// Setting the same segment again must not duplicate entries
+	size_t nboundary = sparse->GetNumberOfBoundaryVoxels();
+	sparse->SetRow( first, nx, &segment[0] );
+	EXPECT_EQ( nboundary, sparse->GetNumberOfBoundaryVoxels() );
+	this->ExpectEqualMaps( m_dense, sparse->ToImage() );
+}
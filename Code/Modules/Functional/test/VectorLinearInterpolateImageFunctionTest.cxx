@@ -0,0 +1,149 @@
+// --------------------------------------------------------------------------------------
+// File:          VectorLinearInterpolateImageFunctionTest.cxx
+// Date:          Oct 16, 2026
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <vector>
+#include <itkImage.h>
+#include <itkVectorImage.h>
+#include <itkLinearInterpolateImageFunction.h>
+#include <itkVectorIndexSelectionCastImageFilter.h>
+
+#include "VectorLinearInterpolateImageFunction.h"
+
+using namespace rstk;
+
+int main(int argc, char **argv) {
+    ::testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+typedef itk::VectorImage< float, 3u >                                   VectorImageType;
+typedef itk::Image< float, 3u >                                         ScalarImageType;
+typedef VectorLinearInterpolateImageFunction< VectorImageType >         VectorInterpolator;
+typedef VectorInterpolator::ContinuousIndexType                         CIndex;
+typedef itk::LinearInterpolateImageFunction< ScalarImageType >          ScalarInterpolator;
+typedef itk::VectorIndexSelectionCastImageFilter
+		< VectorImageType, ScalarImageType >                            SelectFilter;
+
+class VectorLinearInterpolateImageFunctionTest : public ::testing::Test {
+public:
+	VectorImageType::Pointer NewImage( size_t ncomps ) {
+		VectorImageType::SizeType size;
+		size[0] = 7; size[1] = 6; size[2] = 5;
+
+		VectorImageType::Pointer im = VectorImageType::New();
+		im->SetRegions( size );
+		im->SetNumberOfComponentsPerPixel( ncomps );
+		im->Allocate();
+
+		float* buffer = im->GetBufferPointer();
+		size_t npix = im->GetLargestPossibleRegion().GetNumberOfPixels();
+		for ( size_t i = 0; i < npix * ncomps; i++ ) {
+			buffer[i] = 10.0 * sin( 0.7 * i ) + 0.1 * i;
+		}
+		return im;
+	}
+
+	/** Points on the grid, between nodes and on every face and corner of the domain */
+	std::vector< CIndex > SamplePoints( const VectorImageType* im ) {
+		VectorImageType::SizeType size = im->GetLargestPossibleRegion().GetSize();
+		std::vector< CIndex > points;
+		CIndex c;
+
+		const double steps[5] = { 0.0, 0.25, 0.5, 0.9, 1.0 };
+		for ( size_t k = 0; k < 5; k++ ) {
+			for ( size_t j = 0; j < 5; j++ ) {
+				for ( size_t i = 0; i < 5; i++ ) {
+					c[0] = steps[i] * ( size[0] - 1 );
+					c[1] = steps[j] * ( size[1] - 1 );
+					c[2] = steps[k] * ( size[2] - 1 );
+					points.push_back( c );
+				}
+			}
+		}
+
+		for ( size_t n = 0; n < 50; n++ ) {
+			for ( size_t d = 0; d < 3; d++ ) {
+				c[d] = fmod( 0.37 * ( n + 1 ) * ( d + 2 ), size[d] - 1.0 );
+			}
+			points.push_back( c );
+		}
+		return points;
+	}
+
+	void CompareWithScalarInterpolator( size_t ncomps ) {
+		VectorImageType::Pointer im = this->NewImage( ncomps );
+		std::vector< CIndex > points = this->SamplePoints( im );
+		size_t npoints = points.size();
+
+		VectorInterpolator::Pointer interp = VectorInterpolator::New();
+		interp->SetInputImage( im );
+
+		std::vector< float > batch( npoints * ncomps );
+		interp->EvaluateBatchAtContinuousIndex( &points[0], npoints, &batch[0] );
+
+		for ( size_t k = 0; k < ncomps; k++ ) {
+			SelectFilter::Pointer select = SelectFilter::New();
+			select->SetInput( im );
+			select->SetIndex( k );
+			select->Update();
+
+			ScalarInterpolator::Pointer scalar = ScalarInterpolator::New();
+			scalar->SetInputImage( select->GetOutput() );
+
+			for ( size_t i = 0; i < npoints; i++ ) {
+				EXPECT_NEAR( scalar->EvaluateAtContinuousIndex( points[i] ), batch[k * npoints + i], 1.0e-4 )
+						<< "at " << points[i] << ", component " << k;
+			}
+		}
+	}
+};
+
+TEST_F( VectorLinearInterpolateImageFunctionTest, BatchMatchesScalarFixedLength ) {
+	this->CompareWithScalarInterpolator( 3 );
+}
+
+TEST_F( VectorLinearInterpolateImageFunctionTest, BatchMatchesScalarVariableLength ) {
+	this->CompareWithScalarInterpolator( 8 );
+}
+
+TEST_F( VectorLinearInterpolateImageFunctionTest, BatchMatchesPointwiseOnBorders ) {
+	VectorImageType::Pointer im = this->NewImage( 2 );
+	VectorImageType::SizeType size = im->GetLargestPossibleRegion().GetSize();
+	size_t ncomps = 2;
+
+	// Up to half a voxel out of the first and last nodes, where neighbors are clamped
+	std::vector< CIndex > points = this->SamplePoints( im );
+	CIndex c;
+	const double offsets[4] = { -0.5, -0.2, 0.2, 0.49 };
+	for ( size_t o = 0; o < 4; o++ ) {
+		for ( size_t d = 0; d < 3; d++ ) {
+			c.Fill( 1.5 );
+			c[d] = ( offsets[o] < 0 )?offsets[o]:( size[d] - 1 + offsets[o] );
+			points.push_back( c );
+		}
+	}
+	size_t npoints = points.size();
+
+	VectorInterpolator::Pointer interp = VectorInterpolator::New();
+	interp->SetInputImage( im );
+
+	std::vector< float > batch( npoints * ncomps );
+	interp->EvaluateBatchAtContinuousIndex( &points[0], npoints, &batch[0] );
+
+	for ( size_t i = 0; i < npoints; i++ ) {
+		VectorInterpolator::OutputType v = interp->EvaluateAtContinuousIndex( points[i] );
+		for ( size_t k = 0; k < ncomps; k++ ) {
+			EXPECT_NEAR( v[k], batch[k * npoints + i], 1.0e-4 ) << "at " << points[i] << ", component " << k;
+		}
+	}
+}
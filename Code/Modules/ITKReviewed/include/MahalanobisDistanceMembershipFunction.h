@@ -18,6 +18,7 @@
 #ifndef __MahalanobisDistanceMembershipFunction_h
 #define __MahalanobisDistanceMembershipFunction_h
 
+#include <vector>
 #include <itkVariableSizeMatrix.h>
 #include <itkMembershipFunctionBase.h>
 
@@ -112,6 +113,16 @@ public:
    * distance is returned. */
   double Evaluate(const MeasurementVectorType & measurement) const;
 
+  /**
+   * Evaluate nsamples measurements stored one after the other (as in the
+   * buffer of a VectorImage), writing the squared distances in out. It uses
+   * the Cholesky factor of the inverse covariance and processes the samples
+   * in blocks, so that the inner loops run over samples. Results are clamped
+   * to MaximumValue. Measurements of up to 6 components use kernels
+   * specialized for their length, with no heap allocation. */
+  template< typename TValue >
+  void EvaluateBatch(const TValue* samples, size_t nsamples, double* out) const;
+
   /** Method to clone a membership function, i.e. create a new instance of
    * the same type of membership function and configure its ivars to
    * match. */
@@ -149,6 +160,17 @@ private:
   // when covariace matirx is set.
   CovarianceMatrixType m_InverseCovariance;
 
+  // upper triangular U, row-major, such that InverseCovariance = U^t * U.
+  // Empty if the inverse covariance is not positive definite.
+  std::vector< double > m_CholeskyFactor;
+
+  void ComputeCholeskyFactor();
+
+  /** Blocked evaluation behind EvaluateBatch. VComponents is the length
+   * of the measurements when known at compile time, 0 otherwise. */
+  template< unsigned int VComponents, typename TValue >
+  void EvaluateBlocks(const TValue* samples, size_t nsamples, double* out) const;
+
   /** Boolean to cache whether the covarinace is singular or nearly singular */
   bool m_CovarianceNonsingular;
 };
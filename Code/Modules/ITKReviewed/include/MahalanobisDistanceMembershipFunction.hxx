@@ -22,10 +22,14 @@
 
 #include <itkLightObject.h>
 #include <math.h>
+#include <algorithm>
 #include <vnl/vnl_math.h>
 #include <vnl/vnl_vector.h>
 #include <vnl/vnl_matrix.h>
 #include <vnl/algo/vnl_matrix_inverse.h>
+#include <vnl/algo/vnl_cholesky.h>
+
+#define MAHALANOBIS_BATCH_BLOCK 16
 
 namespace rstk {
 template<typename TVector>
@@ -47,6 +51,7 @@ MahalanobisDistanceMembershipFunction<TVector>::MahalanobisDistanceMembershipFun
 	m_Covariance.SetIdentity();
 	m_InverseCovariance = m_Covariance;
 	m_CovarianceNonsingular = true;
+	this->ComputeCholeskyFactor();
 
 	m_MaximumValue = itk::NumericTraits<double>::max();
 }
@@ -149,11 +154,36 @@ void MahalanobisDistanceMembershipFunction<TVector>::SetCovariance(
 		m_InverseCovariance *= aLargeDouble;
 	}
 
+	this->ComputeCholeskyFactor();
 	this->Modified();
 }
 
+template<typename TVector>
+void MahalanobisDistanceMembershipFunction<TVector>::ComputeCholeskyFactor() {
+	const unsigned int n = m_InverseCovariance.Rows();
+	m_CholeskyFactor.clear();
+	if (n == 0) {
+		return;
+	}
+
+	vnl_cholesky chol(m_InverseCovariance.GetVnlMatrix(), vnl_cholesky::quiet);
+	if (chol.rank_deficiency() > 0) {
+		// EvaluateBatch falls back to Evaluate
+		return;
+	}
+
+	vnl_matrix<double> L = chol.lower_triangle();
+	m_CholeskyFactor.resize(n * n, 0.0);
+	for (unsigned int r = 0; r < n; ++r) {
+		for (unsigned int c = r; c < n; ++c) {
+			m_CholeskyFactor[r * n + c] = L(c, r);
+		}
+	}
+}
+
 template<typename TVector>
 void MahalanobisDistanceMembershipFunction<TVector>::Initialize() {
+	m_MaximumValue = itk::NumericTraits<double>::max();
 	double uppertmp = Evaluate(m_RangeMax);
 	double lowertmp = Evaluate(m_RangeMin);
 
@@ -181,12 +211,92 @@ double MahalanobisDistanceMembershipFunction<TVector>::Evaluate(
 			rowdot += m_InverseCovariance(r, c) * (measurement[c] - m_Mean[c]);
 		}
 		temp += rowdot * (measurement[r] - m_Mean[r]);
+	}
+
+	// Partial sums are not monotonic, clamp only the full form as EvaluateBatch does
+	return (temp > m_MaximumValue) ? m_MaximumValue : temp;
+}
 
-		if (temp > m_MaximumValue)
-			return m_MaximumValue;
+template<typename TVector>
+template<typename TValue>
+void MahalanobisDistanceMembershipFunction<TVector>::EvaluateBatch(
+		const TValue* samples, size_t nsamples, double* out) const {
+	const size_t n = this->GetMeasurementVectorSize();
+
+	if (m_CholeskyFactor.empty()) {
+		MeasurementVectorType x;
+		itk::NumericTraits<MeasurementVectorType>::SetLength(x, n);
+		for (size_t s = 0; s < nsamples; ++s) {
+			for (size_t c = 0; c < n; ++c) {
+				x[c] = samples[s * n + c];
+			}
+			out[s] = this->Evaluate(x);
+		}
+		return;
+	}
+
+	switch (n) {
+	case 1: this->template EvaluateBlocks<1, TValue>(samples, nsamples, out); break;
+	case 2: this->template EvaluateBlocks<2, TValue>(samples, nsamples, out); break;
+	case 3: this->template EvaluateBlocks<3, TValue>(samples, nsamples, out); break;
+	case 4: this->template EvaluateBlocks<4, TValue>(samples, nsamples, out); break;
+	case 5: this->template EvaluateBlocks<5, TValue>(samples, nsamples, out); break;
+	case 6: this->template EvaluateBlocks<6, TValue>(samples, nsamples, out); break;
+	default: this->template EvaluateBlocks<0, TValue>(samples, nsamples, out);
 	}
+}
 
-	return temp;
+template<typename TVector>
+template<unsigned int VComponents, typename TValue>
+void MahalanobisDistanceMembershipFunction<TVector>::EvaluateBlocks(
+		const TValue* samples, size_t nsamples, double* out) const {
+	const size_t n = (VComponents > 0) ? VComponents : this->GetMeasurementVectorSize();
+
+	// d^2 = || U * ( x - mean ) ||^2, computed for a block of samples at a time.
+	// Samples are transposed into diff so that the loops over s vectorize.
+	// With a fixed length, diff lives on the stack and the loops over
+	// components have constant trip counts.
+	const size_t B = MAHALANOBIS_BATCH_BLOCK;
+	const double* U = &m_CholeskyFactor[0];
+	double fixeddiff[(VComponents > 0 ? VComponents : 1) * MAHALANOBIS_BATCH_BLOCK];
+	std::vector<double> vardiff;
+	double* diff = fixeddiff;
+	if (VComponents == 0) {
+		vardiff.resize(n * B);
+		diff = &vardiff[0];
+	}
+	std::fill(diff, diff + n * B, 0.0);
+
+	double acc[MAHALANOBIS_BATCH_BLOCK];
+	double sum[MAHALANOBIS_BATCH_BLOCK];
+
+	for (size_t first = 0; first < nsamples; first += B) {
+		const size_t nb = std::min(B, nsamples - first);
+		const TValue* x = samples + first * n;
+		for (size_t s = 0; s < nb; ++s) {
+			for (size_t c = 0; c < n; ++c) {
+				diff[c * B + s] = x[s * n + c] - m_Mean[c];
+			}
+		}
+
+		for (size_t s = 0; s < B; ++s) sum[s] = 0.0;
+		for (size_t r = 0; r < n; ++r) {
+			for (size_t s = 0; s < B; ++s) acc[s] = 0.0;
+			for (size_t c = r; c < n; ++c) {
+				const double u = U[r * n + c];
+				const double* d = &diff[c * B];
+				for (size_t s = 0; s < B; ++s) acc[s] += u * d[s];
+			}
+			for (size_t s = 0; s < B; ++s) sum[s] += acc[s] * acc[s];
+		}
+
+		for (size_t s = 0; s < B; ++s) {
+			sum[s] = (sum[s] > m_MaximumValue) ? m_MaximumValue : sum[s];
+		}
+		for (size_t s = 0; s < nb; ++s) {
+			out[first + s] = sum[s];
+		}
+	}
 }
 
 template<typename TVector>
@@ -258,6 +368,7 @@ void MahalanobisDistanceMembershipFunction<TVector>::UpdateVectorSize() {
 			m_Covariance.SetIdentity();
 			m_InverseCovariance = m_Covariance;
 			m_CovarianceNonsingular = true;
+			this->ComputeCholeskyFactor();
 			this->Modified();
 		}
 	}
@@ -76,6 +76,11 @@ public:
   /** Output type is Vector<double,Dimension> */
   typedef typename Superclass::OutputType OutputType;
 
+  /** Point typedef support. */
+  typedef typename Superclass::PointType PointType;
+
+  using Superclass::Evaluate;
+
   /** Evaluate the function at a ContinuousIndex position
    *
    * Returns the linearly interpolated image intensity at a
@@ -87,6 +92,36 @@ public:
   virtual OutputType EvaluateAtContinuousIndex(
     const ContinuousIndexType & index) const;
 
+  /** Evaluate the function at a ContinuousIndex position, writing the
+   * interpolated components in out, which must hold as many values as
+   * components per pixel. No output vector is allocated. */
+  template< typename TValue >
+  void EvaluateAtContinuousIndex(const ContinuousIndexType & index, TValue * out) const
+  {
+    this->EvaluateBatchAtContinuousIndex(&index, 1, out);
+  }
+
+  /** Evaluate the function at npoints ContinuousIndex positions. The
+   * components are written in structure-of-arrays layout: component k
+   * of point i goes to out[k * npoints + i]. Neighbours are read through
+   * the buffer pointer and the image offset table, and images of up to
+   * 6 components use kernels specialized for their length. As in
+   * EvaluateAtContinuousIndex, no bounds checking is done. Requires a
+   * VectorImage input. */
+  template< typename TValue >
+  void EvaluateBatchAtContinuousIndex(const ContinuousIndexType * index, size_t npoints, TValue * out) const;
+
+  /** Evaluate the function at a point, writing the interpolated
+   * components in out (see above). */
+  template< typename TValue >
+  void Evaluate(const PointType & point, TValue * out) const
+  {
+    ContinuousIndexType index;
+
+    this->GetInputImage()->TransformPhysicalPointToContinuousIndex(point, index);
+    this->EvaluateAtContinuousIndex(index, out);
+  }
+
 protected:
   VectorLinearInterpolateImageFunction();
   ~VectorLinearInterpolateImageFunction(){}
@@ -98,6 +133,11 @@ private:
   void operator=(const Self &);                       //purposely not
                                                       // implemented
 
+  /** Batch interpolation kernel. VComponents is the number of components
+   * when known at compile time, 0 otherwise. */
+  template< unsigned int VComponents, typename TValue >
+  void InterpolateBatch(const ContinuousIndexType * index, size_t npoints, TValue * out) const;
+
   /** Number of neighbors used in the interpolation */
   static const unsigned long m_Neighbors;
 };
@@ -20,6 +20,7 @@
 
 #include "VectorLinearInterpolateImageFunction.h"
 
+#include <vector>
 #include "vnl/vnl_math.h"
 
 namespace rstk
@@ -142,6 +143,128 @@ VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
 
   return ( output );
 }
+
+/**
+ * Evaluate at a batch of image index positions
+ */
+template< typename TInputImage, typename TCoordRep >
+template< typename TValue >
+void
+VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::EvaluateBatchAtContinuousIndex(
+  const ContinuousIndexType * index, size_t npoints, TValue * out) const
+{
+  switch ( this->GetInputImage()->GetNumberOfComponentsPerPixel() )
+    {
+    case 1: this->template InterpolateBatch< 1, TValue >(index, npoints, out); break;
+    case 2: this->template InterpolateBatch< 2, TValue >(index, npoints, out); break;
+    case 3: this->template InterpolateBatch< 3, TValue >(index, npoints, out); break;
+    case 4: this->template InterpolateBatch< 4, TValue >(index, npoints, out); break;
+    case 5: this->template InterpolateBatch< 5, TValue >(index, npoints, out); break;
+    case 6: this->template InterpolateBatch< 6, TValue >(index, npoints, out); break;
+    default: this->template InterpolateBatch< 0, TValue >(index, npoints, out);
+    }
+}
+
+/**
+ * Batch interpolation kernel. Same weighting and border handling as
+ * EvaluateAtContinuousIndex, with neighbours addressed by offset.
+ */
+template< typename TInputImage, typename TCoordRep >
+template< unsigned int VComponents, typename TValue >
+void
+VectorLinearInterpolateImageFunction< TInputImage, TCoordRep >
+::InterpolateBatch(
+  const ContinuousIndexType * index, size_t npoints, TValue * out) const
+{
+  typedef typename TInputImage::InternalPixelType InternalPixelType;
+
+  const TInputImage * const inputImgPtr=this->GetInputImage();
+  const unsigned int ncomps = ( VComponents > 0 )? VComponents : inputImgPtr->GetNumberOfComponentsPerPixel();
+  const InternalPixelType * const buffer = inputImgPtr->GetBufferPointer();
+
+  // Strides of the buffer in number of values, and its first index
+  const itk::OffsetValueType * offsetTable = inputImgPtr->GetOffsetTable();
+  const IndexType bufferStart = inputImgPtr->GetBufferedRegion().GetIndex();
+  itk::OffsetValueType strides[ImageDimension];
+  for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+    {
+    strides[dim] = offsetTable[dim] * ncomps;
+    }
+
+  // Accumulators, on the stack when the number of components is fixed
+  InternalComputationType fixedOutput[ ( VComponents > 0 )? VComponents : 1 ];
+  std::vector< InternalComputationType > varOutput;
+  InternalComputationType * output = fixedOutput;
+  if ( VComponents == 0 )
+    {
+    varOutput.resize(ncomps);
+    output = &varOutput[0];
+    }
+
+  itk::OffsetValueType    offsets[ImageDimension][2];
+  InternalComputationType weights[ImageDimension][2];
+
+  for ( size_t i = 0; i < npoints; ++i )
+    {
+    const ContinuousIndexType & cidx = index[i];
+
+    for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+      {
+      const itk::IndexValueType base = itk::Math::Floor< itk::IndexValueType >(cidx[dim]);
+      const InternalComputationType distance = cidx[dim] - static_cast< InternalComputationType >( base );
+
+      // Take care of the pixels just in the outer boundaries of the grid
+      itk::IndexValueType lower = base;
+      if ( lower < this->m_StartIndex[dim] )
+        {
+        lower = this->m_StartIndex[dim];
+        }
+      itk::IndexValueType upper = base + 1;
+      if ( upper > this->m_EndIndex[dim] )
+        {
+        upper = this->m_EndIndex[dim];
+        }
+
+      offsets[dim][0] = ( lower - bufferStart[dim] ) * strides[dim];
+      offsets[dim][1] = ( upper - bufferStart[dim] ) * strides[dim];
+      weights[dim][0] = 1.0 - distance;
+      weights[dim][1] = distance;
+      }
+
+    for ( unsigned int k = 0; k < ncomps; ++k )
+      {
+      output[k] = 0.0;
+      }
+
+    for ( unsigned int counter = 0; counter < m_Neighbors; ++counter )
+      {
+      InternalComputationType overlap = 1.0;
+      itk::OffsetValueType    offset = 0;
+      unsigned int upper = counter;  // each bit indicates upper/lower neighbour
+      for ( unsigned int dim = 0; dim < ImageDimension; ++dim )
+        {
+        overlap *= weights[dim][upper & 1];
+        offset += offsets[dim][upper & 1];
+        upper >>= 1;
+        }
+
+      if ( overlap )
+        {
+        const InternalPixelType * input = buffer + offset;
+        for ( unsigned int k = 0; k < ncomps; ++k )
+          {
+          output[k] += overlap * static_cast< InternalComputationType >( input[k] );
+          }
+        }
+      }
+
+    for ( unsigned int k = 0; k < ncomps; ++k )
+      {
+      out[k * npoints + i] = static_cast< TValue >( output[k] );
+      }
+    }
+}
 } // end namespace itk
 
 #endif
@@ -101,8 +101,6 @@ void SpectralOptimizer<TFunctional>
 template< typename TFunctional >
 void SpectralOptimizer<TFunctional>::ComputeDerivative() {
 	// Multiply phi and copy reshaped on this->m_Derivative
-	WeightsMatrix phi = this->m_Transform->GetPhi()->transpose();
-
 	size_t dimsize = this->m_Functional->GetValidVertices().size();
 	size_t fullsize = dimsize * Dimension;
 
@@ -117,22 +115,20 @@ void SpectralOptimizer<TFunctional>::ComputeDerivative() {
 	//this->m_MaximumGradient = fabs(this->m_Functional->GetGradientStatistics()[4] -
 	//		this->m_Functional->GetGradientStatistics()[2]);
 
+	ParametersContainer gradient;
+	for ( size_t i = 0; i<Dimension; i++) {
+		gradient[i] = ParametersVector( dimsize, 0.0 );
+		if( this->m_Scales[i] > 1.0e-8 ) {
+			gradient[i].copy_in( &gvdata[i*dimsize] );
+		}
+	}
+
+	// All components go through the transpose of phi in one pass
 	ParametersContainer derivative;
-	ParametersVector dimVector = ParametersVector(dimsize);
+	this->m_Transform->PhiTransposeMultiply( gradient, derivative );
 
 	typename CoefficientsImageType::PixelType* buff[Dimension];
-	float* dimdata;
-
-	double norm = 1.0;
 	for ( size_t i = 0; i<Dimension; i++) {
-		if( this->m_Scales[i] > 1.0e-8 ) {
-			dimdata = &gvdata[i*dimsize];
-			dimVector.copy_in(dimdata);
-			phi.mult( dimVector, derivative[i] );
-
-			double m = derivative[i].inf_norm();
-			if ( m > norm )	norm = m;
-		}
 		this->m_DerivativeCoefficients[i]->FillBuffer( 0.0 );
 		buff[i] = this->m_DerivativeCoefficients[i]->GetBufferPointer();
 	}
@@ -51,6 +51,39 @@
 
 namespace rstk {
 
+/** Closed form of the 1D B-spline weights of the VOrder + 1 control points
+ *  around a sample, for the fractional position t of the sample with respect
+ *  to the second of them. Only the cubic case is available, other orders go
+ *  through the kernel functions */
+template< unsigned int VOrder >
+struct BSplineClosedFormWeights {
+	static const bool Available = false;
+	static void Evaluate( double itkNotUsed(t), double* itkNotUsed(w) ) {}
+	static void EvaluateDerivative( double itkNotUsed(t), double* itkNotUsed(dw) ) {}
+};
+
+template<>
+struct BSplineClosedFormWeights< 3u > {
+	static const bool Available = true;
+	static void Evaluate( double t, double* w ) {
+		double t2 = t * t;
+		double t3 = t2 * t;
+		double s = 1.0 - t;
+		w[0] = s * s * s / 6.0;
+		w[1] = ( 3.0 * t3 - 6.0 * t2 + 4.0 ) / 6.0;
+		w[2] = ( -3.0 * t3 + 3.0 * t2 + 3.0 * t + 1.0 ) / 6.0;
+		w[3] = t3 / 6.0;
+	}
+	static void EvaluateDerivative( double t, double* dw ) {
+		double t2 = t * t;
+		double s = 1.0 - t;
+		dw[0] = -0.5 * s * s;
+		dw[1] = 1.5 * t2 - 2.0 * t;
+		dw[2] = -1.5 * t2 + t + 0.5;
+		dw[3] = 0.5 * t2;
+	}
+};
+
 template< class TScalar, unsigned int NDimensions = 3u, unsigned int VSplineOrder = 3u >
 class BSplineSparseMatrixTransform: public SparseMatrixTransform< TScalar, NDimensions > {
 public:
@@ -71,6 +104,7 @@ public:
 	typedef typename Superclass::KernelFunctionPointer                                  KernelFunctionPointer;
 	typedef typename Superclass::WeightsMatrix                                          WeightsMatrix;
 	typedef typename Superclass::DimensionVector                                        DimensionVector;
+	typedef typename Superclass::DimensionParameters                                    DimensionParameters;
 	typedef typename Superclass::ParametersType                                         ParametersType;
 	typedef typename Superclass::PointsList                                             PointsList;
 	typedef typename Superclass::JacobianType                                           JacobianType;
@@ -97,6 +131,10 @@ public:
 
 	typedef typename Superclass::AltCoeffType                        AltCoeffType;
 	typedef typename Superclass::AltCoeffPointer                     AltCoeffPointer;
+	typedef typename Superclass::MatrixSectionType                   MatrixSectionType;
+	typedef typename Superclass::FunctionalCallback                  FunctionalCallback;
+	typedef typename Superclass::SizeType                            SizeType;
+	typedef BSplineClosedFormWeights< VSplineOrder >                 ClosedFormWeights;
 
 	using Superclass::InterpolateModeType;
 protected:
@@ -115,6 +153,27 @@ protected:
 		return SplineOrder;
 	}
 
+	/** Builds the rows from the 1D weights of each axis, computed once per point,
+	 *  when their closed form is available for SplineOrder */
+	virtual void ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId );
+
+	/** When the displacement field lies on the control grid, S is the tensor
+	 *  product of the same tridiagonal matrix along each axis, and the
+	 *  coefficients are obtained with one forward and one backward recursion
+	 *  per grid line and axis */
+	virtual bool PrefilterCoefficients( const DimensionParameters& values, DimensionParameters& coeffs );
+
+	struct PrefilterStruct {
+		double       *data[Dimension];
+		size_t        length;
+		size_t        stride;
+		size_t        nlines;
+		double        offdiag;
+		const double *cprime;
+		const double *pivots;
+	};
+	static ITK_THREAD_RETURN_TYPE PrefilterThreaderCallback( void *arg );
+
 private:
 	BSplineSparseMatrixTransform( const Self & );
 	void operator=( const Self & );
@@ -122,4 +181,8 @@ private:
 
 } // namespace rstk
 
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "BSplineSparseMatrixTransform.hxx"
+#endif
+
 #endif /* BSPLINESPARSEMATRIXTRANSFORM_H_ */
@@ -0,0 +1,274 @@
+// --------------------------------------------------------------------------------------
+// File:          BSplineSparseMatrixTransform.hxx
+// Date:          Jan 15, 2014
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2014, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of RegSeg
+//
+// RegSeg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// RegSeg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with RegSeg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+
+#ifndef BSPLINESPARSEMATRIXTRANSFORM_HXX_
+#define BSPLINESPARSEMATRIXTRANSFORM_HXX_
+
+#include "BSplineSparseMatrixTransform.h"
+
+namespace rstk {
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+void
+BSplineSparseMatrixTransform< TScalar, NDimensions, VSplineOrder >
+::ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId ) {
+	if ( !ClosedFormWeights::Available ) {
+		Superclass::ThreadedComputeMatrix( section, func, threadId );
+		return;
+	}
+
+	const size_t nw = SplineOrder + 1;
+	size_t last = section.first_row + section.num_rows;
+	const PointsList& vrows = *(section.vrows);
+	bool derivative = ( func == &Self::EvaluateDerivative );
+	size_t ddim = section.dim;
+
+	// Strides of the coefficients images
+	size_t stride[Dimension];
+	stride[0] = 1;
+	for ( size_t d = 1; d < Dimension; d++ ) {
+		stride[d] = stride[d - 1] * this->m_ControlGridSize[d - 1];
+	}
+
+	double w[Dimension][SplineOrder + 1];
+	long first[Dimension];
+	size_t lo[Dimension], hi[Dimension], k[Dimension];
+	VectorType cvector;
+	PointType ci;
+
+	vcl_vector< int > cols;
+	vcl_vector< ScalarType > vals;
+	size_t maxnz = 1;
+	for ( size_t d = 0; d < Dimension; d++ ) maxnz*= nw;
+	cols.reserve( maxnz );
+	vals.reserve( maxnz );
+
+	for ( size_t row = section.first_row; row < last; row++ ) {
+		ci = vrows[row];
+		for ( size_t d = 0; d < Dimension; d++ ) {
+			cvector[d] = ci[d] - this->m_ControlGridOrigin[d];
+		}
+		cvector = this->m_ControlGridPhysicalPointToIndex * cvector;
+
+		cols.clear();
+		vals.clear();
+
+		// 1D weights of the control points first[d] ... first[d] + SplineOrder,
+		// restricted to those in the grid
+		bool inside = true;
+		for ( size_t d = 0; d < Dimension && inside; d++ ) {
+			double fl = vcl_floor( cvector[d] );
+			double t = cvector[d] - fl;
+			first[d] = static_cast< long >( fl ) - 1;
+
+			if ( derivative && d == ddim ) {
+				ClosedFormWeights::EvaluateDerivative( t, w[d] );
+			} else {
+				ClosedFormWeights::Evaluate( t, w[d] );
+			}
+
+			long gsize = this->m_ControlGridSize[d];
+			lo[d] = ( first[d] < 0 )?( -first[d] ):0;
+			hi[d] = ( first[d] + long(nw) > gsize )?( gsize - first[d] ):nw;
+			inside = ( first[d] + long(nw) > 0 ) && ( first[d] < gsize ) && ( lo[d] < hi[d] );
+		}
+
+		if ( !inside ) {
+			section.AppendRow( cols, vals );
+			continue;
+		}
+
+		// Tensor product, x running fastest so that columns are sorted
+		for ( size_t d = 0; d < Dimension; d++ ) k[d] = lo[d];
+		while ( true ) {
+			ScalarType wi = 1.0;
+			size_t col = 0;
+			for ( size_t d = 0; d < Dimension; d++ ) {
+				wi*= w[d][k[d]];
+				col+= ( first[d] + k[d] ) * stride[d];
+			}
+
+			if ( fabs( wi ) > 1.0e-5 ) {
+				cols.push_back( col );
+				vals.push_back( wi );
+			}
+
+			size_t d = 0;
+			for ( ; d < Dimension; d++ ) {
+				if ( ++k[d] < hi[d] ) break;
+				k[d] = lo[d];
+			}
+			if ( d == Dimension ) break;
+		}
+
+		section.AppendRow( cols, vals );
+	}
+}
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+bool
+BSplineSparseMatrixTransform< TScalar, NDimensions, VSplineOrder >
+::PrefilterCoefficients( const DimensionParameters& values, DimensionParameters& coeffs ) {
+	if ( !ClosedFormWeights::Available ) {
+		return false;
+	}
+
+	// The values must be sampled at the control points, i.e. the field
+	// must lie on the control grid
+	if ( this->m_DisplacementField.IsNull() ||
+			this->m_DisplacementField->GetLargestPossibleRegion().GetSize() != this->m_ControlGridSize ) {
+		return false;
+	}
+
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		if ( values[i].size() != this->m_NumberOfDimParameters ) {
+			return false;
+		}
+
+		double tol = 1.0e-5 * this->m_ControlGridSpacing[i];
+		if ( fabs( this->m_DisplacementField->GetSpacing()[i] - this->m_ControlGridSpacing[i] ) > tol ||
+				fabs( this->m_DisplacementField->GetOrigin()[i] - this->m_ControlGridOrigin[i] ) > tol ) {
+			return false;
+		}
+
+		for ( size_t j = 0; j < Dimension; j++ ) {
+			if ( fabs( this->m_DisplacementField->GetDirection()[i][j] - this->m_ControlGridDirection[i][j] ) > 1.0e-6 ) {
+				return false;
+			}
+			if ( i != j && fabs( this->m_ControlGridPhysicalPointToIndex[i][j] ) > 1.0e-6 ) {
+				return false;
+			}
+		}
+	}
+
+	// Kernel at the integer offsets -1, 0, 1 and 2
+	double w[SplineOrder + 1];
+	ClosedFormWeights::Evaluate( 0.0, w );
+	if ( SplineOrder != 3 || w[3] != 0.0 || fabs( w[0] - w[2] ) > 1.0e-12 ) {
+		return false;
+	}
+	double offdiag = w[0];
+	double diag = w[1];
+
+	size_t npix = this->m_NumberOfDimParameters;
+	std::vector< double > data[Dimension];
+	PrefilterStruct str;
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		data[i].resize( npix );
+		for ( size_t k = 0; k < npix; k++ ) data[i][k] = values[i][k];
+		str.data[i] = &data[i][0];
+	}
+	str.offdiag = offdiag;
+
+	std::vector< double > cprime, pivots;
+	size_t stride = 1;
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	for ( size_t d = 0; d < Dimension; d++ ) {
+		size_t n = this->m_ControlGridSize[d];
+
+		// The elimination only depends on the line length, computed once per axis
+		cprime.resize( n );
+		pivots.resize( n );
+		double m = diag;
+		for ( size_t k = 0; k < n; k++ ) {
+			if ( k > 0 ) m = diag - offdiag * cprime[k - 1];
+			pivots[k] = 1.0 / m;
+			cprime[k] = offdiag / m;
+		}
+
+		str.length = n;
+		str.stride = stride;
+		str.nlines = npix / n;
+		str.cprime = &cprime[0];
+		str.pivots = &pivots[0];
+
+		this->GetMultiThreader()->SetSingleMethod( this->PrefilterThreaderCallback, &str );
+		this->GetMultiThreader()->SingleMethodExecute();
+		stride*= n;
+	}
+
+	for ( size_t i = 0; i < Dimension; i++ ) {
+		coeffs[i].set_size( npix );
+		for ( size_t k = 0; k < npix; k++ ) coeffs[i][k] = data[i][k];
+	}
+	return true;
+}
+
+template< class TScalar, unsigned int NDimensions, unsigned int VSplineOrder >
+ITK_THREAD_RETURN_TYPE
+BSplineSparseMatrixTransform< TScalar, NDimensions, VSplineOrder >
+::PrefilterThreaderCallback( void *arg ) {
+	itk::ThreadIdType threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
+	itk::ThreadIdType threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
+	PrefilterStruct* str = (PrefilterStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+	size_t first = ( str->nlines * threadId ) / threadCount;
+	size_t last = ( str->nlines * ( threadId + 1 ) ) / threadCount;
+	size_t n = str->length;
+	size_t stride = str->stride;
+	const double b = str->offdiag;
+
+	for ( size_t l = first; l < last; l++ ) {
+		size_t start = ( l % stride ) + ( l / stride ) * stride * n;
+
+		for ( size_t i = 0; i < Dimension; i++ ) {
+			double* x = str->data[i] + start;
+
+			// Causal pass
+			x[0]*= str->pivots[0];
+			for ( size_t k = 1; k < n; k++ ) {
+				x[k * stride] = ( x[k * stride] - b * x[( k - 1 ) * stride] ) * str->pivots[k];
+			}
+
+			// Anticausal pass
+			for ( size_t k = n - 1; k > 0; k-- ) {
+				x[( k - 1 ) * stride]-= str->cprime[k - 1] * x[k * stride];
+			}
+		}
+	}
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+} // namespace rstk
+
+#endif /* BSPLINESPARSEMATRIXTRANSFORM_HXX_ */
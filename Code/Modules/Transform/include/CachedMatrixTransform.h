@@ -44,6 +44,7 @@
 #define CACHEDMATRIXTRANSFORM_H_
 
 #include <functional>
+#include <vector>
 
 #include <itkTransform.h>
 #include <itkPoint.h>
@@ -63,6 +64,7 @@
 #include <vnl/algo/vnl_sparse_lu.h>
 
 #include "RBFFieldTransform.h"
+#include "CompressedSparseMatrix.h"
 #include "rstkMacro.h"
 
 namespace rstk {
@@ -95,6 +97,7 @@ public:
 
     typedef vnl_sparse_matrix< ScalarType >                                     WeightsMatrix;
     typedef typename WeightsMatrix::row                                         SparseMatrixRowType;
+    typedef CompressedSparseMatrix< ScalarType, Dimension >                     CompressedMatrixType;
     typedef vnl_vector< ScalarType >                                            DimensionVector;
     typedef vnl_matrix< ScalarType >                                            DimensionMatrixType;
 
@@ -103,6 +106,7 @@ public:
     typedef typename SolverTypeTraits::MatrixType                               SolverMatrix;
     typedef typename SolverTypeTraits::VectorType                               SolverVector;
     typedef typename SolverMatrix::pair_t                                       SolverPair;
+    typedef std::vector< SolverVector >                                         SolverVectorContainer;
 
     typedef itk::FixedArray< DimensionVector, NDimensions >                     DimensionParameters;
     typedef itk::FixedArray< DimensionVector*, NDimensions >                    DimensionParametersContainer;
@@ -202,9 +206,33 @@ public:
 
     virtual void SetFieldParametersFromImage(const DomainBase* image);
     virtual void SetCoefficientsParametersFromImage(const DomainBase* image);
+
+    // Iterative least squares settings
+    itkSetMacro( SolverMaximumIterations, size_t );
+    itkGetConstMacro( SolverMaximumIterations, size_t );
+    itkSetMacro( SolverTolerance, double );
+    itkGetConstMacro( SolverTolerance, double );
 protected:
 	CachedMatrixTransform();
-	~CachedMatrixTransform(){};
+	~CachedMatrixTransform(){ this->ReleaseFactorization(); };
+
+	/** Keeps the LU factorization of A until it is released or replaced.
+	 *  A is factorized once, on the first solve */
+	void FactorizeMatrix( const SolverMatrix& A );
+	void ReleaseFactorization();
+	bool IsFactorized() const { return this->m_Factorization != NULL; }
+
+	/** Solves A x = b with the kept factorization */
+	void SolveFactorized( const SolverVector& b, SolverVector& x );
+
+	/** Solves A X = B for all right-hand sides. The sparse LU solver uses
+	 *  internal work space, so the solves share the factorization in sequence */
+	void SolveFactorized( const SolverVectorContainer& B, SolverVectorContainer& X );
+
+	/** Minimizes ||A x - b|| for all components with conjugate gradients
+	 *  on the normal equations (CGLS). A is only applied through products,
+	 *  x is used as initial guess. Returns the number of iterations */
+	size_t SolveLeastSquares( const CompressedMatrixType& A, const DimensionParameters& b, DimensionParameters& x, itk::MultiThreader* threader );
 
 	DimensionVector Vectorize( const CoefficientsImageType* image );
 	DimensionParameters VectorizeField( const FieldType* image );
@@ -240,6 +268,10 @@ protected:
 
 	bool                         m_UseImageOutput;
 	InterpolateModeType          m_InterpolationMode;
+
+	SolverType*                  m_Factorization;
+	size_t                       m_SolverMaximumIterations;
+	double                       m_SolverTolerance;
 private:
 	CachedMatrixTransform( const Self & );
 	void operator=( const Self & );
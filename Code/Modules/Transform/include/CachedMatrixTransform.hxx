@@ -66,7 +66,10 @@ CachedMatrixTransform<TScalar,NDimensions>
 Superclass(),
 m_NumberOfPoints(0),
 m_UseImageOutput(false),
-m_InterpolationMode(UNKNOWN) {
+m_InterpolationMode(UNKNOWN),
+m_Factorization(NULL),
+m_SolverMaximumIterations(500),
+m_SolverTolerance(1.0e-6) {
 	for( size_t i = 0; i<Dimension; i++ ) {
 		this->m_PointValues[i] = DimensionVector();
 	}
@@ -250,6 +253,120 @@ CachedMatrixTransform<TScalar,NDimensions>
 	return vectorized;
 }
 
+template< class TScalar, unsigned int NDimensions >
+void
+CachedMatrixTransform<TScalar,NDimensions>
+::FactorizeMatrix( const SolverMatrix& A ) {
+	if ( A.rows() != A.cols() ) {
+		itkExceptionMacro(<< "LU factorization requires a square matrix, got " << A.rows() << "x" << A.cols() << ".");
+	}
+
+	this->ReleaseFactorization();
+	this->m_Factorization = new SolverType( A );
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+CachedMatrixTransform<TScalar,NDimensions>
+::ReleaseFactorization() {
+	delete this->m_Factorization;
+	this->m_Factorization = NULL;
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+CachedMatrixTransform<TScalar,NDimensions>
+::SolveFactorized( const SolverVector& b, SolverVector& x ) {
+	if ( this->m_Factorization == NULL ) {
+		itkExceptionMacro(<< "matrix has not been factorized.");
+	}
+	x.set_size( b.size() );
+	SolverTypeTraits::Solve( *( this->m_Factorization ), b, x );
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+CachedMatrixTransform<TScalar,NDimensions>
+::SolveFactorized( const SolverVectorContainer& B, SolverVectorContainer& X ) {
+	X.resize( B.size() );
+	for( size_t i = 0; i < B.size(); i++ ) {
+		this->SolveFactorized( B[i], X[i] );
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+size_t
+CachedMatrixTransform<TScalar,NDimensions>
+::SolveLeastSquares( const CompressedMatrixType& A, const DimensionParameters& b, DimensionParameters& x, itk::MultiThreader* threader ) {
+	size_t nRows = A.rows();
+	size_t nCols = A.cols();
+
+	DimensionParameters r, s, p, q;
+	double gamma[Dimension], gamma0[Dimension];
+	bool converged[Dimension];
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		if ( b[d].size() != nRows ) {
+			itkExceptionMacro(<< "right-hand side size (" << b[d].size() << ") does not match the matrix (" << nRows << " rows).");
+		}
+		if ( x[d].size() != nCols ) {
+			x[d].set_size( nCols );
+			x[d].fill( 0.0 );
+		}
+	}
+
+	// r = b - A x, s = A^T r
+	A.Multiply( x, q, threader );
+	for( size_t d = 0; d < Dimension; d++ ) {
+		r[d] = b[d] - q[d];
+	}
+	A.TransposeMultiply( r, s, threader );
+
+	bool done = true;
+	for( size_t d = 0; d < Dimension; d++ ) {
+		p[d] = s[d];
+		gamma[d] = dot_product( s[d], s[d] );
+		gamma0[d] = gamma[d];
+		converged[d] = ( gamma[d] == 0.0 );
+		done = done && converged[d];
+	}
+
+	size_t it = 0;
+	double tol2 = this->m_SolverTolerance * this->m_SolverTolerance;
+	while( !done && it < this->m_SolverMaximumIterations ) {
+		A.Multiply( p, q, threader );
+
+		for( size_t d = 0; d < Dimension; d++ ) {
+			if ( converged[d] ) continue;
+			double qq = dot_product( q[d], q[d] );
+			if ( qq == 0.0 ) {
+				converged[d] = true;
+				continue;
+			}
+			double alpha = gamma[d] / qq;
+			x[d]+= static_cast< ScalarType >( alpha ) * p[d];
+			r[d]-= static_cast< ScalarType >( alpha ) * q[d];
+		}
+
+		A.TransposeMultiply( r, s, threader );
+
+		done = true;
+		for( size_t d = 0; d < Dimension; d++ ) {
+			if ( !converged[d] ) {
+				double gnew = dot_product( s[d], s[d] );
+				double beta = gnew / gamma[d];
+				gamma[d] = gnew;
+				p[d] = s[d] + static_cast< ScalarType >( beta ) * p[d];
+				converged[d] = ( gnew <= tol2 * gamma0[d] );
+			}
+			done = done && converged[d];
+		}
+		it++;
+	}
+
+	return it;
+}
+
 }
 
 
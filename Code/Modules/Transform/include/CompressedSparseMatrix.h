@@ -0,0 +1,138 @@
+// --------------------------------------------------------------------------------------
+// File:          CompressedSparseMatrix.h
+// Date:          Mar 09, 2015
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of RegSeg
+//
+// RegSeg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// RegSeg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with RegSeg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef COMPRESSEDSPARSEMATRIX_H_
+#define COMPRESSEDSPARSEMATRIX_H_
+
+#include <vector>
+
+#include <itkFixedArray.h>
+#include <itkMultiThreader.h>
+#include <vnl/vnl_sparse_matrix.h>
+#include <vnl/vnl_vector.h>
+
+namespace rstk {
+/** \class CompressedSparseMatrix
+ *  \brief Read-only compressed copy of a weights matrix
+ *
+ *  The weights matrices are assembled row by row in a vnl_sparse_matrix,
+ *  which stores one vector of (column, value) pairs per row. Once a matrix
+ *  is computed, SetMatrix packs it in contiguous CSR arrays and builds the
+ *  CSC layout at the same time, so that products with the transpose do not
+ *  need a copy of the matrix.
+ *
+ *  Multiply and TransposeMultiply process the VDimension components of a
+ *  field in one sweep over the matrix. Rows are split among threads so that
+ *  all of them get a similar number of non-zeros.
+ */
+template< class TValue, unsigned int VDimension = 3u >
+class CompressedSparseMatrix {
+public:
+	typedef CompressedSparseMatrix                         Self;
+	typedef TValue                                         ValueType;
+	typedef unsigned int                                   IndexValueType;
+	typedef vnl_sparse_matrix< ValueType >                 SourceMatrixType;
+	typedef vnl_vector< ValueType >                        VectorType;
+	typedef itk::FixedArray< VectorType, VDimension >      MultiVectorType;
+	typedef std::vector< size_t >                          PointerContainer;
+	typedef std::vector< IndexValueType >                  IndexContainer;
+	typedef std::vector< ValueType >                       ValueContainer;
+
+	CompressedSparseMatrix(): m_Rows(0), m_Columns(0) {}
+
+	/** Packs m, building both the CSR and the CSC layouts */
+	void SetMatrix( const SourceMatrixType& m );
+
+	/** Takes over the contents of CSR arrays (left empty) and builds the CSC layout */
+	void SetMatrix( size_t nrows, size_t ncols, PointerContainer& pointers, IndexContainer& indices, ValueContainer& values );
+	void Clear();
+
+	size_t rows() const { return this->m_Rows; }
+	size_t cols() const { return this->m_Columns; }
+	size_t GetNumberOfNonZeros() const { return this->m_Values.size(); }
+	bool IsEmpty() const { return this->m_Rows == 0 || this->m_Columns == 0; }
+
+	const PointerContainer& GetRowPointers() const { return this->m_RowPointers; }
+	const IndexContainer& GetColumnIndices() const { return this->m_ColumnIndices; }
+	const ValueContainer& GetValues() const { return this->m_Values; }
+
+	/** Computes y[d] = A x[d] for all components d */
+	void Multiply( const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const;
+
+	/** Computes y[d] = A^T x[d] for all components d */
+	void TransposeMultiply( const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const;
+
+protected:
+	struct ProductStruct {
+		const size_t         *pointers;
+		const IndexValueType *indices;
+		const ValueType      *values;
+		size_t                nrows;
+		const ValueType      *x[VDimension];
+		ValueType            *y[VDimension];
+	};
+
+	void BuildTranspose();
+	void Product( const PointerContainer& pointers, const IndexContainer& indices, const ValueContainer& values,
+			      size_t nrows, size_t ncols, const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const;
+	static ITK_THREAD_RETURN_TYPE ProductThreaderCallback( void *arg );
+	static void ThreadedProduct( const ProductStruct& str, size_t first, size_t last );
+
+	size_t           m_Rows;
+	size_t           m_Columns;
+
+	// CSR layout
+	PointerContainer m_RowPointers;
+	IndexContainer   m_ColumnIndices;
+	ValueContainer   m_Values;
+
+	// CSC layout (CSR of the transpose)
+	PointerContainer m_ColumnPointers;
+	IndexContainer   m_RowIndices;
+	ValueContainer   m_TransposedValues;
+};
+} // end namespace rstk
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "CompressedSparseMatrix.hxx"
+#endif
+#endif /* COMPRESSEDSPARSEMATRIX_H_ */
@@ -0,0 +1,246 @@
+// --------------------------------------------------------------------------------------
+// File:          CompressedSparseMatrix.hxx
+// Date:          Mar 09, 2015
+// Author:        code@oscaresteban.es (Oscar Esteban)
+// Version:       1.5.5
+// License:       GPLv3 - 29 June 2007
+// Short Summary:
+// --------------------------------------------------------------------------------------
+//
+// Copyright (c) 2015, code@oscaresteban.es (Oscar Esteban)
+// with Signal Processing Lab 5, EPFL (LTS5-EPFL)
+// and Biomedical Image Technology, UPM (BIT-UPM)
+// All rights reserved.
+//
+// This file is part of RegSeg
+//
+// RegSeg is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// RegSeg is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with RegSeg.  If not, see <http://www.gnu.org/licenses/>.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+
+#ifndef COMPRESSEDSPARSEMATRIX_HXX_
+#define COMPRESSEDSPARSEMATRIX_HXX_
+
+#include "CompressedSparseMatrix.h"
+#include <algorithm>
+#include <itkMacro.h>
+
+namespace rstk {
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::SetMatrix( const SourceMatrixType& m ) {
+	this->Clear();
+	this->m_Rows = m.rows();
+	this->m_Columns = m.cols();
+
+	size_t nnz = 0;
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		nnz+= m.get_row( r ).size();
+	}
+
+	this->m_RowPointers.resize( this->m_Rows + 1 );
+	this->m_ColumnIndices.resize( nnz );
+	this->m_Values.resize( nnz );
+
+	size_t k = 0;
+	this->m_RowPointers[0] = 0;
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		const typename SourceMatrixType::row& row = m.get_row( r );
+		for( size_t i = 0; i < row.size(); i++ ) {
+			this->m_ColumnIndices[k] = row[i].first;
+			this->m_Values[k] = row[i].second;
+			k++;
+		}
+		this->m_RowPointers[r + 1] = k;
+	}
+
+	this->BuildTranspose();
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::SetMatrix( size_t nrows, size_t ncols, PointerContainer& pointers, IndexContainer& indices, ValueContainer& values ) {
+	if( pointers.size() != nrows + 1 || indices.size() != pointers.back() || values.size() != indices.size() ) {
+		itkGenericExceptionMacro(<< "inconsistent CSR arrays for a " << nrows << "x" << ncols << " matrix.");
+	}
+
+	this->Clear();
+	this->m_Rows = nrows;
+	this->m_Columns = ncols;
+	this->m_RowPointers.swap( pointers );
+	this->m_ColumnIndices.swap( indices );
+	this->m_Values.swap( values );
+	this->BuildTranspose();
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::BuildTranspose() {
+	size_t nnz = this->m_Values.size();
+	this->m_ColumnPointers.assign( this->m_Columns + 1, 0 );
+	this->m_RowIndices.resize( nnz );
+	this->m_TransposedValues.resize( nnz );
+
+	for( size_t k = 0; k < nnz; k++ ) {
+		this->m_ColumnPointers[this->m_ColumnIndices[k] + 1]++;
+	}
+
+	for( size_t c = 0; c < this->m_Columns; c++ ) {
+		this->m_ColumnPointers[c + 1]+= this->m_ColumnPointers[c];
+	}
+
+	// Rows are visited in order, so row indices end up sorted within each column
+	PointerContainer next( this->m_ColumnPointers.begin(), this->m_ColumnPointers.end() - 1 );
+	for( size_t r = 0; r < this->m_Rows; r++ ) {
+		for( size_t i = this->m_RowPointers[r]; i < this->m_RowPointers[r + 1]; i++ ) {
+			size_t pos = next[this->m_ColumnIndices[i]]++;
+			this->m_RowIndices[pos] = r;
+			this->m_TransposedValues[pos] = this->m_Values[i];
+		}
+	}
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::Clear() {
+	this->m_Rows = 0;
+	this->m_Columns = 0;
+	PointerContainer().swap( this->m_RowPointers );
+	IndexContainer().swap( this->m_ColumnIndices );
+	ValueContainer().swap( this->m_Values );
+	PointerContainer().swap( this->m_ColumnPointers );
+	IndexContainer().swap( this->m_RowIndices );
+	ValueContainer().swap( this->m_TransposedValues );
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::Multiply( const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const {
+	this->Product( this->m_RowPointers, this->m_ColumnIndices, this->m_Values,
+			       this->m_Rows, this->m_Columns, x, y, threader );
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::TransposeMultiply( const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const {
+	this->Product( this->m_ColumnPointers, this->m_RowIndices, this->m_TransposedValues,
+			       this->m_Columns, this->m_Rows, x, y, threader );
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::Product( const PointerContainer& pointers, const IndexContainer& indices, const ValueContainer& values,
+		   size_t nrows, size_t ncols, const MultiVectorType& x, MultiVectorType& y, itk::MultiThreader* threader ) const {
+	if( pointers.empty() ) {
+		itkGenericExceptionMacro(<< "matrix has not been set.");
+	}
+
+	ProductStruct str;
+	str.pointers = &pointers[0];
+	str.indices = indices.empty()?NULL:&indices[0];
+	str.values = values.empty()?NULL:&values[0];
+	str.nrows = nrows;
+
+	for( size_t d = 0; d < VDimension; d++ ) {
+		if( x[d].size() != ncols ) {
+			itkGenericExceptionMacro(<< "vector size (" << x[d].size() << ") does not match the number of columns (" << ncols << ").");
+		}
+		if( y[d].size() != nrows ) {
+			y[d].set_size( nrows );
+		}
+		str.x[d] = x[d].data_block();
+		str.y[d] = y[d].data_block();
+	}
+
+	if( threader == NULL ) {
+		ThreadedProduct( str, 0, nrows );
+		return;
+	}
+
+	threader->SetSingleMethod( Self::ProductThreaderCallback, &str );
+	threader->SingleMethodExecute();
+}
+
+template< class TValue, unsigned int VDimension >
+ITK_THREAD_RETURN_TYPE
+CompressedSparseMatrix<TValue,VDimension>
+::ProductThreaderCallback( void *arg ) {
+	itk::ThreadIdType threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
+	itk::ThreadIdType threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
+	ProductStruct* str = (ProductStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+	// Split by number of non-zeros, each thread writes a disjoint range of y
+	const size_t *begin = str->pointers;
+	const size_t *end = str->pointers + str->nrows;
+	size_t nnz = str->pointers[str->nrows];
+
+	size_t first = std::lower_bound( begin, end, ( nnz * threadId ) / threadCount ) - begin;
+	size_t last = str->nrows;
+	if( threadId + 1 < threadCount ) {
+		last = std::lower_bound( begin, end, ( nnz * ( threadId + 1 ) ) / threadCount ) - begin;
+	}
+
+	if( first < last ) {
+		ThreadedProduct( *str, first, last );
+	}
+	return ITK_THREAD_RETURN_VALUE;
+}
+
+template< class TValue, unsigned int VDimension >
+void
+CompressedSparseMatrix<TValue,VDimension>
+::ThreadedProduct( const ProductStruct& str, size_t first, size_t last ) {
+	ValueType acc[VDimension];
+	ValueType w;
+	IndexValueType c;
+
+	for( size_t r = first; r < last; r++ ) {
+		for( size_t d = 0; d < VDimension; d++ ) acc[d] = 0.0;
+
+		for( size_t k = str.pointers[r]; k < str.pointers[r + 1]; k++ ) {
+			c = str.indices[k];
+			w = str.values[k];
+			for( size_t d = 0; d < VDimension; d++ ) {
+				acc[d]+= w * str.x[d][c];
+			}
+		}
+
+		for( size_t d = 0; d < VDimension; d++ ) {
+			str.y[d][r] = acc[d];
+		}
+	}
+}
+
+} // end namespace rstk
+
+#endif /* COMPRESSEDSPARSEMATRIX_HXX_ */
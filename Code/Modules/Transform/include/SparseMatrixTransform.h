@@ -44,6 +44,7 @@
 #define SPARSEMATRIXTRANSFORM_H_
 
 #include <functional>
+#include <vector>
 
 #include "CachedMatrixTransform.h"
 #include <itkTransform.h>
@@ -64,6 +65,7 @@
 #include <vnl/vnl_vector.h>
 #include <vnl/vnl_matrix.h>
 #include <vnl/algo/vnl_sparse_lu.h>
+#include <vcl_vector.h>
 
 #include "rstkMacro.h"
 
@@ -92,6 +94,7 @@ public:
 
     typedef typename Superclass::WeightsMatrix                     WeightsMatrix;
     typedef typename Superclass::SparseMatrixRowType               SparseMatrixRowType;
+    typedef typename Superclass::CompressedMatrixType              CompressedMatrixType;
     typedef typename Superclass::DimensionVector                   DimensionVector;
     typedef typename Superclass::DimensionMatrixType               DimensionMatrixType;
 
@@ -100,6 +103,7 @@ public:
     typedef typename Superclass::SolverMatrix                      SolverMatrix;
     typedef typename Superclass::SolverVector                      SolverVector;
     typedef typename Superclass::SolverPair                        SolverPair;
+    typedef typename Superclass::SolverVectorContainer             SolverVectorContainer;
     
     typedef typename Superclass::DimensionParameters               DimensionParameters;
     typedef typename Superclass::DimensionParametersContainer      DimensionParametersContainer;
@@ -231,6 +235,10 @@ public:
     void UpdateField() { this->UpdateField( this->VectorizeCoefficients() ); }
     void ComputeInverse();
 
+    /** Least squares fit of the coefficients to the values set at the
+     *  points, applying Phi implicitly (no explicit inverse) */
+    size_t ComputeCoefficientsFromPoints();
+
     //void ComputeCoeffDerivatives( void );
     void ComputeGradientField();
     void ComputeCoefficients();
@@ -243,6 +251,12 @@ public:
 		return &this->m_S;
 	}
 
+	/** Compressed copy of Phi, used in the products with the matrix */
+	virtual const CompressedMatrixType* GetPhiOperator( const bool onlyvalid = true );
+
+	/** Computes y = Phi^T x for all components in one pass */
+	void PhiTransposeMultiply( const DimensionParameters& x, DimensionParameters& y, const bool onlyvalid = true );
+
     void SetCoefficientsImages( const CoefficientsImageArray & images );
     void SetCoefficientsImage( size_t dim, const CoefficientsImageType* c );
     void SetCoefficientsVectorImage( const FieldType* f );
@@ -266,32 +280,84 @@ protected:
 
 	enum WeightsMatrixType { PHI, PHI_FIELD, S, SPRIME, PHI_INV };
 
+	typedef typename CompressedMatrixType::PointerContainer  RowPointerContainer;
+	typedef typename CompressedMatrixType::IndexContainer    ColumnIndexContainer;
+	typedef typename CompressedMatrixType::ValueContainer    ValueContainer;
+
+	/** Contiguous range of rows computed by one thread. The rows are
+	 *  written to the private buffers of the section, in order, and
+	 *  merged once all threads are done */
 	struct MatrixSectionType {
-		WeightsMatrix *matrix;
 		PointsList *vrows;
 		PointsList *vcols;
 		size_t section_id;
 		size_t first_row;
 		size_t num_rows;
 		size_t dim;
+
+		RowPointerContainer  pointers;
+		ColumnIndexContainer cols;
+		ValueContainer       vals;
+
+		/** Appends the next row of the section, which may be empty */
+		void AppendRow( const vcl_vector< int >& c, const vcl_vector< ScalarType >& v ) {
+			if ( pointers.empty() ) pointers.push_back( 0 );
+			cols.insert( cols.end(), c.begin(), c.end() );
+			vals.insert( vals.end(), v.begin(), v.end() );
+			pointers.push_back( cols.size() );
+		}
 	};
+	typedef std::vector< MatrixSectionType >                 MatrixSectionContainer;
 
 	typedef ScalarType (Self::*FunctionalCallback)( const VectorType, const size_t );
 
 	struct SMTStruct {
 		SparseMatrixTransform *Transform;
 		WeightsMatrixType type;
-		WeightsMatrix* matrix;
 		size_t dim;
 		PointsList *vrows;
 		PointsList *vcols;
+		MatrixSectionContainer sections;
+	};
+
+	/** 1D kernel weights of the control points along one axis of an output
+	 *  grid. Position n is weighted by the count[n] control points starting
+	 *  at first[n], with values in weights[n * width] onwards */
+	struct AxisWeightsType {
+		size_t                    width;
+		std::vector< long >       first;
+		std::vector< size_t >     count;
+		std::vector< ScalarType > weights;
+	};
+
+	/** One separable pass: out[o][n][i] = sum_k w[n][k] in[o][first[n] + k][i] */
+	struct SeparablePassStruct {
+		const ScalarType      *in;
+		ScalarType            *out;
+		size_t                 inner;
+		size_t                 outer;
+		size_t                 ngrid;
+		size_t                 nout;
+		const AxisWeightsType *weights;
 	};
 
 	void Interpolate( const DimensionParameters& coeff );
 	void UpdateField( const DimensionParameters& coeff );
+
+	/** Computes the coefficients that interpolate values at the control points
+	 *  without solving with S. Returns false when not available, and then
+	 *  ComputeCoefficients falls back to the sparse LU solver */
+	virtual bool PrefilterCoefficients( const DimensionParameters& itkNotUsed(values), DimensionParameters& itkNotUsed(coeffs) ) { return false; }
+
+	/** Fills the weight tables of the axes of field. Returns false when the
+	 *  field and control grids are not aligned, and the field cannot be
+	 *  evaluated separably */
+	bool ComputeFieldAxisWeights( const FieldType* field, AxisWeightsType weights[] );
+	void SeparableInterpolateField( const DimensionParameters& coeff, const AxisWeightsType weights[], FieldType* field );
+	static ITK_THREAD_RETURN_TYPE SeparablePassThreaderCallback( void *arg );
 	void InvertPhi();
 
-	void ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId );
+	virtual void ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId );
 	itk::ThreadIdType SplitMatrixSection( itk::ThreadIdType i, itk::ThreadIdType num, MatrixSectionType& section );
 	static ITK_THREAD_RETURN_TYPE ComputeThreaderCallback(void *arg);
 
@@ -331,6 +397,12 @@ protected:
 	WeightsMatrix   m_S;
 	WeightsMatrix   m_SPrime[Dimension];
 
+	CompressedMatrixType m_PhiOperator;
+	CompressedMatrixType m_PhiValidOperator;
+	CompressedMatrixType m_FieldPhiOperator;
+	CompressedMatrixType m_SOperator;
+	CompressedMatrixType m_SPrimeOperator[Dimension];
+
 	KernelFunctionPointer m_KernelFunction;
 	KernelFunctionPointer m_DerivativeKernel;
 	//KernelFunctionPointer m_SecondDerivativeKernel;
@@ -339,6 +411,7 @@ protected:
 
 	virtual void ComputeMatrix( WeightsMatrixType type, size_t dim = 0 );
 	virtual void AfterComputeMatrix( WeightsMatrixType type );
+	void MergeMatrixSections( MatrixSectionContainer& sections, WeightsMatrix* matrix, CompressedMatrixType* op, bool normalize );
 	virtual size_t ComputeRegionOfPoint(const PointType& point, VectorType& cvector, IndexType& start, IndexType& end, OffsetTableType offsetTable );
 
 	/** Support processing data in multiple threads. */
@@ -44,6 +44,8 @@
 #define SPARSEMATRIXTRANSFORM_HXX_
 
 #include "SparseMatrixTransform.h"
+#include <algorithm>
+
 #include <itkGaussianKernelFunction.h>
 #include <itkBSplineKernelFunction.h>
 #include <itkBSplineDerivativeKernelFunction.h>
@@ -231,6 +233,8 @@ SparseMatrixTransform<TScalar,NDimensions>
 	str.type = type;
 	str.dim = dim;
 	size_t nCols = this->m_ParamLocations.size();
+	WeightsMatrix* matrix = NULL;
+	CompressedMatrixType* op = NULL;
 
 	switch( type ) {
 	case Self::PHI:
@@ -240,26 +244,30 @@ SparseMatrixTransform<TScalar,NDimensions>
 			itkExceptionMacro(<< "OffGrid positions are not initialized");
 		}
 		this->m_Phi = WeightsMatrix( this->m_NumberOfPoints , nCols );
-		str.matrix = &this->m_Phi;
+		matrix = &this->m_Phi;
+		op = &this->m_PhiOperator;
 		break;
 
 	case Self::PHI_FIELD:
 		str.vrows = &this->m_FieldLocations;
 		str.vcols = &this->m_ParamLocations;
 		this->m_FieldPhi = WeightsMatrix( this->m_FieldLocations.size() , nCols );
-		str.matrix = &this->m_FieldPhi;
+		matrix = &this->m_FieldPhi;
+		op = &this->m_FieldPhiOperator;
 		break;
 
 	case Self::S:
 		this->m_S = WeightsMatrix( nCols, nCols );
 
 		str.vrows = &this->m_ParamLocations;
-		str.matrix = &this->m_S;
+		matrix = &this->m_S;
+		op = &this->m_SOperator;
 		break;
 	case Self::SPRIME:
 		this->m_SPrime[dim] = WeightsMatrix( nCols, nCols );
 		str.vrows = &this->m_ParamLocations;
-		str.matrix = &this->m_SPrime[dim];
+		matrix = &this->m_SPrime[dim];
+		op = &this->m_SPrimeOperator[dim];
 		break;
 	default:
 		itkExceptionMacro(<< "Matrix computation not implemented" );
@@ -267,46 +275,134 @@ SparseMatrixTransform<TScalar,NDimensions>
 	}
 
 	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	str.sections.resize( this->GetMultiThreader()->GetNumberOfThreads() );
+	for( size_t i = 0; i < str.sections.size(); i++ ) {
+		str.sections[i].num_rows = 0;
+	}
+
 	this->GetMultiThreader()->SetSingleMethod( this->ComputeThreaderCallback, &str );
 	this->GetMultiThreader()->SingleMethodExecute();
+	this->MergeMatrixSections( str.sections, matrix, op, type == Self::PHI );
 	this->AfterComputeMatrix(type);
 }
 
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
-::AfterComputeMatrix(WeightsMatrixType type) {
-	size_t numvalid = this->m_ValidLocations.size();
-	this->m_Phi.normalize_rows();
-	if(numvalid > 0 &&  numvalid <= this->m_NumberOfPoints ) {
-		if (type == Self::PHI)  {
-			this->m_Phi_valid = WeightsMatrix( numvalid , this->m_NumberOfDimParameters );
-
-			size_t rid = 0;
-			typename PointIdContainer::iterator it = this->m_ValidLocations.begin();
-			typename PointIdContainer::iterator end = this->m_ValidLocations.end();
-			typename WeightsMatrix::row row;
-			vcl_vector< int > cols;
-			vcl_vector< ScalarType > vals;
-
-			while( it != end ) {
-				row = this->m_Phi.get_row(*it);
-				cols.resize(0);
-				vals.resize(0);
-
-				for(size_t i = 0; i < row.size(); i++) {
-					cols.push_back(row[i].first);
-					vals.push_back(row[i].second);
+::MergeMatrixSections( MatrixSectionContainer& sections, WeightsMatrix* matrix, CompressedMatrixType* op, bool normalize ) {
+	size_t nRows = matrix->rows();
+	size_t nnz = 0;
+	for( size_t s = 0; s < sections.size(); s++ ) {
+		nnz+= sections[s].cols.size();
+	}
+
+	RowPointerContainer pointers( nRows + 1, 0 );
+	ColumnIndexContainer indices;
+	ValueContainer values;
+	indices.reserve( nnz );
+	values.reserve( nnz );
+
+	vcl_vector< int > cols;
+	vcl_vector< ScalarType > vals;
+
+	// Sections cover consecutive row ranges, merging them in order makes the result independent of threading
+	size_t row = 0;
+	for( size_t s = 0; s < sections.size(); s++ ) {
+		MatrixSectionType& section = sections[s];
+
+		for( size_t r = 0; r < section.num_rows; r++, row++ ) {
+			size_t first = section.pointers[r];
+			size_t last = section.pointers[r + 1];
+
+			ScalarType scale = 1.0;
+			if ( normalize ) {
+				double norm = 0.0;
+				for( size_t k = first; k < last; k++ ) {
+					norm+= section.vals[k] * section.vals[k];
+				}
+				if ( norm > 0.0 ) {
+					scale = 1.0 / sqrt( norm );
 				}
+			}
 
-				this->m_Phi_valid.set_row(rid, cols, vals);
-				rid++;
-				++it;
+			cols.clear();
+			vals.clear();
+			for( size_t k = first; k < last; k++ ) {
+				indices.push_back( section.cols[k] );
+				values.push_back( section.vals[k] * scale );
+				cols.push_back( section.cols[k] );
+				vals.push_back( values.back() );
+			}
+			pointers[row + 1] = indices.size();
+
+			if ( cols.size() > 0 ) {
+				matrix->set_row( row, cols, vals );
 			}
 		}
+
+		RowPointerContainer().swap( section.pointers );
+		ColumnIndexContainer().swap( section.cols );
+		ValueContainer().swap( section.vals );
 	}
 
+	if ( row != nRows ) {
+		itkExceptionMacro(<< "computed " << row << " rows of a matrix with " << nRows << " rows.");
+	}
 
+	op->SetMatrix( nRows, matrix->cols(), pointers, indices, values );
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::AfterComputeMatrix(WeightsMatrixType type) {
+	if (type != Self::PHI) {
+		return;
+	}
+
+	size_t numvalid = this->m_ValidLocations.size();
+	if( numvalid == 0 || numvalid > this->m_NumberOfPoints ) {
+		this->m_Phi_valid = WeightsMatrix();
+		this->m_PhiValidOperator.Clear();
+		return;
+	}
+
+	// Rows of Phi are already normalized, copy the valid ones
+	const RowPointerContainer& rp = this->m_PhiOperator.GetRowPointers();
+	const ColumnIndexContainer& rc = this->m_PhiOperator.GetColumnIndices();
+	const ValueContainer& rv = this->m_PhiOperator.GetValues();
+
+	this->m_Phi_valid = WeightsMatrix( numvalid , this->m_NumberOfDimParameters );
+
+	RowPointerContainer pointers( numvalid + 1, 0 );
+	ColumnIndexContainer indices;
+	ValueContainer values;
+	vcl_vector< int > cols;
+	vcl_vector< ScalarType > vals;
+
+	size_t rid = 0;
+	typename PointIdContainer::const_iterator it = this->m_ValidLocations.begin();
+	typename PointIdContainer::const_iterator end = this->m_ValidLocations.end();
+	while( it != end ) {
+		cols.clear();
+		vals.clear();
+
+		for(size_t k = rp[*it]; k < rp[*it + 1]; k++) {
+			indices.push_back(rc[k]);
+			values.push_back(rv[k]);
+			cols.push_back(rc[k]);
+			vals.push_back(rv[k]);
+		}
+		pointers[rid + 1] = indices.size();
+
+		if( cols.size() > 0 ) {
+			this->m_Phi_valid.set_row(rid, cols, vals);
+		}
+		rid++;
+		++it;
+	}
+
+	this->m_PhiValidOperator.SetMatrix( numvalid, this->m_NumberOfDimParameters, pointers, indices, values );
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -320,8 +416,7 @@ SparseMatrixTransform<TScalar,NDimensions>
 	threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
 	str = (SMTStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
 
-	MatrixSectionType splitSection;
-	splitSection.matrix = str->matrix;
+	MatrixSectionType& splitSection = str->sections[threadId];
 	splitSection.vrows = str->vrows;
 	splitSection.dim = str->dim;
 	total = str->Transform->SplitMatrixSection( threadId, threadCount, splitSection );
@@ -365,7 +460,7 @@ SparseMatrixTransform<TScalar,NDimensions>
 ::ThreadedComputeMatrix( MatrixSectionType& section, FunctionalCallback func, itk::ThreadIdType threadId ) {
 	size_t last = section.first_row + section.num_rows;
 	itk::SizeValueType nRows = section.num_rows;
-	PointsList vrows = *(section.vrows);
+	const PointsList& vrows = *(section.vrows);
 	size_t dim = section.dim;
 
 	ScalarType wi;
@@ -401,9 +496,7 @@ SparseMatrixTransform<TScalar,NDimensions>
 			}
 		}
 
-		if ( cols.size() > 0 ) {
-			section.matrix->set_row( row, cols, vals );
-		}
+		section.AppendRow( cols, vals );
 	}
 }
 
@@ -413,13 +506,12 @@ SparseMatrixTransform<TScalar,NDimensions>
 ::InterpolatePoints() {
 	const DimensionParameters coeff = this->VectorizeCoefficients();
 	// Check m_Phi and initializations
-	if( this->m_Phi.rows() == 0 || this->m_Phi.cols() == 0 ) {
+	if( this->m_PhiOperator.IsEmpty() ) {
 		this->ComputeMatrix( Self::PHI );
 	}
-	for( size_t i = 0; i<Dimension; i++ ) {
-		this->m_PointValues[i].set_size( this->m_NumberOfPoints );
-		this->m_Phi.mult( coeff[i], this->m_PointValues[i] );
-	}
+
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	this->m_PhiOperator.Multiply( coeff, this->m_PointValues, this->GetMultiThreader() );
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -427,24 +519,8 @@ void
 SparseMatrixTransform<TScalar,NDimensions>
 ::InterpolateField() {
 	const DimensionParameters coeff = this->VectorizeCoefficients();
-	// Check m_Phi and initializations
-	if( this->m_FieldPhi.rows() == 0 || this->m_FieldPhi.cols() == 0 ) {
-		this->ComputeMatrix( Self::PHI_FIELD );
-	}
-
-	size_t npix = this->m_DisplacementField->GetLargestPossibleRegion().GetNumberOfPixels();
-
-	DimensionVector interpField[Dimension];
-	for( size_t i = 0; i<Dimension; i++ ) {
-		interpField[i] = DimensionVector();
-		interpField[i].set_size(npix);
-		this->m_FieldPhi.mult( coeff[i], interpField[i] );
-	}
 
-	bool setVector;
-	ScalarType val;
 	VectorType v; v.Fill(0.0);
-
 	FieldPointer field = FieldType::New();
 	field->SetRegions( this->m_DisplacementField->GetLargestPossibleRegion().GetSize() );
 	field->SetOrigin( this->m_DisplacementField->GetOrigin() );
@@ -453,6 +529,27 @@ SparseMatrixTransform<TScalar,NDimensions>
 	field->Allocate();
 	field->FillBuffer( v );
 
+	// On aligned grids the field is evaluated axis by axis, without building m_FieldPhi
+	AxisWeightsType weights[Dimension];
+	if( this->ComputeFieldAxisWeights( field, weights ) ) {
+		this->SeparableInterpolateField( coeff, weights, field );
+		this->SetDisplacementField( field );
+		return;
+	}
+
+	// Check m_Phi and initializations
+	if( this->m_FieldPhiOperator.IsEmpty() ) {
+		this->ComputeMatrix( Self::PHI_FIELD );
+	}
+
+	size_t npix = this->m_DisplacementField->GetLargestPossibleRegion().GetNumberOfPixels();
+
+	DimensionParameters interpField;
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	this->m_FieldPhiOperator.Multiply( coeff, interpField, this->GetMultiThreader() );
+
+	bool setVector;
+	ScalarType val;
 	VectorType* obuf = field->GetBufferPointer();
 
 	for( size_t row = 0; row<npix; row++ ) {
@@ -473,6 +570,145 @@ SparseMatrixTransform<TScalar,NDimensions>
 	this->SetDisplacementField( field );
 }
 
+template< class TScalar, unsigned int NDimensions >
+bool
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeFieldAxisWeights( const FieldType* field, AxisWeightsType weights[] ) {
+	DirectionType dir = field->GetDirection();
+	for( size_t i = 0; i < Dimension; i++ ) {
+		for( size_t j = 0; j < Dimension; j++ ) {
+			if ( i != j && ( fabs( dir[i][j] ) > 1.0e-6 || fabs( this->m_ControlGridPhysicalPointToIndex[i][j] ) > 1.0e-6 ) ) {
+				return false;
+			}
+		}
+	}
+
+	SizeType size = field->GetLargestPossibleRegion().GetSize();
+	PointType origin = field->GetOrigin();
+	SpacingType spacing = field->GetSpacing();
+
+	// Same support as ComputeRegionOfPoint: control points within 2 grid units
+	const size_t width = 5;
+	double p, c, u;
+	long start, end;
+
+	for( size_t d = 0; d < Dimension; d++ ) {
+		AxisWeightsType& aw = weights[d];
+		aw.width = width;
+		aw.first.assign( size[d], 0 );
+		aw.count.assign( size[d], 0 );
+		aw.weights.assign( size[d] * width, 0.0 );
+
+		long gsize = this->m_ControlGridSize[d];
+		for( size_t n = 0; n < size[d]; n++ ) {
+			p = origin[d] + dir[d][d] * spacing[d] * n;
+			c = this->m_ControlGridPhysicalPointToIndex[d][d] * ( p - this->m_ControlGridOrigin[d] );
+			start = static_cast< long >( ceil( c - 2.0 ) );
+			end = static_cast< long >( floor( c + 2.0 ) );
+
+			if ( start < 0 ) start = 0;
+			if ( end > gsize - 1 ) end = gsize - 1;
+			if ( end < start ) continue;
+
+			aw.first[n] = start;
+			aw.count[n] = end - start + 1;
+			for( size_t k = 0; k < aw.count[n]; k++ ) {
+				u = this->m_ControlGridOrigin[d] + this->m_ControlGridIndexToPhysicalPoint[d][d] * ( start + k );
+				aw.weights[n * width + k] = this->m_KernelFunction->Evaluate( ( p - u ) / this->m_ControlGridSpacing[d] );
+			}
+		}
+	}
+	return true;
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::SeparableInterpolateField( const DimensionParameters& coeff, const AxisWeightsType weights[], FieldType* field ) {
+	SizeType outSize = field->GetLargestPossibleRegion().GetSize();
+	size_t dims[Dimension];
+	for( size_t d = 0; d < Dimension; d++ ) {
+		dims[d] = this->m_ControlGridSize[d];
+	}
+
+	// Coefficients with the components interleaved, as in the field buffer
+	std::vector< ScalarType > current( this->m_NumberOfDimParameters * Dimension );
+	for( size_t j = 0; j < this->m_NumberOfDimParameters; j++ ) {
+		for( size_t i = 0; i < Dimension; i++ ) {
+			current[j * Dimension + i] = coeff[i][j];
+		}
+	}
+	std::vector< ScalarType > next;
+	ScalarType* obuf = reinterpret_cast< ScalarType* >( field->GetBufferPointer() );
+
+	// Axis a maps [outer][ngrid][inner] to [outer][nout][inner], where inner
+	// spans the axes already resampled and outer the ones still on the grid
+	SeparablePassStruct str;
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	for( size_t a = 0; a < Dimension; a++ ) {
+		str.inner = Dimension;
+		str.outer = 1;
+		for( size_t d = 0; d < a; d++ ) str.inner*= dims[d];
+		for( size_t d = a + 1; d < Dimension; d++ ) str.outer*= dims[d];
+		str.ngrid = dims[a];
+		str.nout = outSize[a];
+		str.weights = &weights[a];
+		str.in = &current[0];
+
+		if ( a == Dimension - 1 ) {
+			str.out = obuf;
+		} else {
+			next.resize( str.outer * str.nout * str.inner );
+			str.out = &next[0];
+		}
+
+		this->GetMultiThreader()->SetSingleMethod( this->SeparablePassThreaderCallback, &str );
+		this->GetMultiThreader()->SingleMethodExecute();
+
+		dims[a] = outSize[a];
+		current.swap( next );
+	}
+
+	size_t nvals = field->GetLargestPossibleRegion().GetNumberOfPixels() * Dimension;
+	for( size_t i = 0; i < nvals; i++ ) {
+		if( fabs( obuf[i] ) <= 1.0e-5 ) obuf[i] = 0.0;
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+ITK_THREAD_RETURN_TYPE
+SparseMatrixTransform<TScalar,NDimensions>
+::SeparablePassThreaderCallback(void *arg) {
+	itk::ThreadIdType threadId = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->ThreadID;
+	itk::ThreadIdType threadCount = ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->NumberOfThreads;
+	SeparablePassStruct* str = (SeparablePassStruct *)( ( (itk::MultiThreader::ThreadInfoStruct *)( arg ) )->UserData );
+
+	// Each thread writes whole output lines out[o][n][*]
+	size_t nlines = str->outer * str->nout;
+	size_t first = ( nlines * threadId ) / threadCount;
+	size_t last = ( nlines * ( threadId + 1 ) ) / threadCount;
+
+	const AxisWeightsType& aw = *( str->weights );
+	size_t inner = str->inner;
+
+	for( size_t l = first; l < last; l++ ) {
+		size_t o = l / str->nout;
+		size_t n = l % str->nout;
+		ScalarType* dst = str->out + l * inner;
+		std::fill( dst, dst + inner, 0.0 );
+
+		const ScalarType* w = &aw.weights[n * aw.width];
+		for( size_t k = 0; k < aw.count[n]; k++ ) {
+			const ScalarType* src = str->in + ( o * str->ngrid + aw.first[n] + k ) * inner;
+			ScalarType wk = w[k];
+			for( size_t i = 0; i < inner; i++ ) {
+				dst[i]+= wk * src[i];
+			}
+		}
+	}
+	return ITK_THREAD_RETURN_VALUE;
+}
+
 template< class TScalar, unsigned int NDimensions >
 void
 SparseMatrixTransform<TScalar,NDimensions>
@@ -483,22 +719,9 @@ SparseMatrixTransform<TScalar,NDimensions>
 
 	this->SetInverseDisplacementField(invfield->GetOutput());
 
-	//// Check m_Phi_inverse and initializations
-	//if( this->m_Phi_inverse.rows() == 0 || this->m_Phi_inverse.cols() == 0 ) {
-	//	this->InvertPhi();
-	//}
-    //
-	//DimensionParameters coeff;
-	//// Compute coefficients
-	//for( size_t i = 0; i<Dimension; i++ ) {
-	//	coeff[i] = DimensionVector( this->m_NumberOfPoints );
-	//	this->m_Phi_inverse.mult( this->m_PointValues[i], coeff[i] );
-	//}
-    //
-	//// TODO set coeff here or inside Interpolate( coeff )
-    //
-	//// Interpolation with new coefficients
-	//this->UpdateField( coeff );
+	// Note: InvertPhi and ComputeCoefficientsFromPoints are not used here. They
+	// map the values at the points to the coefficients of the same field, and
+	// do not invert the displacement
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -513,8 +736,8 @@ SparseMatrixTransform<TScalar,NDimensions>
 
 	// Interpolate
 	DimensionParameters fieldValues;
-	for( size_t i = 0; i<Dimension; i++)
-		this->m_S.mult( coeff[i], fieldValues[i] );
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	this->m_SOperator.Multiply( coeff, fieldValues, this->GetMultiThreader() );
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -525,15 +748,26 @@ SparseMatrixTransform<TScalar,NDimensions>
 		this->InitializeCoefficientsImages();
 	}
 
-	if( this->m_S.rows() == 0 || this->m_S.cols() == 0 ) {
+	DimensionParameters fieldValues = this->VectorizeField( this->m_DisplacementField );
+	DimensionParameters coeffs;
+
+	if ( this->PrefilterCoefficients( fieldValues, coeffs ) ) {
+		for( size_t col = 0; col < Dimension; col++ ) {
+			size_t offset = col * this->m_NumberOfDimParameters;
+			for( size_t k = 0; k<this->m_NumberOfDimParameters; k++) {
+				this->m_Parameters[k + offset] = coeffs[col][k];
+			}
+		}
+		this->Modified();
+		return;
+	}
+
+	if( this->m_SOperator.IsEmpty() ) {
 		this->ComputeMatrix( Self::S );
 	}
 
 	SolverVector X[Dimension], Y[Dimension];
 
-	DimensionParameters fieldValues = this->VectorizeField( this->m_DisplacementField );
-	DimensionParameters coeffs;
-
 	for ( size_t i = 0; i<Dimension; i++) {
 		// TODO: check m_NumberOfPoints here
 		// Y[i] = SolverVector( this->m_NumberOfPoints );
@@ -542,24 +776,25 @@ SparseMatrixTransform<TScalar,NDimensions>
 		X[i] = SolverVector( this->m_NumberOfDimParameters );
 	}
 
-	size_t nRows = this->m_S.rows();
-	SolverMatrix S( nRows, this->m_S.cols() );
-	SparseMatrixRowType row;
-	typedef typename SolverMatrix::row SolverRow;
-	SolverRow row_s;
+	size_t nRows = this->m_SOperator.rows();
+	const RowPointerContainer& rp = this->m_SOperator.GetRowPointers();
+	const ColumnIndexContainer& rc = this->m_SOperator.GetColumnIndices();
+	const ValueContainer& rv = this->m_SOperator.GetValues();
+
+	SolverMatrix S( nRows, this->m_SOperator.cols() );
 	vcl_vector< int > cols;
 	vcl_vector< double > vals;
 
 	for( size_t i = 0; i < nRows; i++ ){
-		row_s.clear();
-		row = this->m_S.get_row( i );
-
-		for( size_t j = 0; j< row.size(); j++ ) {
-			cols.push_back( row[j].first );
-			vals.push_back( static_cast< double >( row[j].second ) );
-
+		cols.clear();
+		vals.clear();
+		for( size_t k = rp[i]; k < rp[i + 1]; k++ ) {
+			cols.push_back( rc[k] );
+			vals.push_back( static_cast< double >( rv[k] ) );
+		}
+		if ( cols.size() > 0 ) {
+			S.set_row( i, cols, vals );
 		}
-		S.set_row( i, cols, vals );
 	}
 
 	if ( Dimension == 3 ) {
@@ -597,12 +832,17 @@ SparseMatrixTransform<TScalar,NDimensions>
 	ScalarType* fbuf[Dimension];
 
 
-	for( size_t i = 0; i<Dimension; i++ ) {
-		for( size_t j=0; j<Dimension; j++ ) {
-			// Interpolate
-			this->m_SPrime[j].mult( coeff[i], result[i][j] );
+	DimensionParameters partial;
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	for( size_t j=0; j<Dimension; j++ ) {
+		// Interpolate
+		this->m_SPrimeOperator[j].Multiply( coeff, partial, this->GetMultiThreader() );
+		for( size_t i = 0; i<Dimension; i++ ) {
+			result[i][j] = partial[i];
 		}
+	}
 
+	for( size_t i = 0; i<Dimension; i++ ) {
 		// Clear data buffer and get pointer
 		this->m_Derivatives[i]->FillBuffer( 0.0 );
 		fbuf[i] = this->m_Derivatives[i]->GetBufferPointer();
@@ -646,53 +886,83 @@ void
 SparseMatrixTransform<TScalar,NDimensions>
 ::InvertPhi() {
 	// Check m_Phi
-	if( this->m_Phi.rows() == 0 || this->m_Phi.cols() == 0 ) {
+	if( this->m_PhiOperator.IsEmpty() ) {
 		this->ComputeMatrix( Self::PHI );
 	}
 
-	size_t nRows = this->m_Phi.rows();
-	size_t nCols = this->m_Phi.cols();
+	size_t nRows = this->m_PhiOperator.rows();
+	size_t nCols = this->m_PhiOperator.cols();
 
-	this->m_Phi_inverse = WeightsMatrix( nCols, nRows );
+	const RowPointerContainer& rp = this->m_PhiOperator.GetRowPointers();
+	const ColumnIndexContainer& rc = this->m_PhiOperator.GetColumnIndices();
+	const ValueContainer& rv = this->m_PhiOperator.GetValues();
 
-	ScalarType val;
 	SolverMatrix A( nRows, nCols );
-	SparseMatrixRowType row;
-	typedef typename SolverMatrix::row SolverRow;
-	SolverRow row_s;
 	vcl_vector< int > cols;
 	vcl_vector< double > vals;
 
 	for( size_t i = 0; i < nRows; i++ ){
-		row_s.clear();
-		row = this->m_Phi.get_row( i );
-
-		for( size_t j = 0; j< row.size(); j++ ) {
-			cols.push_back( row[j].first );
-			vals.push_back( static_cast< double >( row[j].second ) );
+		cols.clear();
+		vals.clear();
+		for( size_t k = rp[i]; k < rp[i + 1]; k++ ) {
+			cols.push_back( rc[k] );
+			vals.push_back( static_cast< double >( rv[k] ) );
+		}
+		if ( cols.size() > 0 ) {
+			A.set_row( i, cols, vals );
 		}
-		A.set_row( i, cols, vals );
 	}
 
-	SolverVector X, B;
-	for( size_t col = 0; col<nRows; col++ ) {
-		B = SolverVector( nCols );
-		B.fill( 0.0 );
-		B(col) = 1.0;
-		X = SolverVector( nCols );
+	// Factorize once, then solve for the columns of the inverse
+	this->FactorizeMatrix( A );
+
+	this->m_Phi_inverse = WeightsMatrix( nCols, nRows );
+	SolverVector B( nRows, 0.0 );
+	SolverVector X;
 
-		SolverTypeTraits::Solve( A, B, X );
+	for( size_t col = 0; col < nRows; col++ ) {
+		B( col ) = 1.0;
+		this->SolveFactorized( B, X );
+		B( col ) = 0.0;
 
-		for( size_t row = 0; row<nCols; row++ ) {
-			val = X[row];
-			if( fabs(val) > 1.0e-8 ) {
-				this->m_Phi_inverse.put( row, col, val );
+		for( size_t row = 0; row < X.size(); row++ ) {
+			if( fabs( X[row] ) > 1.0e-8 ) {
+				this->m_Phi_inverse.put( row, col, X[row] );
 			}
 		}
 	}
 
+	// The LU factors are large, do not keep them after the inverse is built
+	this->ReleaseFactorization();
 	this->Modified();
+}
+
+template< class TScalar, unsigned int NDimensions >
+size_t
+SparseMatrixTransform<TScalar,NDimensions>
+::ComputeCoefficientsFromPoints() {
+	if ( this->m_NumberOfDimParameters == 0 ) {
+		this->InitializeCoefficientsImages();
+	}
+
+	if( this->m_PhiOperator.IsEmpty() ) {
+		this->ComputeMatrix( Self::PHI );
+	}
+
+	// Start from the current coefficients
+	DimensionParameters coeffs = this->VectorizeCoefficients();
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	size_t iterations = this->SolveLeastSquares( this->m_PhiOperator, this->m_PointValues, coeffs, this->GetMultiThreader() );
+
+	for( size_t col = 0; col < Dimension; col++ ) {
+		size_t offset = col * this->m_NumberOfDimParameters;
+		for( size_t k = 0; k<this->m_NumberOfDimParameters; k++) {
+			this->m_Parameters[k + offset] = coeffs[col][k];
+		}
+	}
 
+	this->Modified();
+	return iterations;
 }
 
 template< class TScalar, unsigned int NDimensions >
@@ -711,6 +981,30 @@ SparseMatrixTransform<TScalar,NDimensions>
 	}
 }
 
+template< class TScalar, unsigned int NDimensions >
+const typename SparseMatrixTransform<TScalar,NDimensions>::CompressedMatrixType*
+SparseMatrixTransform<TScalar,NDimensions>
+::GetPhiOperator(const bool onlyvalid) {
+	if( this->m_PhiOperator.IsEmpty() ) {
+		this->ComputeMatrix( Self::PHI );
+	}
+
+	if (onlyvalid) {
+		return &this->m_PhiValidOperator;
+	} else {
+		return &this->m_PhiOperator;
+	}
+}
+
+template< class TScalar, unsigned int NDimensions >
+void
+SparseMatrixTransform<TScalar,NDimensions>
+::PhiTransposeMultiply( const DimensionParameters& x, DimensionParameters& y, const bool onlyvalid ) {
+	const CompressedMatrixType* phi = this->GetPhiOperator( onlyvalid );
+	this->GetMultiThreader()->SetNumberOfThreads( this->GetNumberOfThreads() );
+	phi->TransposeMultiply( x, y, this->GetMultiThreader() );
+}
+
 template< class TScalar, unsigned int NDimensions >
 inline bool
 SparseMatrixTransform<TScalar,NDimensions>
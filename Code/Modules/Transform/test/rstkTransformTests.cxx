@@ -16,7 +16,10 @@
 #include <itkImageAlgorithm.h>
 #include <itkImageFileReader.h>
 #include <itkBSplineInterpolateImageFunction.h>
+#include <itkMultiThreader.h>
+#include <vnl/vnl_sparse_matrix.h>
 #include "BSplineSparseMatrixTransform.h"
+#include "CompressedSparseMatrix.h"
 #include "DisplacementFieldFileWriter.h"
 #include "DisplacementFieldComponentsFileWriter.h"
 
@@ -166,6 +169,63 @@ public:
 };
 
 
+/** Exposes the prefilter, and can disable it to force the LU solution */
+class PrefilterTestTransform: public Transform {
+public:
+	typedef PrefilterTestTransform                 Self;
+	typedef Transform                              Superclass;
+	typedef itk::SmartPointer< Self >              Pointer;
+
+	itkNewMacro( Self );
+	itkTypeMacro( PrefilterTestTransform, BSplineSparseMatrixTransform );
+
+	itkSetMacro( UsePrefilter, bool );
+
+	/** Prefilter the current displacement field */
+	bool PrefilterField( DimensionParameters& coeffs ) {
+		return Superclass::PrefilterCoefficients( this->VectorizeField( this->m_DisplacementField ), coeffs );
+	}
+
+protected:
+	PrefilterTestTransform(): Superclass(), m_UsePrefilter( true ) {}
+
+	virtual bool PrefilterCoefficients( const DimensionParameters& values, DimensionParameters& coeffs ) {
+		return this->m_UsePrefilter && Superclass::PrefilterCoefficients( values, coeffs );
+	}
+
+	bool m_UsePrefilter;
+};
+
+/** Exposes the solvers that work with Phi */
+class SolverTestTransform: public Transform {
+public:
+	typedef SolverTestTransform                    Self;
+	typedef Transform                              Superclass;
+	typedef itk::SmartPointer< Self >              Pointer;
+
+	itkNewMacro( Self );
+	itkTypeMacro( SolverTestTransform, BSplineSparseMatrixTransform );
+
+	/** Least squares fit of the displacement field values at the points */
+	size_t FitField( DimensionParameters& coeffs ) {
+		if ( this->m_PhiOperator.IsEmpty() ) {
+			this->ComputeMatrix( Superclass::PHI );
+		}
+		DimensionParameters values = this->VectorizeField( this->m_DisplacementField );
+		return this->SolveLeastSquares( this->m_PhiOperator, values, coeffs, this->GetMultiThreader() );
+	}
+
+	const WeightsMatrix& ComputePhiInverse() {
+		this->InvertPhi();
+		return this->m_Phi_inverse;
+	}
+
+	bool IsFactorized() const { return Superclass::IsFactorized(); }
+
+protected:
+	SolverTestTransform(): Superclass() {}
+};
+
 TEST_F( TransformTests, MatricesTest ) {
 	m_transform->ComputeCoefficients();
 	m_transform->UpdateField();
@@ -448,4 +508,239 @@ TEST_F( TransformTests, RandomSampleTest ) {
 	}
 	ASSERT_NEAR( 0.0, error, 1.0e-5 );
 }
+TEST_F( TransformTests, PrefilterMatchesLU ) {
+	PrefilterTestTransform::Pointer pre = PrefilterTestTransform::New();
+	pre->SetControlGridInformation( m_field );
+	pre->SetDisplacementField( m_field );
+
+	pre->ComputeCoefficients();
+
+	// Otherwise ComputeCoefficients fell back to the LU solver too
+	Transform::DimensionParameters coeffs;
+	ASSERT_TRUE( pre->PrefilterField( coeffs ) );
+
+	PrefilterTestTransform::Pointer lu = PrefilterTestTransform::New();
+	lu->SetUsePrefilter( false );
+	lu->SetControlGridInformation( m_field );
+	lu->SetDisplacementField( m_field );
+	lu->ComputeCoefficients();
+
+	const Transform::ParametersType& a = pre->GetParameters();
+	const Transform::ParametersType& b = lu->GetParameters();
+	ASSERT_EQ( b.Size(), a.Size() );
+
+	double error = 0.0;
+	for ( size_t i = 0; i < a.Size(); i++ ) {
+		EXPECT_NEAR( b[i], a[i], 1.0e-4 * ( 1.0 + fabs( b[i] ) ) ) << "parameter " << i;
+		error+= fabs( b[i] - a[i] );
+	}
+	EXPECT_NEAR( 0.0, error / a.Size(), 1.0e-5 );
+}
+
+TEST_F( TransformTests, PrefilterRejectsOffGridField ) {
+	PrefilterTestTransform::Pointer pre = PrefilterTestTransform::New();
+	pre->SetControlGridInformation( m_field );
+	pre->SetDisplacementField( m_field );
+	pre->ComputeCoefficients();
+
+	// Same size as the control grid, shifted by half a control point
+	FieldType::Pointer shifted = FieldType::New();
+	FieldType::PointType origin = m_field->GetOrigin();
+	origin[0]+= 0.5 * m_field->GetSpacing()[0];
+	shifted->SetRegions( m_field->GetLargestPossibleRegion() );
+	shifted->SetSpacing( m_field->GetSpacing() );
+	shifted->SetOrigin( origin );
+	shifted->SetDirection( m_field->GetDirection() );
+	shifted->Allocate();
+	itk::ImageAlgorithm::Copy< FieldType, FieldType >(
+			m_field, shifted,
+			m_field->GetLargestPossibleRegion(),
+			shifted->GetLargestPossibleRegion()
+	);
+
+	Transform::DimensionParameters coeffs;
+	pre->SetDisplacementField( shifted );
+	EXPECT_FALSE( pre->PrefilterField( coeffs ) );
+
+	pre->SetDisplacementField( m_field );
+	EXPECT_TRUE( pre->PrefilterField( coeffs ) );
+}
+
+TEST_F( TransformTests, SolveLeastSquaresMatchesLU ) {
+	PrefilterTestTransform::Pointer lu = PrefilterTestTransform::New();
+	lu->SetUsePrefilter( false );
+	lu->SetControlGridInformation( m_field );
+	lu->SetDisplacementField( m_field );
+	lu->ComputeCoefficients();
+	const Transform::ParametersType& ref = lu->GetParameters();
+
+	// Points on the control grid: Phi is square and equals S
+	SolverTestTransform::Pointer tfm = SolverTestTransform::New();
+	tfm->SetControlGridInformation( m_field );
+	tfm->SetDisplacementField( m_field );
+	tfm->SetOutputReference( m_field );
+	tfm->SetSolverTolerance( 1.0e-5 );
+	tfm->SetSolverMaximumIterations( 5000 );
+
+	Transform::DimensionParameters coeffs;
+	size_t iterations = tfm->FitField( coeffs );
+	EXPECT_LT( iterations, tfm->GetSolverMaximumIterations() );
+
+	size_t n = coeffs[0].size();
+	ASSERT_EQ( ref.Size(), 3 * n );
+	for ( size_t d = 0; d < 3; d++ ) {
+		for ( size_t k = 0; k < n; k++ ) {
+			double expected = ref[d * n + k];
+			EXPECT_NEAR( expected, coeffs[d][k], 1.0e-3 * ( 1.0 + fabs( expected ) ) ) << "coefficient " << k << ", component " << d;
+		}
+	}
+}
+
+TEST_F( TransformTests, InvertPhiMatchesLU ) {
+	PrefilterTestTransform::Pointer lu = PrefilterTestTransform::New();
+	lu->SetUsePrefilter( false );
+	lu->SetControlGridInformation( m_field );
+	lu->SetDisplacementField( m_field );
+	lu->ComputeCoefficients();
+	const Transform::ParametersType& ref = lu->GetParameters();
+
+	SolverTestTransform::Pointer tfm = SolverTestTransform::New();
+	tfm->SetControlGridInformation( m_field );
+	tfm->SetDisplacementField( m_field );
+	tfm->SetOutputReference( m_field );
+
+	const Transform::WeightsMatrix& inv = tfm->ComputePhiInverse();
+	EXPECT_FALSE( tfm->IsFactorized() );
+
+	size_t n = inv.rows();
+	ASSERT_EQ( ref.Size(), 3 * n );
+
+	const VectorType* fbuf = m_field->GetBufferPointer();
+	Transform::DimensionVector values( inv.cols() ), coeffs;
+	for ( size_t d = 0; d < 3; d++ ) {
+		for ( size_t k = 0; k < values.size(); k++ ) values[k] = fbuf[k][d];
+		inv.mult( values, coeffs );
+
+		for ( size_t k = 0; k < n; k++ ) {
+			double expected = ref[d * n + k];
+			EXPECT_NEAR( expected, coeffs[k], 1.0e-4 * ( 1.0 + fabs( expected ) ) ) << "coefficient " << k << ", component " << d;
+		}
+	}
+}
+
+typedef CompressedSparseMatrix< ScalarType, 3 >        CSRMatrix;
+typedef CSRMatrix::SourceMatrixType                    SourceMatrix;
+typedef CSRMatrix::VectorType                          CSRVector;
+typedef CSRMatrix::MultiVectorType                     CSRMultiVector;
+
+/** Random matrix where every third row (and every fifth column) is empty */
+SourceMatrix RandomSparseMatrix( size_t nrows, size_t ncols, size_t perRow ) {
+	SourceMatrix m( nrows, ncols );
+	srand( 42 );
+	for ( size_t r = 0; r < nrows; r++ ) {
+		if ( r % 3 == 1 ) continue;
+		for ( size_t k = 0; k < perRow; k++ ) {
+			size_t c = rand() % ncols;
+			if ( c % 5 == 2 ) continue;
+			m( r, c ) = ( rand() % 2001 - 1000 ) * 1.0e-3;
+		}
+	}
+	return m;
+}
+
+CSRMultiVector RandomMultiVector( size_t n ) {
+	CSRMultiVector x;
+	for ( size_t d = 0; d < 3; d++ ) {
+		x[d].set_size( n );
+		for ( size_t i = 0; i < n; i++ ) x[d][i] = ( rand() % 2001 - 1000 ) * 1.0e-2;
+	}
+	return x;
+}
+
+/** Compares Multiply and TransposeMultiply with vnl mult and pre_mult */
+void CompareWithSourceMatrix( const SourceMatrix& m, itk::MultiThreader* threader ) {
+	CSRMatrix csr;
+	csr.SetMatrix( m );
+	ASSERT_EQ( m.rows(), csr.rows() );
+	ASSERT_EQ( m.cols(), csr.cols() );
+
+	CSRMultiVector x = RandomMultiVector( m.cols() );
+	CSRMultiVector xt = RandomMultiVector( m.rows() );
+	CSRMultiVector y, yt;
+	csr.Multiply( x, y, threader );
+	csr.TransposeMultiply( xt, yt, threader );
+
+	for ( size_t d = 0; d < 3; d++ ) {
+		CSRVector ref, reft;
+		m.mult( x[d], ref );
+		m.pre_mult( xt[d], reft );
+
+		ASSERT_EQ( m.rows(), y[d].size() );
+		ASSERT_EQ( m.cols(), yt[d].size() );
+		for ( size_t r = 0; r < m.rows(); r++ ) {
+			EXPECT_NEAR( ref[r], y[d][r], 1.0e-4 * ( 1.0 + fabs( ref[r] ) ) ) << "row " << r << ", component " << d;
+		}
+		for ( size_t c = 0; c < m.cols(); c++ ) {
+			EXPECT_NEAR( reft[c], yt[d][c], 1.0e-4 * ( 1.0 + fabs( reft[c] ) ) ) << "column " << c << ", component " << d;
+		}
+	}
+}
+
+TEST( CompressedSparseMatrixTests, ProductsMatchVNL ) {
+	SourceMatrix m = RandomSparseMatrix( 300, 170, 9 );
+	CompareWithSourceMatrix( m, NULL );
+}
+
+TEST( CompressedSparseMatrixTests, ThreadedProductsMatchVNL ) {
+	SourceMatrix m = RandomSparseMatrix( 300, 170, 9 );
+	itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+	threader->SetNumberOfThreads( 4 );
+	CompareWithSourceMatrix( m, threader );
+}
+
+TEST( CompressedSparseMatrixTests, NoNonZeros ) {
+	SourceMatrix m( 40, 25 );
+	itk::MultiThreader::Pointer threader = itk::MultiThreader::New();
+	threader->SetNumberOfThreads( 4 );
+
+	CSRMatrix csr;
+	csr.SetMatrix( m );
+	EXPECT_EQ( 0u, csr.GetNumberOfNonZeros() );
+
+	CompareWithSourceMatrix( m, NULL );
+	CompareWithSourceMatrix( m, threader );
+
+	// Products with an empty matrix must overwrite stale outputs with zeros
+	CSRMultiVector x = RandomMultiVector( m.cols() );
+	CSRMultiVector y = RandomMultiVector( m.rows() );
+	csr.Multiply( x, y, threader );
+	for ( size_t d = 0; d < 3; d++ ) {
+		EXPECT_EQ( 0.0, y[d].inf_norm() );
+	}
+}
+
+TEST( CompressedSparseMatrixTests, TakeOverCSRArrays ) {
+	SourceMatrix m = RandomSparseMatrix( 64, 48, 5 );
+
+	CSRMatrix::PointerContainer pointers( 1, 0 );
+	CSRMatrix::IndexContainer indices;
+	CSRMatrix::ValueContainer values;
+	for ( size_t r = 0; r < m.rows(); r++ ) {
+		const SourceMatrix::row& row = m.get_row( r );
+		for ( size_t i = 0; i < row.size(); i++ ) {
+			indices.push_back( row[i].first );
+			values.push_back( row[i].second );
+		}
+		pointers.push_back( indices.size() );
+	}
+
+	CSRMatrix csr;
+	csr.SetMatrix( m.rows(), m.cols(), pointers, indices, values );
+
+	CSRMatrix ref;
+	ref.SetMatrix( m );
+	EXPECT_EQ( ref.GetRowPointers(), csr.GetRowPointers() );
+	EXPECT_EQ( ref.GetColumnIndices(), csr.GetColumnIndices() );
+	EXPECT_EQ( ref.GetValues(), csr.GetValues() );
+}
 } // namespace rstk